@@ -10,5 +10,14 @@ public class NetworkShooterTarget : TargetRules
 		Type = TargetType.Game;
 		DefaultBuildSettings = BuildSettingsVersion.V2;
 		ExtraModuleNames.Add("NetworkShooter");
+
+		// Player state and character properties are push model replicated. A launcher install shares its prebuilt
+		// engine binaries, which are built without it, and won't let a target change that. Against a source built
+		// engine the target builds its own copy of the engine with push model like NetworkShooterServer
+		if (!UnrealBuildTool.IsEngineInstalled())
+		{
+			BuildEnvironment = TargetBuildEnvironment.Unique;
+			bWithPushModel = true;
+		}
 	}
 }
@@ -2,11 +2,45 @@
 
 
 #include "NSGameState.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterNetProfiles.h"
+#include "EngineUtils.h"
+#include "Engine/Channel.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "HAL/IConsoleManager.h"
+#include "Materials/MaterialInstanceDynamic.h"
 #include "Net/UnrealNetwork.h"
+#include "UObject/UObjectIterator.h"
 
 ANSGameState::ANSGameState()
 {
 	bInMenu = false;
+
+	TeamMaterialsCreated = 0;
+	TeamMaterialRequests = 0;
+
+	EmitterPool.SetOwner(this);
+	Ragdolls.SetOwner(this);
+}
+
+void ANSGameState::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	UNetworkShooterNetProfiles::Apply(this);
+}
+
+void ANSGameState::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Characters that replicated before the game state couldn't get their team material yet
+	for (TActorIterator<ANetworkShooterCharacter> Iter(GetWorld()); Iter; ++Iter)
+	{
+		(*Iter)->ApplyTeamColor();
+	}
 }
 
 void ANSGameState::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
@@ -14,4 +48,170 @@ void ANSGameState::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLife
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
 	DOREPLIFETIME(ANSGameState, bInMenu);
-}
\ No newline at end of file
+}
+
+void ANSGameState::SetInMenu(bool bNewInMenu)
+{
+	if (bInMenu != bNewInMenu)
+	{
+		bInMenu = bNewInMenu;
+		ForceNetUpdate();
+		OnRep_InMenu();
+	}
+}
+
+void ANSGameState::OnRep_InMenu()
+{
+	ClientEvents.OnMenuChanged.Broadcast(bInMenu);
+}
+
+void ANSGameState::AddPlayerState(APlayerState* PlayerState)
+{
+	Super::AddPlayerState(PlayerState);
+	ClientEvents.OnScoreboardChanged.Broadcast();
+}
+
+void ANSGameState::RemovePlayerState(APlayerState* PlayerState)
+{
+	Super::RemovePlayerState(PlayerState);
+	ClientEvents.OnScoreboardChanged.Broadcast();
+}
+
+UMaterialInterface* ANSGameState::GetTeamMaterial(UMaterialInterface* BaseMaterial, ETeam Team)
+{
+	if (BaseMaterial == nullptr)
+	{
+		return nullptr;
+	}
+
+	TeamMaterialRequests++;
+
+	FNSTeamMaterialKey Key;
+	Key.BaseMaterial = BaseMaterial;
+	Key.Team = (uint8)Team;
+
+	UMaterialInstanceDynamic*& TeamMaterial = TeamMaterials.FindOrAdd(Key);
+
+	if (TeamMaterial == nullptr)
+	{
+		TeamMaterial = UMaterialInstanceDynamic::Create(BaseMaterial, this);
+		TeamMaterial->SetVectorParameterValue(TEXT("BodyColor"), Team == ETeam::BLUE_TEAM ? FLinearColor(0.0f, 0.0f, 0.5f) : FLinearColor(0.5f, 0.0f, 0.0f));
+
+		TeamMaterialsCreated++;
+	}
+
+	return TeamMaterial;
+}
+
+void ANSGameState::LogTeamMaterialStats() const
+{
+	int32 Characters = 0;
+	TSet<UMaterialInterface*> BodyMaterials;
+
+	for (TActorIterator<ANetworkShooterCharacter> Iter(GetWorld()); Iter; ++Iter)
+	{
+		Characters++;
+		BodyMaterials.Add((*Iter)->GetMesh()->GetMaterial(0));
+	}
+
+	int32 WorldMaterialInstances = 0;
+
+	for (TObjectIterator<UMaterialInstanceDynamic> Iter; Iter; ++Iter)
+	{
+		if (Iter->GetWorld() == GetWorld())
+		{
+			WorldMaterialInstances++;
+		}
+	}
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Team materials: %d characters using %d distinct body materials, %d dynamic material instances in the world, %d team materials created for %d requests, %d cached"),
+		Characters, BodyMaterials.Num(), WorldMaterialInstances, TeamMaterialsCreated, TeamMaterialRequests, TeamMaterials.Num());
+}
+
+void ANSGameState::MultiCastFireEffects_Implementation(const FNetworkShooterFireEffectBatch& Batch)
+{
+	for (const FNetworkShooterFireEffect& Effect : Batch.Effects)
+	{
+		ANetworkShooterCharacter* Shooter = Effect.Shooter.Get();
+
+		if (Shooter == nullptr)
+		{
+			continue;
+		}
+
+		if (Effect.TimeOffset == 0)
+		{
+			Shooter->PlayShootEffects();
+		}
+		else
+		{
+			// Keep the spacing the shots had on the server
+			FTimerHandle thisTimer;
+			GetWorldTimerManager().SetTimer(thisTimer, FTimerDelegate::CreateWeakLambda(Shooter, [Shooter]()
+			{
+				Shooter->PlayShootEffects();
+			}), Effect.TimeOffset / 1000.0f, false);
+		}
+	}
+}
+
+static void LogTeamMaterialStats(const TArray<FString>& Args, UWorld* World)
+{
+	ANSGameState* thisGameState = World ? World->GetGameState<ANSGameState>() : nullptr;
+
+	if (thisGameState != nullptr)
+	{
+		thisGameState->LogTeamMaterialStats();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs TeamMaterialStatsCommand(
+	TEXT("ns.TeamMaterials.Stats"),
+	TEXT("Logs how many body materials and dynamic material instances the characters in this world use"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LogTeamMaterialStats));
+
+static void LogReliableStats(const TArray<FString>& Args, UWorld* World)
+{
+	UNetDriver* Driver = World ? World->GetNetDriver() : nullptr;
+
+	if (Driver == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("ns.Net.ReliableStats needs a networked world"));
+		return;
+	}
+
+	TArray<UNetConnection*> Connections;
+
+	if (Driver->ServerConnection != nullptr)
+	{
+		Connections.Add(Driver->ServerConnection);
+	}
+	else
+	{
+		Connections = Driver->ClientConnections;
+	}
+
+	for (UNetConnection* Connection : Connections)
+	{
+		int32 InFlight = 0;
+		int32 WorstChannel = 0;
+
+		for (UChannel* Channel : Connection->OpenChannels)
+		{
+			if (Channel != nullptr)
+			{
+				InFlight += Channel->NumOutRec;
+				WorstChannel = FMath::Max(WorstChannel, Channel->NumOutRec);
+			}
+		}
+
+		// A channel that reaches RELIABLE_BUFFER unacked bunches closes the connection
+		UE_LOG(LogNetworkShooter, Display, TEXT("%s: %d channels, %d reliable bunches unacked, %d on the worst channel (limit %d)"),
+			*Connection->LowLevelGetRemoteAddress(true), Connection->OpenChannels.Num(), InFlight, WorstChannel, RELIABLE_BUFFER);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs ReliableStatsCommand(
+	TEXT("ns.Net.ReliableStats"),
+	TEXT("Logs the reliable bunches waiting for an ack on each connection"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LogReliableStats));
@@ -4,8 +4,32 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/GameState.h"
+#include "NetworkShooterClientEvents.h"
+#include "NetworkShooterEmitterPool.h"
+#include "NetworkShooterFireEffects.h"
+#include "NetworkShooterRagdollManager.h"
 #include "NSGameState.generated.h"
 
+class UMaterialInstanceDynamic;
+class UMaterialInterface;
+
+/** A shared team material is built per base material and team, ETeam as its uint8 */
+USTRUCT()
+struct FNSTeamMaterialKey
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UMaterialInterface* BaseMaterial = nullptr;
+
+	UPROPERTY()
+	uint8 Team = 0;
+
+	bool operator==(const FNSTeamMaterialKey& Other) const { return BaseMaterial == Other.BaseMaterial && Team == Other.Team; }
+
+	friend uint32 GetTypeHash(const FNSTeamMaterialKey& Key) { return HashCombine(GetTypeHash(Key.BaseMaterial), Key.Team); }
+};
+
 /**
  * 
  */
@@ -17,6 +41,53 @@ class NETWORKSHOOTER_API ANSGameState : public AGameState
 public:
 	ANSGameState();
 
-	UPROPERTY(Replicated)
+	// Set it through SetInMenu on the server
+	UPROPERTY(ReplicatedUsing = OnRep_InMenu)
 	bool bInMenu;
+
+	void SetInMenu(bool bNewInMenu);
+
+	// Replays every shot the server ran this frame, sent once per frame by the game mode
+	UFUNCTION(NetMulticast, Unreliable)
+	void MultiCastFireEffects(const FNetworkShooterFireEffectBatch& Batch);
+
+	FNetworkShooterEmitterPool& GetEmitterPool() { return EmitterPool; }
+
+	FNetworkShooterRagdollManager& GetRagdolls() { return Ragdolls; }
+
+	virtual void AddPlayerState(APlayerState* PlayerState) override;
+	virtual void RemovePlayerState(APlayerState* PlayerState) override;
+
+	FNetworkShooterClientEvents& GetClientEvents() { return ClientEvents; }
+
+	// One shared body material per team built from BaseMaterial, so characters on a team batch together.
+	// Client side, null without a base material
+	UMaterialInterface* GetTeamMaterial(UMaterialInterface* BaseMaterial, ETeam Team);
+
+	void LogTeamMaterialStats() const;
+
+	virtual void PostInitializeComponents() override;
+
+protected:
+	virtual void BeginPlay() override;
+
+	UFUNCTION()
+	void OnRep_InMenu();
+
+private:
+	// Replicated state changes for the HUD, materials and audio
+	FNetworkShooterClientEvents ClientEvents;
+
+	// Shot effect particles for this world, client side
+	FNetworkShooterEmitterPool EmitterPool;
+
+	// Death physics budget for this world
+	FNetworkShooterRagdollManager Ragdolls;
+
+	// Characters may use different body materials, each gets its own pair of team materials
+	UPROPERTY(Transient)
+	TMap<FNSTeamMaterialKey, UMaterialInstanceDynamic*> TeamMaterials;
+
+	int32 TeamMaterialsCreated;
+	int32 TeamMaterialRequests;
 };
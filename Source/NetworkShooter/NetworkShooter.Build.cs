@@ -8,6 +8,8 @@ public class NetworkShooter : ModuleRules
 	{
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
-		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay" });
+		// HeadMountedDisplay stays on the server too: the character's motion controller properties are typed
+		// UMotionControllerComponent for the blueprint, a dedicated server just never creates them
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay", "NetCore", "AIModule", "ReplicationGraph" });
 	}
 }
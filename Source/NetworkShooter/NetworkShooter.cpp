@@ -1,7 +1,31 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "NetworkShooter.h"
+#include "NetworkShooterFrameBudget.h"
+#include "NetworkShooterReplicationGraph.h"
+#include "Misc/CoreDelegates.h"
 #include "Modules/ModuleManager.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, NetworkShooter, "NetworkShooter" );
+class FNetworkShooterModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+		UNetworkShooterReplicationGraph::RegisterReplicationDriver();
+
+		EndFrameHandle = FCoreDelegates::OnEndFrame.AddRaw(&FNetworkShooterFrameBudget::Get(), &FNetworkShooterFrameBudget::EndFrame);
+	}
+
+	virtual void ShutdownModule() override
+	{
+		FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+	}
+
+private:
+	FDelegateHandle EndFrameHandle;
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FNetworkShooterModule, NetworkShooter, "NetworkShooter" );
+
+DEFINE_LOG_CATEGORY(LogNetworkShooter);
  
\ No newline at end of file
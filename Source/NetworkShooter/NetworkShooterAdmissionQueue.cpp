@@ -0,0 +1,192 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterAdmissionQueue.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterGameMode.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarLoginMaxPerFrame(
+	TEXT("ns.Login.MaxPerFrame"),
+	4,
+	TEXT("Most waiting players given a pawn in one server frame."));
+
+static TAutoConsoleVariable<float> CVarLoginBudgetMs(
+	TEXT("ns.Login.BudgetMs"),
+	3.0f,
+	TEXT("Milliseconds a frame may spend admitting players. At least one is admitted every frame whatever the budget."));
+
+FNetworkShooterAdmissionQueue::FNetworkShooterAdmissionQueue()
+	: bUpdating(false)
+	, bRemovedWhileUpdating(false)
+	, TotalAdmitted(0)
+	, MaxDepth(0)
+	, StormAdmitted(0)
+	, StormFrames(0)
+	, StormMaxFrameSeconds(0.0)
+	, StormMaxWait(0.0)
+	, LastStormAdmitted(0)
+	, LastStormFrames(0)
+	, LastStormMaxFrameSeconds(0.0)
+	, LastStormMaxWait(0.0)
+{
+}
+
+void FNetworkShooterAdmissionQueue::Enqueue(AController* Controller, ETeam Team, double Now)
+{
+	if (Contains(Controller))
+	{
+		return;
+	}
+
+	Entries.Add({ Controller, Team, Now });
+	MaxDepth = FMath::Max(MaxDepth, Entries.Num());
+}
+
+void FNetworkShooterAdmissionQueue::Remove(AController* Controller)
+{
+	if (!bUpdating)
+	{
+		Entries.RemoveAll([Controller](const FEntry& Entry) { return Entry.Controller.Get() == Controller; });
+		return;
+	}
+
+	for (FEntry& Entry : Entries)
+	{
+		if (Entry.Controller.Get() == Controller)
+		{
+			Entry.Controller = nullptr;
+			bRemovedWhileUpdating = true;
+		}
+	}
+}
+
+bool FNetworkShooterAdmissionQueue::Contains(const AController* Controller) const
+{
+	return Entries.ContainsByPredicate([Controller](const FEntry& Entry) { return Entry.Controller.Get() == Controller; });
+}
+
+int32 FNetworkShooterAdmissionQueue::Num(ETeam Team) const
+{
+	int32 Count = 0;
+
+	for (const FEntry& Entry : Entries)
+	{
+		Count += Entry.Team == Team ? 1 : 0;
+	}
+
+	return Count;
+}
+
+int32 FNetworkShooterAdmissionQueue::Update(double Now, TFunctionRef<void(AController*)> Admit)
+{
+	if (Entries.Num() == 0)
+	{
+		return 0;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	const double Budget = CVarLoginBudgetMs.GetValueOnGameThread() / 1000.0;
+	const int32 MaxPerFrame = FMath::Max(CVarLoginMaxPerFrame.GetValueOnGameThread(), 1);
+
+	int32 NumAdmitted = 0;
+	int32 NumTaken = 0;
+
+	TGuardValue<bool> UpdatingGuard(bUpdating, true);
+
+	while (NumTaken < Entries.Num() && NumAdmitted < MaxPerFrame)
+	{
+		// Checked before each admission but the first, so a budget below the cost of one spawn still drains
+		if (NumAdmitted > 0 && FPlatformTime::Seconds() - StartTime >= Budget)
+		{
+			break;
+		}
+
+		const FEntry Entry = Entries[NumTaken++];
+		AController* Controller = Entry.Controller.Get();
+
+		// Left while waiting, or during an earlier Admit of this frame
+		if (Controller == nullptr || Controller->IsPendingKillPending())
+		{
+			continue;
+		}
+
+		StormMaxWait = FMath::Max(StormMaxWait, Now - Entry.EnqueueTime);
+
+		Admit(Controller);
+		NumAdmitted++;
+	}
+
+	// Taken off in one go. Admit never queues anyone, and players it logged out are only cleared so far
+	check(NumTaken <= Entries.Num());
+	Entries.RemoveAt(0, NumTaken, false);
+
+	if (bRemovedWhileUpdating)
+	{
+		Entries.RemoveAll([](const FEntry& Entry) { return Entry.Controller.IsExplicitlyNull(); });
+		bRemovedWhileUpdating = false;
+	}
+
+	TotalAdmitted += NumAdmitted;
+	StormAdmitted += NumAdmitted;
+	StormFrames++;
+	StormMaxFrameSeconds = FMath::Max(StormMaxFrameSeconds, FPlatformTime::Seconds() - StartTime);
+
+	if (Entries.Num() == 0)
+	{
+		UE_LOG(LogNetworkShooter, Log, TEXT("Admission: %d players over %d frames, worst frame %.2fms admitting, longest wait %.2fs"),
+			StormAdmitted, StormFrames, StormMaxFrameSeconds * 1000.0, StormMaxWait);
+
+		LastStormAdmitted = StormAdmitted;
+		LastStormFrames = StormFrames;
+		LastStormMaxFrameSeconds = StormMaxFrameSeconds;
+		LastStormMaxWait = StormMaxWait;
+
+		StormAdmitted = 0;
+		StormFrames = 0;
+		StormMaxFrameSeconds = 0.0;
+		StormMaxWait = 0.0;
+	}
+
+	return NumAdmitted;
+}
+
+void FNetworkShooterAdmissionQueue::LogStats() const
+{
+	UE_LOG(LogNetworkShooter, Display, TEXT("Admission queue: depth %d (max %d), %d admitted"), Num(), MaxDepth, TotalAdmitted);
+	UE_LOG(LogNetworkShooter, Display, TEXT("  last drain: %d players over %d frames, worst frame %.2fms admitting, longest wait %.2fs"),
+		LastStormAdmitted, LastStormFrames, LastStormMaxFrameSeconds * 1000.0, LastStormMaxWait);
+}
+
+static void LogAdmissionStats(const TArray<FString>& Args, UWorld* World)
+{
+	if (ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr)
+	{
+		GameMode->GetAdmissions().LogStats();
+	}
+}
+
+static void RunJoinStorm(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("JoinStorm: no NetworkShooter game mode, run this on the server"));
+		return;
+	}
+
+	GameMode->SimulateJoinStorm(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 64);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs AdmissionStatsCommand(
+	TEXT("ns.Login.Stats"),
+	TEXT("Logs the admission queue and how the last join storm drained"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LogAdmissionStats));
+
+static FAutoConsoleCommandWithWorldAndArgs JoinStormCommand(
+	TEXT("ns.Login.JoinStorm"),
+	TEXT("Joins bot players all in one frame the way logins after a map change arrive, through the admission queue unless ns.Login.Queue is 0. Logs the whole frames they took once all are admitted, then removes them. Usage: ns.Login.JoinStorm [Players=64]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunJoinStorm));
@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AController;
+enum class ETeam : uint8;
+
+/**
+ * Players that have logged in but don't have a pawn yet, in login order. After a map change every
+ * client arrives within a few frames, and spawning and placing a pawn is a few milliseconds each,
+ * so the game mode admits at most ns.Login.MaxPerFrame a frame and stops early once
+ * ns.Login.BudgetMs is spent. Teams are picked at login, so they replicate while players wait.
+ */
+class NETWORKSHOOTER_API FNetworkShooterAdmissionQueue
+{
+public:
+	FNetworkShooterAdmissionQueue();
+
+	void Enqueue(AController* Controller, ETeam Team, double Now);
+	void Remove(AController* Controller);
+	bool Contains(const AController* Controller) const;
+
+	int32 Num() const { return Entries.Num(); }
+
+	// Players of Team still waiting, so team balance counts them before they have a pawn
+	int32 Num(ETeam Team) const;
+
+	// Admits players in login order within this frame's limits, returns how many
+	int32 Update(double Now, TFunctionRef<void(AController*)> Admit);
+
+	void LogStats() const;
+
+private:
+	struct FEntry
+	{
+		TWeakObjectPtr<AController> Controller;
+		ETeam Team;
+		double EnqueueTime;
+	};
+
+	TArray<FEntry> Entries;
+
+	// Admit may log a player out, which removes it while Update still indexes Entries. Those are
+	// only cleared then and taken out once Update is done
+	bool bUpdating;
+	bool bRemovedWhileUpdating;
+
+	int32 TotalAdmitted;
+	int32 MaxDepth;
+
+	// The current join storm, from the first login into an empty queue until it drains again
+	int32 StormAdmitted;
+	int32 StormFrames;
+	double StormMaxFrameSeconds;
+	double StormMaxWait;
+
+	// The last storm that drained, for ns.Login.Stats
+	int32 LastStormAdmitted;
+	int32 LastStormFrames;
+	double LastStormMaxFrameSeconds;
+	double LastStormMaxWait;
+};
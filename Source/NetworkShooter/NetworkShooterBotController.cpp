@@ -0,0 +1,146 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterBotController.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterGameMode.h"
+#include "NetworkShooterPlayerState.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<float> CVarBotFireInterval(
+	TEXT("ns.Bots.FireInterval"),
+	0.2f,
+	TEXT("Seconds between bot shots while they have a target."));
+
+static TAutoConsoleVariable<float> CVarBotSpread(
+	TEXT("ns.Bots.Spread"),
+	3.0f,
+	TEXT("Half angle in degrees of the cone bots fire into, so not every shot lands."));
+
+static TAutoConsoleVariable<float> CVarBotRange(
+	TEXT("ns.Bots.Range"),
+	5000.0f,
+	TEXT("Bots only pick targets closer than this."));
+
+ANetworkShooterBotController::ANetworkShooterBotController()
+{
+	bWantsPlayerState = true;
+
+	WanderDirection = FVector::ForwardVector;
+	NextRetarget = 0.0f;
+	NextWander = 0.0f;
+	NextFire = 0.0f;
+}
+
+void ANetworkShooterBotController::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	ANetworkShooterCharacter* BotChar = Cast<ANetworkShooterCharacter>(GetPawn());
+	ANetworkShooterPlayerState* BotPS = GetPlayerState<ANetworkShooterPlayerState>();
+
+	// Dead bots wait for the game mode to respawn them
+	if (BotChar == nullptr || BotPS == nullptr || BotPS->Health <= 0 || BotChar->IsInPool())
+	{
+		return;
+	}
+
+	const float Now = GetWorld()->GetTimeSeconds();
+
+	if (Now >= NextWander)
+	{
+		WanderDirection = FRotator(0.0f, FMath::FRandRange(0.0f, 360.0f), 0.0f).Vector();
+		NextWander = Now + FMath::FRandRange(1.0f, 3.0f);
+	}
+
+	BotChar->AddMovementInput(WanderDirection, 1.0f);
+
+	if (Now >= NextRetarget)
+	{
+		Target = FindTarget(BotChar);
+
+		// Spread out so a crowd of bots doesn't all search in the same frame
+		NextRetarget = Now + FMath::FRandRange(0.4f, 0.6f);
+	}
+
+	ANetworkShooterCharacter* TargetChar = Target.Get();
+
+	if (TargetChar == nullptr || TargetChar->IsInPool() || TargetChar->IsDead())
+	{
+		return;
+	}
+
+	const FVector Origin = BotChar->GetPawnViewLocation();
+	const FVector ToTarget = (TargetChar->GetActorLocation() - Origin).GetSafeNormal();
+
+	SetControlRotation(ToTarget.Rotation());
+
+	if (Now >= NextFire)
+	{
+		BotChar->FireAt(Origin, FMath::VRandCone(ToTarget, FMath::DegreesToRadians(CVarBotSpread.GetValueOnGameThread())));
+		NextFire = Now + CVarBotFireInterval.GetValueOnGameThread();
+	}
+}
+
+ANetworkShooterCharacter* ANetworkShooterBotController::FindTarget(ANetworkShooterCharacter* BotChar) const
+{
+	ANetworkShooterGameMode* GameMode = Cast<ANetworkShooterGameMode>(GetWorld()->GetAuthGameMode());
+
+	if (GameMode == nullptr)
+	{
+		return nullptr;
+	}
+
+	ANetworkShooterCharacter* Best = nullptr;
+	float BestDistSq = FMath::Square(CVarBotRange.GetValueOnGameThread());
+
+	// The game mode's list, gathered once a frame for every bot instead of an actor iterator each
+	for (ANetworkShooterCharacter* thisChar : GameMode->GetLivingCharacters())
+	{
+		if (thisChar == BotChar || !IsValid(thisChar) || thisChar->IsInPool() || thisChar->IsDead() || thisChar->CurrentTeam == BotChar->CurrentTeam)
+		{
+			continue;
+		}
+
+		const float DistSq = FVector::DistSquared(thisChar->GetActorLocation(), BotChar->GetActorLocation());
+
+		if (DistSq < BestDistSq)
+		{
+			Best = thisChar;
+			BestDistSq = DistSq;
+		}
+	}
+
+	return Best;
+}
+
+static void AddBots(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("ns.Bots.Add only works on the server"));
+		return;
+	}
+
+	const int32 NumBots = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1;
+	int32 NumAdded = 0;
+
+	for (int32 i = 0; i < NumBots; i++)
+	{
+		if (GameMode->AddBot() != nullptr)
+		{
+			NumAdded++;
+		}
+	}
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Added %d bots"), NumAdded);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs AddBotsCommand(
+	TEXT("ns.Bots.Add"),
+	TEXT("Adds server side bots that move, fire and respawn. Usage: ns.Bots.Add [NumBots=1]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&AddBots));
@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AIController.h"
+#include "NetworkShooterBotController.generated.h"
+
+class ANetworkShooterCharacter;
+
+/**
+ * Server side scripted player for load testing. Wanders about, turns to the nearest enemy
+ * and fires through the same fire command path a client uses, then dies and respawns like
+ * anyone else. Added with ns.Bots.Add.
+ */
+UCLASS()
+class NETWORKSHOOTER_API ANetworkShooterBotController : public AAIController
+{
+	GENERATED_BODY()
+
+public:
+	ANetworkShooterBotController();
+
+	virtual void Tick(float DeltaSeconds) override;
+
+private:
+	ANetworkShooterCharacter* FindTarget(ANetworkShooterCharacter* BotChar) const;
+
+	TWeakObjectPtr<ANetworkShooterCharacter> Target;
+	FVector WanderDirection;
+
+	float NextRetarget;
+	float NextWander;
+	float NextFire;
+};
@@ -1,23 +1,47 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "NetworkShooterCharacter.h"
+#include "NetworkShooter.h"
 #include "NetworkShooterProjectile.h"
+#include "NetworkShooterFrameBudget.h"
 #include "Animation/AnimInstance.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
+#include "GameFramework/CharacterMovementComponent.h"
 #include "GameFramework/InputSettings.h"
-#include "HeadMountedDisplayFunctionLibrary.h"
 #include "Kismet/GameplayStatics.h"
-#include "MotionControllerComponent.h"
+#include "Misc/CommandLine.h"
 #include "Particles/ParticleSystemComponent.h"
+#include "UObject/ConstructorHelpers.h"
 #include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
+#include "NetworkShooterClientEvents.h"
 #include "NetworkShooterPlayerState.h"
-#include "DrawDebugHelpers.h"
+#include "NetworkShooterRagdollManager.h"
+#include "NSGameState.h"
+#include "GameFramework/GameStateBase.h"
+#include "EngineUtils.h"
+#include "HeadMountedDisplayFunctionLibrary.h"
+#include "MotionControllerComponent.h"
 #include "XRMotionControllerBase.h" // for FXRMotionControllerBase::RightHandSourceId
 
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 
+// How far the server traces a shot from its origin
+static const float FireRange = 10000000.0f;
+
+static TAutoConsoleVariable<int32> CVarFireReliable(
+	TEXT("ns.Fire.Reliable"),
+	0,
+	TEXT("Send fire events as reliable RPCs instead of the redundant unreliable stream, to compare hit registration under net.PktLoss."));
+
+// The first person, VR and effect components are left out on a dedicated server unless it runs with -KeepCosmetics. See ns.Pawn.CostReport
+static bool ShouldStripCosmetics()
+{
+	return IsRunningDedicatedServer() && !FParse::Param(FCommandLine::Get(), TEXT("KeepCosmetics"));
+}
+
 //////////////////////////////////////////////////////////////////////////
 // ANetworkShooterCharacter
 
@@ -30,82 +54,150 @@ ANetworkShooterCharacter::ANetworkShooterCharacter()
 	BaseTurnRate = 45.f;
 	BaseLookUpRate = 45.f;
 
-	// Create a CameraComponent	
-	FirstPersonCameraComponent = CreateDefaultSubobject<UCameraComponent>(TEXT("FirstPersonCamera"));
-	FirstPersonCameraComponent->SetupAttachment(GetCapsuleComponent());
-	FirstPersonCameraComponent->SetRelativeLocation(FVector(-39.56f, 1.75f, 64.f)); // Position the camera
-	FirstPersonCameraComponent->bUsePawnControlRotation = true;
-
-	// Create a mesh component that will be used when being viewed from a '1st person' view (when controlling this pawn)
-	FP_MESH = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("CharacterMesh1P"));
-	FP_MESH->SetOnlyOwnerSee(true);
-	FP_MESH->SetupAttachment(FirstPersonCameraComponent);
-	FP_MESH->bCastDynamicShadow = false;
-	FP_MESH->CastShadow = false;
-	FP_MESH->SetRelativeRotation(FRotator(1.9f, -19.19f, 5.2f));
-	FP_MESH->SetRelativeLocation(FVector(-0.5f, -4.4f, -155.7f));
-
-	// Create a gun mesh component (1st person)
-	FP_Gun = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("FP_Gun"));
-	FP_Gun->SetOnlyOwnerSee(true);			// otherwise won't be visible in the multiplayer
-	FP_Gun->bCastDynamicShadow = false;
-	FP_Gun->CastShadow = false;
-	FP_Gun->SetupAttachment(FP_MESH, TEXT("GripPoint"));
-
-	// Create a gun mesh component (3rd person)
-	TP_Gun = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("TP_Gun"));
-	TP_Gun->SetOwnerNoSee(true);
-	TP_Gun->SetupAttachment(GetMesh(), TEXT("hand_rSocket"));
-
 	GetMesh()->SetOwnerNoSee(true);
 
-	// Create particle systems
-	TP_GunShotParticle = CreateDefaultSubobject<UParticleSystemComponent>(TEXT("ParticleSysTP"));
-
-	TP_GunShotParticle->bAutoActivate = false;
-	TP_GunShotParticle->SetupAttachment(TP_Gun);
-	TP_GunShotParticle->SetOwnerNoSee(true);
-
-	FP_GunShotParticle = CreateDefaultSubobject<UParticleSystemComponent>(TEXT("ParticleSysFP"));
-
-	FP_GunShotParticle->bAutoActivate = false;
-	FP_GunShotParticle->SetupAttachment(FP_Gun);
-	FP_GunShotParticle->SetOnlyOwnerSee(true);
+	// Nobody sees or hears anything on a dedicated server. The properties stay for the blueprint, null there
+	if (!ShouldStripCosmetics())
+	{
+		// Create a CameraComponent	
+		FirstPersonCameraComponent = CreateDefaultSubobject<UCameraComponent>(TEXT("FirstPersonCamera"));
+		FirstPersonCameraComponent->SetupAttachment(GetCapsuleComponent());
+		FirstPersonCameraComponent->SetRelativeLocation(FVector(-39.56f, 1.75f, 64.f)); // Position the camera
+		FirstPersonCameraComponent->bUsePawnControlRotation = true;
+
+		// Create a mesh component that will be used when being viewed from a '1st person' view (when controlling this pawn)
+		FP_MESH = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("CharacterMesh1P"));
+		FP_MESH->SetOnlyOwnerSee(true);
+		FP_MESH->SetupAttachment(FirstPersonCameraComponent);
+		FP_MESH->bCastDynamicShadow = false;
+		FP_MESH->CastShadow = false;
+		FP_MESH->SetRelativeRotation(FRotator(1.9f, -19.19f, 5.2f));
+		FP_MESH->SetRelativeLocation(FVector(-0.5f, -4.4f, -155.7f));
+
+		// Create a gun mesh component (1st person)
+		FP_Gun = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("FP_Gun"));
+		FP_Gun->SetOnlyOwnerSee(true);			// otherwise won't be visible in the multiplayer
+		FP_Gun->bCastDynamicShadow = false;
+		FP_Gun->CastShadow = false;
+		FP_Gun->SetupAttachment(FP_MESH, TEXT("GripPoint"));
+
+		// Create a gun mesh component (3rd person)
+		TP_Gun = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("TP_Gun"));
+		TP_Gun->SetOwnerNoSee(true);
+		TP_Gun->SetupAttachment(GetMesh(), TEXT("hand_rSocket"));
+
+		// Create particle systems
+		TP_GunShotParticle = CreateDefaultSubobject<UParticleSystemComponent>(TEXT("ParticleSysTP"));
+
+		TP_GunShotParticle->bAutoActivate = false;
+		TP_GunShotParticle->SetupAttachment(TP_Gun);
+		TP_GunShotParticle->SetOwnerNoSee(true);
+
+		FP_GunShotParticle = CreateDefaultSubobject<UParticleSystemComponent>(TEXT("ParticleSysFP"));
+
+		FP_GunShotParticle->bAutoActivate = false;
+		FP_GunShotParticle->SetupAttachment(FP_Gun);
+		FP_GunShotParticle->SetOnlyOwnerSee(true);
+
+		BulletParticle = CreateDefaultSubobject<UParticleSystemComponent>(TEXT("BulletSysTP"));
+		BulletParticle->bAutoActivate = false;
+		BulletParticle->SetupAttachment(FirstPersonCameraComponent);
+
+		FP_MuzzleLocation = CreateDefaultSubobject<USceneComponent>(TEXT("MuzzleLocation"));
+		FP_MuzzleLocation->SetupAttachment(FP_Gun);
+		FP_MuzzleLocation->SetRelativeLocation(FVector(0.2f, 48.4f, -10.6f));
+
+		// Note: The ProjectileClass and the skeletal mesh/anim blueprints for Mesh1P, FP_Gun, and VR_Gun 
+		// are set in the derived blueprint asset named MyCharacter to avoid direct content references in C++.
+
+		// Create VR Controllers.
+		R_MotionController = CreateDefaultSubobject<UMotionControllerComponent>(TEXT("R_MotionController"));
+		R_MotionController->MotionSource = FXRMotionControllerBase::RightHandSourceId;
+		R_MotionController->SetupAttachment(RootComponent);
+		L_MotionController = CreateDefaultSubobject<UMotionControllerComponent>(TEXT("L_MotionController"));
+		L_MotionController->SetupAttachment(RootComponent);
+
+		// Create a gun and attach it to the right-hand VR controller.
+		// Create a gun mesh component
+		VR_Gun = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("VR_Gun"));
+		VR_Gun->SetOnlyOwnerSee(false);			// otherwise won't be visible in the multiplayer
+		VR_Gun->bCastDynamicShadow = false;
+		VR_Gun->CastShadow = false;
+		VR_Gun->SetupAttachment(R_MotionController);
+		VR_Gun->SetRelativeRotation(FRotator(0.0f, -90.0f, 0.0f));
+
+		VR_MuzzleLocation = CreateDefaultSubobject<USceneComponent>(TEXT("VR_MuzzleLocation"));
+		VR_MuzzleLocation->SetupAttachment(VR_Gun);
+		VR_MuzzleLocation->SetRelativeLocation(FVector(0.000004, 53.999992, 10.000000));
+		VR_MuzzleLocation->SetRelativeRotation(FRotator(0.0f, 90.0f, 0.0f));		// Counteract the rotation of the VR gun model.
+	}
 
-	BulletParticle = CreateDefaultSubobject<UParticleSystemComponent>(TEXT("BulletSysTP"));
-	BulletParticle->bAutoActivate = false;
-	BulletParticle->SetupAttachment(FirstPersonCameraComponent);
+	// Uncomment the following line to turn motion controllers on by default:
+	//bUsingMotionControllers = true;
 
-	FP_MuzzleLocation = CreateDefaultSubobject<USceneComponent>(TEXT("MuzzleLocation"));
-	FP_MuzzleLocation->SetupAttachment(FP_Gun);
-	FP_MuzzleLocation->SetRelativeLocation(FVector(0.2f, 48.4f, -10.6f));
+	// Defaults for the ragdoll fallback, the blueprint can replace them
+	static ConstructorHelpers::FObjectFinder<UAnimationAsset> Death1(TEXT("/Game/AnimStarterPack/Death_1"));
+	static ConstructorHelpers::FObjectFinder<UAnimationAsset> Death2(TEXT("/Game/AnimStarterPack/Death_2"));
+	static ConstructorHelpers::FObjectFinder<UAnimationAsset> Death3(TEXT("/Game/AnimStarterPack/Death_3"));
+	DeathAnimations.Add(Death1.Object);
+	DeathAnimations.Add(Death2.Object);
+	DeathAnimations.Add(Death3.Object);
+
+	PoolGeneration = 0;
+	bInPool = false;
+	bDead = false;
+	FireInterval = 0.1f;
+	bWantsToFire = false;
+
+	BlueTeamMaterial = nullptr;
+	RedTeamMaterial = nullptr;
+	BodyMaterial = nullptr;
+}
 
-	// Note: The ProjectileClass and the skeletal mesh/anim blueprints for Mesh1P, FP_Gun, and VR_Gun 
-	// are set in the derived blueprint asset named MyCharacter to avoid direct content references in C++.
+void ANetworkShooterCharacter::StripCosmeticComponents()
+{
+	// Kept alive and assigned so the blueprint and its cooked templates still find them, they just stop costing anything
+	auto Strip = [](UActorComponent* Component)
+	{
+		if (Component != nullptr && Component->IsRegistered())
+		{
+			Component->SetComponentTickEnabled(false);
+			Component->UnregisterComponent();
+		}
+	};
+
+	// The body mesh stays for hitboxes and ragdolls
+	Strip(FP_GunShotParticle);
+	Strip(FP_MuzzleLocation);
+	Strip(FP_Gun);
+	Strip(FP_MESH);
+	Strip(VR_MuzzleLocation);
+	Strip(VR_Gun);
+	Strip(R_MotionController);
+	Strip(L_MotionController);
+	Strip(BulletParticle);
+	Strip(FirstPersonCameraComponent);
+	Strip(TP_GunShotParticle);
+	Strip(TP_Gun);
+}
 
-	// Create VR Controllers.
-	R_MotionController = CreateDefaultSubobject<UMotionControllerComponent>(TEXT("R_MotionController"));
-	R_MotionController->MotionSource = FXRMotionControllerBase::RightHandSourceId;
-	R_MotionController->SetupAttachment(RootComponent);
-	L_MotionController = CreateDefaultSubobject<UMotionControllerComponent>(TEXT("L_MotionController"));
-	L_MotionController->SetupAttachment(RootComponent);
+void ANetworkShooterCharacter::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
 
-	// Create a gun and attach it to the right-hand VR controller.
-	// Create a gun mesh component
-	VR_Gun = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("VR_Gun"));
-	VR_Gun->SetOnlyOwnerSee(false);			// otherwise won't be visible in the multiplayer
-	VR_Gun->bCastDynamicShadow = false;
-	VR_Gun->CastShadow = false;
-	VR_Gun->SetupAttachment(R_MotionController);
-	VR_Gun->SetRelativeRotation(FRotator(0.0f, -90.0f, 0.0f));
+	// A dedicated server started from the editor built the class before it knew, and cooked blueprints can still
+	// bring their copies along. Unregistered after the construction script, which may still set them up
+	if (GetNetMode() == NM_DedicatedServer && !FParse::Param(FCommandLine::Get(), TEXT("KeepCosmetics")))
+	{
+		StripCosmeticComponents();
+	}
 
-	VR_MuzzleLocation = CreateDefaultSubobject<USceneComponent>(TEXT("VR_MuzzleLocation"));
-	VR_MuzzleLocation->SetupAttachment(VR_Gun);
-	VR_MuzzleLocation->SetRelativeLocation(FVector(0.000004, 53.999992, 10.000000));
-	VR_MuzzleLocation->SetRelativeRotation(FRotator(0.0f, 90.0f, 0.0f));		// Counteract the rotation of the VR gun model.
+	// Remember where the mesh lives so it can be put back after a ragdoll
+	MeshRelativeTransform = GetMesh()->GetRelativeTransform();
+	MeshCollisionProfile = GetMesh()->GetCollisionProfileName();
 
-	// Uncomment the following line to turn motion controllers on by default:
-	//bUsingMotionControllers = true;
+	// Before any team material replaces it
+	BodyMaterial = GetMesh()->GetMaterial(0);
 }
 
 void ANetworkShooterCharacter::BeginPlay()
@@ -113,33 +205,91 @@ void ANetworkShooterCharacter::BeginPlay()
 	// Call the base class  
 	Super::BeginPlay();
 
-	if (GetLocalRole() != ROLE_Authority)
+	// The RepNotify doesn't fire for a team that matches the default
+	ApplyTeamColor();
+
+	if (GetLocalRole() == ROLE_Authority)
+	{
+		if (ANetworkShooterGameMode* GameMode = Cast<ANetworkShooterGameMode>(GetWorld()->GetAuthGameMode()))
+		{
+			GameMode->GetLagCompensation().Register(this);
+		}
+	}
+}
+
+void ANetworkShooterCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (GetLocalRole() == ROLE_Authority)
+	{
+		if (ANetworkShooterGameMode* GameMode = Cast<ANetworkShooterGameMode>(GetWorld()->GetAuthGameMode()))
+		{
+			GameMode->GetLagCompensation().Unregister(this);
+		}
+	}
+
+	if (ANSGameState* thisGameState = GetWorld()->GetGameState<ANSGameState>())
+	{
+		thisGameState->GetRagdolls().Remove(this);
+	}
+
+	if (HealthChangedHandle.IsValid())
 	{
-		SetTeam(CurrentTeam);
+		if (FNetworkShooterClientEvents* Events = FNetworkShooterClientEvents::Get(GetWorld()))
+		{
+			Events->OnHealthChanged.Remove(HealthChangedHandle);
+		}
+
+		HealthChangedHandle.Reset();
 	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
-void ANetworkShooterCharacter::SetTeam_Implementation(ETeam NewTeam)
+void ANetworkShooterCharacter::OnRep_CurrentTeam()
 {
-	FLinearColor outColor;
+	ApplyTeamColor();
+}
 
-	if (NewTeam == ETeam::BLUE_TEAM)
+void ANetworkShooterCharacter::ApplyTeamColor()
+{
+	if (GetNetMode() == NM_DedicatedServer)
 	{
-		outColor = FLinearColor(0.0f, 0.0f, 0.5f);
+		return;
 	}
-	else
+
+	UMaterialInterface* TeamMaterial = CurrentTeam == ETeam::BLUE_TEAM ? BlueTeamMaterial : RedTeamMaterial;
+
+	if (TeamMaterial == nullptr)
 	{
-		outColor = FLinearColor(0.5f, 0.0f, 0.0f);
+		// The game state applies it once it arrives if it hasn't replicated yet
+		ANSGameState* thisGameState = GetWorld()->GetGameState<ANSGameState>();
+		TeamMaterial = thisGameState ? thisGameState->GetTeamMaterial(BodyMaterial, CurrentTeam) : nullptr;
 	}
 
-	if (DynamicMat == nullptr)
+	if (TeamMaterial == nullptr)
 	{
-		DynamicMat = UMaterialInstanceDynamic::Create(GetMesh()->GetMaterial(0), this);
+		return;
+	}
+
+	// Set every time, a pooled pawn keeps its material between lives
+	GetMesh()->SetMaterial(0, TeamMaterial);
 
-		DynamicMat->SetVectorParameterValue(TEXT("BodyColor"), outColor);
+	if (FP_MESH != nullptr)
+	{
+		FP_MESH->SetMaterial(0, TeamMaterial);
+	}
+
+	if (FNetworkShooterClientEvents* Events = FNetworkShooterClientEvents::Get(GetWorld()))
+	{
+		Events->OnCharacterTeamChanged.Broadcast(this, CurrentTeam);
+	}
+}
 
-		GetMesh()->SetMaterial(0, DynamicMat);
-		FP_MESH->SetMaterial(0, DynamicMat);
+void ANetworkShooterCharacter::OnPlayerHealthChanged(ANetworkShooterPlayerState* PlayerState, float OldHealth, float NewHealth)
+{
+	if (NewHealth < OldHealth && PlayerState == GetPlayerState() && IsLocallyControlled())
+	{
+		UGameplayStatics::PlaySoundAtLocation(this, PainSound, GetActorLocation());
 	}
 }
 
@@ -156,7 +306,8 @@ void ANetworkShooterCharacter::SetupPlayerInputComponent(class UInputComponent*
 	PlayerInputComponent->BindAction("Jump", IE_Released, this, &ACharacter::StopJumping);
 
 	// Bind fire event
-	PlayerInputComponent->BindAction("Fire", IE_Pressed, this, &ANetworkShooterCharacter::OnFire);
+	PlayerInputComponent->BindAction("Fire", IE_Pressed, this, &ANetworkShooterCharacter::OnStartFire);
+	PlayerInputComponent->BindAction("Fire", IE_Released, this, &ANetworkShooterCharacter::OnStopFire);
 
 	PlayerInputComponent->BindAction("ResetVR", IE_Pressed, this, &ANetworkShooterCharacter::OnResetVR);
 
@@ -177,13 +328,72 @@ void ANetworkShooterCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProper
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-	DOREPLIFETIME(ANetworkShooterCharacter, CurrentTeam);
+	FDoRepLifetimeParams Params;
+	Params.bIsPushBased = true;
+
+	DOREPLIFETIME_WITH_PARAMS_FAST(ANetworkShooterCharacter, CurrentTeam, Params);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ANetworkShooterCharacter, PoolGeneration, Params);
 }
 
-void ANetworkShooterCharacter::OnFire()
+void ANetworkShooterCharacter::Tick(float DeltaSeconds)
 {
+	Super::Tick(DeltaSeconds);
+
+	if (IsLocallyControlled())
+	{
+		const float Now = GetWorld()->GetTimeSeconds();
+
+		// Held through the end of the last burst, starts as soon as the weapon has cycled
+		if (bWantsToFire && !FireTrigger.bHeld)
+		{
+			FireTrigger.Press(Now);
+		}
+
+		while (FireTrigger.IsShotDue(Now, FireInterval))
+		{
+			FireLocalShot();
+		}
+
+		// Bots fire from their controller, which ticks first, so their shots go out this frame too
+		SendFireEvents();
+	}
+
+	if (GetLocalRole() == ROLE_Authority)
+	{
+		TickFireStream();
+	}
+}
+
+void ANetworkShooterCharacter::OnStartFire()
+{
+	bWantsToFire = true;
+
+	const float Now = GetWorld()->GetTimeSeconds();
+
+	if (FireTrigger.Press(Now))
+	{
+		FireLocalShot();
+	}
+}
+
+void ANetworkShooterCharacter::OnStopFire()
+{
+	bWantsToFire = false;
+
+	if (FireTrigger.bHeld)
+	{
+		const int32 NumShots = FireTrigger.Release(FireInterval);
+		FireSender.Add(FNetworkShooterFireEvent::Make(ENetworkShooterFireEvent::Stop, FireTrigger.Burst,
+			FNetworkShooterFireCommand(), (uint16)FMath::Min(NumShots, (int32)MAX_uint16)));
+	}
+}
+
+void ANetworkShooterCharacter::FireLocalShot()
+{
+	const int32 Shot = FireTrigger.TakeShot();
+
 	// try and play a firing animation if specified
-	if (FP_FireAnimation != nullptr)
+	if (FP_FireAnimation != nullptr && FP_MESH != nullptr)
 	{
 		// Get the animation object for the arms mesh
 		UAnimInstance* AnimInstance = FP_MESH->GetAnimInstance();
@@ -202,40 +412,221 @@ void ANetworkShooterCharacter::OnFire()
 	FVector mousePos;
 	FVector mouseDir;
 
+	GetScreenCenterAim(mousePos, mouseDir);
+
+	const float Now = GetWorld()->GetTimeSeconds();
+
+	// The server keeps firing with the last aim it got, it only needs to hear the shot was fired
+	if (Shot > 0 && !FireTrigger.ShouldSendAim(mousePos, mouseDir, Now))
+	{
+		FireSender.Add(FNetworkShooterFireEvent::Make(ENetworkShooterFireEvent::Held, FireTrigger.Burst,
+			FNetworkShooterFireCommand(), (uint16)FMath::Min(Shot + 1, (int32)MAX_uint16)));
+		return;
+	}
+
+	FireTrigger.AimSent(mousePos, mouseDir, Now);
+
+	const FNetworkShooterFireCommand Command = FNetworkShooterFireCommand::Make(GetActorLocation(), mousePos, mouseDir, (uint8)Shot,
+		GetWorld()->GetGameState()->GetServerWorldTimeSeconds());
+
+	FireSender.Add(FNetworkShooterFireEvent::Make(Shot == 0 ? ENetworkShooterFireEvent::Start : ENetworkShooterFireEvent::Aim,
+		FireTrigger.Burst, Command));
+}
+
+void ANetworkShooterCharacter::GetScreenCenterAim(FVector& Origin, FVector& Direction) const
+{
 	APlayerController* pController = Cast<APlayerController>(GetController());
 
 	FVector2D ScreenPos = GEngine->GameViewport->Viewport->GetSizeXY();
 
-	pController->DeprojectScreenPositionToWorld(ScreenPos.X / 2.0f,
-		ScreenPos.Y / 2.0f,
-		mousePos,
-		mouseDir);
+	if (pController == nullptr || !pController->DeprojectScreenPositionToWorld(ScreenPos.X / 2.0f, ScreenPos.Y / 2.0f, Origin, Direction))
+	{
+		// No viewport to deproject through, shoot where the pawn looks
+		FRotator EyesRotation;
+		GetActorEyesViewPoint(Origin, EyesRotation);
+		Direction = EyesRotation.Vector();
+	}
+}
+
+void ANetworkShooterCharacter::FireAt(const FVector& Origin, const FVector& Direction)
+{
+	FireSender.Add(FNetworkShooterFireEvent::Make(ENetworkShooterFireEvent::Shot, 0,
+		FNetworkShooterFireCommand::Make(GetActorLocation(), Origin, Direction, 0, GetWorld()->GetGameState()->GetServerWorldTimeSeconds())));
+}
+
+void ANetworkShooterCharacter::SendFireEvents()
+{
+	FNetworkShooterFirePacket Packet;
+
+	// Our copy of the generation, a packet sent before the respawn reached us is rejected and goes out again
+	if (!FireSender.MakePacket(GetWorld()->GetTimeSeconds(), PoolGeneration, Packet))
+	{
+		return;
+	}
 
-	mouseDir *= 10000000.0f;
+	if (CVarFireReliable.GetValueOnGameThread() != 0)
+	{
+		// Delivery is the connection's problem now, nothing to repeat
+		ServerFireEventsReliable(Packet);
+		FireSender.Ack(Packet.GetLastSequence());
+	}
+	else
+	{
+		ServerFireEvents(Packet);
+	}
+}
 
-	ServerFire(mousePos, mouseDir);
+bool ANetworkShooterCharacter::ServerFireEvents_Validate(const FNetworkShooterFirePacket& Packet)
+{
+	// Origin and direction are bounded by the encoding itself, and the packet's size by its NetSerialize
+	return IsFirePacketAllowed(Packet);
 }
 
-bool ANetworkShooterCharacter::ServerFire_Validate(const FVector pos, const FVector dir)
+void ANetworkShooterCharacter::ServerFireEvents_Implementation(const FNetworkShooterFirePacket& Packet)
 {
-	if (pos != FVector(ForceInit) && dir != FVector(ForceInit))
+	ReceiveFireEvents(Packet);
+
+	if (FireReceiver.HasReceived())
+	{
+		ClientAckFireEvents(FireReceiver.GetAck());
+	}
+}
+
+bool ANetworkShooterCharacter::ServerFireEventsReliable_Validate(const FNetworkShooterFirePacket& Packet)
+{
+	return IsFirePacketAllowed(Packet);
+}
+
+void ANetworkShooterCharacter::ServerFireEventsReliable_Implementation(const FNetworkShooterFirePacket& Packet)
+{
+	ReceiveFireEvents(Packet);
+}
+
+bool ANetworkShooterCharacter::IsFirePacketAllowed(const FNetworkShooterFirePacket& Packet) const
+{
+	if (IsLocallyControlled())
 	{
 		return true;
 	}
-	else
+
+	// A player's shots come from a burst the server paces at FireInterval, a modified client could send these at any rate
+	for (const FNetworkShooterFireEvent& Event : Packet.Events)
 	{
-		return false;
+		if (Event.Type == ENetworkShooterFireEvent::Shot)
+		{
+			return false;
+		}
 	}
+
+	return true;
 }
 
-void ANetworkShooterCharacter::ServerFire_Implementation(const FVector pos, const FVector dir)
+void ANetworkShooterCharacter::ClientAckFireEvents_Implementation(uint16 Sequence)
 {
-	Fire(pos, dir);
-	MultiCastShootEffects();
+	FireSender.Ack(Sequence);
+}
+
+void ANetworkShooterCharacter::ReceiveFireEvents(const FNetworkShooterFirePacket& Packet)
+{
+	FireReceiver.Receive(Packet, PoolGeneration, [this](const FNetworkShooterFireEvent& Event) { RunFireEvent(Event); });
+}
+
+void ANetworkShooterCharacter::RunFireEvent(const FNetworkShooterFireEvent& Event)
+{
+	const float Now = GetWorld()->GetTimeSeconds();
+
+	switch (Event.Type)
+	{
+	case ENetworkShooterFireEvent::Shot:
+		ServerShot(Event.Command, Event.Command.GetClientTime(Now));
+		break;
+
+	case ENetworkShooterFireEvent::Start:
+		FireStream.Start(Event.Burst, Event.Command, Event.Command.GetClientTime(Now), Now, FireInterval,
+			[this](const FNetworkShooterFireCommand& Aim, float ClientTime) { ServerShot(Aim, ClientTime); });
+
+		// The first shot goes off on arrival unless the weapon is still cycling from the last burst
+		TickFireStream();
+		break;
+
+	case ENetworkShooterFireEvent::Aim:
+		FireStream.UpdateAim(Event.Burst, Event.Command, Event.Command.GetClientTime(Now));
+		break;
+
+	case ENetworkShooterFireEvent::Held:
+		FireStream.Confirm(Event.Burst, Event.NumShots);
+		break;
+
+	case ENetworkShooterFireEvent::Stop:
+		FireStream.Stop(Event.Burst, Event.NumShots, Now, FireInterval);
+		TickFireStream();
+		break;
+
+	default:
+		break;
+	}
+}
+
+void ANetworkShooterCharacter::TickFireStream()
+{
+	if (!FireStream.IsActive())
+	{
+		return;
+	}
+
+	FireStream.Tick(GetWorld()->GetTimeSeconds(), FireInterval,
+		[this](const FNetworkShooterFireCommand& Aim, float ClientTime) { ServerShot(Aim, ClientTime); });
+}
+
+void ANetworkShooterCharacter::ServerShot(const FNetworkShooterFireCommand& Command, float ClientTime)
+{
+	ANetworkShooterGameMode* GameMode = Cast<ANetworkShooterGameMode>(GetWorld()->GetAuthGameMode());
+
+	if (GameMode != nullptr)
+	{
+		GameMode->GetLoadTest().CountServerFire();
+
+		// Hit registration delay of remote players, the local ones would only dilute it
+		if (!IsLocallyControlled())
+		{
+			GameMode->GetFireLatency().Add(GetWorld()->GetTimeSeconds() - ClientTime);
+		}
+	}
+
+	// The origin is rebuilt around where the server has us, and the end from the unit direction
+	const FVector Start = Command.GetOrigin(GetActorLocation());
+	const FVector End = Start + Command.GetDirection() * FireRange;
+
+	Fire(Start, End, ClientTime);
+
+	if (GameMode != nullptr && FNetworkShooterFireEffectQueue::IsBatching())
+	{
+		GameMode->GetFireEffects().Add(this, ClientTime);
+	}
+	else
+	{
+		if (GameMode != nullptr)
+		{
+			GameMode->GetLoadTest().CountMulticast();
+		}
+
+		MultiCastShootEffects();
+	}
 }
 
 void ANetworkShooterCharacter::MultiCastShootEffects_Implementation()
 {
+	PlayShootEffects();
+}
+
+void ANetworkShooterCharacter::PlayShootEffects()
+{
+	// Multicasts run on the server too, where the effect components are unregistered
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		return;
+	}
+
 	// try and play a firing animation if specified
 	if (TP_FireAnimation != NULL)
 	{
@@ -253,66 +644,110 @@ void ANetworkShooterCharacter::MultiCastShootEffects_Implementation()
 		UGameplayStatics::PlaySoundAtLocation(this, FireSound, GetActorLocation());
 	}
 
-	if (TP_GunShotParticle != nullptr)
+	// Bullets come from the world's pool, which also culls far away and over budget muzzle flashes
+	ANSGameState* thisGameState = GetWorld()->GetGameState<ANSGameState>();
+
+	if (TP_GunShotParticle != nullptr &&
+		(thisGameState == nullptr || thisGameState->GetEmitterPool().ShouldPlay(TP_GunShotParticle->GetComponentLocation())))
 	{
 		TP_GunShotParticle->Activate(true);
 	}
 
 	if (BulletParticle != nullptr)
 	{
-		UGameplayStatics::SpawnEmitterAtLocation(GetWorld(), BulletParticle->Template, BulletParticle->GetComponentLocation(),
-			BulletParticle->GetComponentRotation());
+		if (thisGameState != nullptr)
+		{
+			thisGameState->GetEmitterPool().Spawn(BulletParticle->Template, BulletParticle->GetComponentLocation(),
+				BulletParticle->GetComponentRotation());
+		}
+		else
+		{
+			UGameplayStatics::SpawnEmitterAtLocation(GetWorld(), BulletParticle->Template, BulletParticle->GetComponentLocation(),
+				BulletParticle->GetComponentRotation());
+		}
 	}
 }
 
-void ANetworkShooterCharacter::Fire(const FVector pos, const FVector dir)
+void ANetworkShooterCharacter::Fire(const FVector& Start, const FVector& End, float ClientTime)
 {
+	NS_SCOPE_CYCLE_COUNTER(Fire);
+
+	ANetworkShooterGameMode* GameMode = Cast<ANetworkShooterGameMode>(GetWorld()->GetAuthGameMode());
+
+	// Traced later this frame together with everyone else's shots, against characters where this client saw them
+	if (GameMode != nullptr)
+	{
+		GameMode->GetHitscanQueue().Add(this, Start, End, ClientTime);
+		return;
+	}
+
 	// Perform Raycast
-	FCollisionObjectQueryParams ObjQuery;
-	ObjQuery.AddObjectTypesToQuery(ECC_GameTraceChannel1);
+	const FCollisionObjectQueryParams ObjQuery = FNetworkShooterHitscanQueue::GetShotObjectParams();
 
 	FCollisionQueryParams ColQuery;
 	ColQuery.AddIgnoredActor(this);
 
 	FHitResult HitRes;
-	GetWorld()->LineTraceSingleByObjectType(HitRes, pos, dir, ObjQuery, ColQuery);
+	GetWorld()->LineTraceSingleByObjectType(HitRes, Start, End, ObjQuery, ColQuery);
 
-	DrawDebugLine(GetWorld(), pos, dir, FColor::Red, true, 100, 0, 5.0f);
+	ApplyShot(Start, End, HitRes);
+}
+
+void ANetworkShooterCharacter::ApplyShot(const FVector& Start, const FVector& End, const FHitResult& HitRes)
+{
+#if NS_WITH_SHOT_TRACE
+	if (ANetworkShooterGameMode* GameMode = Cast<ANetworkShooterGameMode>(GetWorld()->GetAuthGameMode()))
+	{
+		GameMode->GetShotTrace().Record(GetWorld(), Start, HitRes.bBlockingHit ? HitRes.ImpactPoint : End, HitRes.GetActor(), GetWorld()->GetTimeSeconds());
+	}
+#endif
 
 	if (HitRes.bBlockingHit)
 	{
 		ANetworkShooterCharacter* OtherChar = Cast<ANetworkShooterCharacter>(HitRes.GetActor());
+		ANetworkShooterPlayerState* OtherPS = OtherChar ? OtherChar->GetNetworkShooterPlayerState() : nullptr;
+		ANetworkShooterPlayerState* thisPS = GetNetworkShooterPlayerState();
 
-		if (OtherChar != nullptr && OtherChar->GetNetworkShooterPlayerState()->Team != this->GetNetworkShooterPlayerState()->Team)
+		if (OtherPS != nullptr && thisPS != nullptr && OtherPS->Team != thisPS->Team)
 		{
 			FDamageEvent thisEvent(UDamageType::StaticClass());
 			OtherChar->TakeDamage(10.0f, thisEvent, this->GetController(), this);
 
+			// Bots have no player controller to rumble
 			APlayerController* thisPC = Cast<APlayerController>(GetController());
 
-			FForceFeedbackParameters FeedbackParams;
-			FeedbackParams.bLooping = false;
-			FeedbackParams.Tag = NAME_None;
+			if (thisPC != nullptr)
+			{
+				FForceFeedbackParameters FeedbackParams;
+				FeedbackParams.bLooping = false;
+				FeedbackParams.Tag = NAME_None;
 
-			thisPC->ClientPlayForceFeedback(HitSuccessFeedback, FeedbackParams);
+				thisPC->ClientPlayForceFeedback(HitSuccessFeedback, FeedbackParams);
+			}
 		}
 	}
 }
 
 float ANetworkShooterCharacter::TakeDamage(float Damage, struct FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser)
 {
+	NS_SCOPE_CYCLE_COUNTER(TakeDamage);
+
 	Super::TakeDamage(Damage, DamageEvent, EventInstigator, DamageCauser);
 
+	// A corpse still points at the player state its player respawned with
 	if (GetLocalRole() == ROLE_Authority &&
 		DamageCauser != this &&
+		!bDead &&
 		NSPlayerState->Health > 0)
 	{
-		NSPlayerState->Health -= Damage;
-		PlayPain();
+		NSPlayerState->SetHealth(NSPlayerState->Health - Damage);
 
 		if (NSPlayerState->Health <= 0)
 		{
-			NSPlayerState->Deaths++;
+			NSPlayerState->SetDeaths(NSPlayerState->Deaths + 1);
+
+			// A held trigger's stop may never come from a dead pawn, which would otherwise keep firing
+			FireStream.Reset();
 
 			// Player has died time to respawn
 			MultiCastRagdoll();
@@ -321,7 +756,7 @@ float ANetworkShooterCharacter::TakeDamage(float Damage, struct FDamageEvent con
 
 			if (OtherChar)
 			{
-				OtherChar->NSPlayerState->SetScore(OtherChar->NSPlayerState->GetScore() + 1.0f);
+				OtherChar->NSPlayerState->AddScore(1.0f);
 			}
 
 			// After 3 seconds respawn
@@ -334,32 +769,111 @@ float ANetworkShooterCharacter::TakeDamage(float Damage, struct FDamageEvent con
 	return Damage;
 }
 
-void ANetworkShooterCharacter::PlayPain_Implementation()
+void ANetworkShooterCharacter::MultiCastRagdoll_Implementation()
 {
-	if (GetLocalRole() == ROLE_AutonomousProxy)
+	bDead = true;
+
+	// Ragdoll, death animation or nothing at all depending on budget, distance and net mode
+	if (ANSGameState* thisGameState = GetWorld()->GetGameState<ANSGameState>())
 	{
-		UGameplayStatics::PlaySoundAtLocation(this, PainSound, GetActorLocation());
+		thisGameState->GetRagdolls().StartDeath(this);
 	}
 }
 
-void ANetworkShooterCharacter::MultiCastRagdoll_Implementation()
+void ANetworkShooterCharacter::Respawn()
 {
-	GetMesh()->SetPhysicsBlendWeight(1.0f);
-	GetMesh()->SetSimulatePhysics(true);
-	GetMesh()->SetCollisionProfileName("Ragdoll");
+	if (GetLocalRole() == ROLE_Authority)
+	{
+		// Get Location from game mode, it also takes care of this pawn
+		NSPlayerState->SetHealth(100.0f);
+		Cast<ANetworkShooterGameMode>(GetWorld()->GetAuthGameMode())->Respawn(this);
+	}
 }
 
-void ANetworkShooterCharacter::Respawn()
+void ANetworkShooterCharacter::ReturnToPool()
 {
 	if (GetLocalRole() == ROLE_Authority)
 	{
-		// Get Location from game mode
-		NSPlayerState->Health = 100.0f;
-		Cast<ANetworkShooterGameMode>(GetWorld()->GetAuthGameMode())->Respawn(this);
-		Destroy(true, true);
+		if (ANetworkShooterGameMode* GameMode = Cast<ANetworkShooterGameMode>(GetWorld()->GetAuthGameMode()))
+		{
+			GameMode->GetLagCompensation().Unregister(this);
+		}
+
+		bInPool = true;
+		NSPlayerState = nullptr;
+
+		GetWorldTimerManager().ClearAllTimersForObject(this);
+
+		// A listen server's own ragdoll of this pawn, its sleep timer lives on the game state
+		if (ANSGameState* thisGameState = GetWorld()->GetGameState<ANSGameState>())
+		{
+			thisGameState->GetRagdolls().Remove(this);
+		}
+
+		GetCharacterMovement()->StopMovementImmediately();
+		GetCharacterMovement()->DisableMovement();
+
+		SetActorHiddenInGame(true);
+		SetActorEnableCollision(false);
+		SetActorTickEnabled(false);
+	}
+}
+
+void ANetworkShooterCharacter::ActivateFromPool()
+{
+	if (GetLocalRole() == ROLE_Authority)
+	{
+		bInPool = false;
+
+		// Tells clients to pull the mesh back out of its ragdoll
+		PoolGeneration++;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ANetworkShooterCharacter, PoolGeneration, this);
+		ResetRagdoll();
+
+		// Still where it died, the game mode shows it once it is on a spawn point
+		SetActorEnableCollision(true);
+		SetActorTickEnabled(true);
+
+		GetCharacterMovement()->SetMovementMode(MOVE_Walking);
+
+		if (ANetworkShooterGameMode* GameMode = Cast<ANetworkShooterGameMode>(GetWorld()->GetAuthGameMode()))
+		{
+			GameMode->GetLagCompensation().Register(this);
+		}
 	}
 }
 
+void ANetworkShooterCharacter::OnRep_PoolGeneration()
+{
+	ResetRagdoll();
+}
+
+void ANetworkShooterCharacter::ResetRagdoll()
+{
+	USkeletalMeshComponent* thisMesh = GetMesh();
+
+	bDead = false;
+
+	if (ANSGameState* thisGameState = GetWorld()->GetGameState<ANSGameState>())
+	{
+		thisGameState->GetRagdolls().Remove(this);
+	}
+
+	// A death animation left the mesh in single node mode
+	if (thisMesh->GetAnimationMode() != EAnimationMode::AnimationBlueprint)
+	{
+		thisMesh->SetAnimationMode(EAnimationMode::AnimationBlueprint);
+	}
+
+	// A frozen ragdoll has its tick turned off
+	thisMesh->SetComponentTickEnabled(true);
+	thisMesh->SetSimulatePhysics(false);
+	thisMesh->SetPhysicsBlendWeight(0.0f);
+	thisMesh->SetCollisionProfileName(MeshCollisionProfile);
+	thisMesh->AttachToComponent(GetCapsuleComponent(), FAttachmentTransformRules::SnapToTargetNotIncludingScale);
+	thisMesh->SetRelativeTransform(MeshRelativeTransform);
+}
+
 void ANetworkShooterCharacter::PossessedBy(AController* NewController)
 {
 	Super::PossessedBy(NewController);
@@ -369,10 +883,44 @@ void ANetworkShooterCharacter::PossessedBy(AController* NewController)
 
 	if (GetLocalRole() == ROLE_Authority && NSPlayerState != nullptr)
 	{
-		NSPlayerState->Health = 100.0f;
+		NSPlayerState->SetHealth(100.0f);
+	}
+
+	// A pooled pawn may come back to a different controller, whose fire events count from its own sequence.
+	// Remote clients reset their own sender in PawnClientRestart, local and bot controllers fire from here
+	FireSender.Reset();
+	FireReceiver.Reset();
+	FireTrigger.Reset();
+	FireStream.Reset();
+	bWantsToFire = false;
+}
+
+void ANetworkShooterCharacter::PawnClientRestart()
+{
+	Super::PawnClientRestart();
+
+	FireSender.Reset();
+	FireTrigger.Reset();
+	bWantsToFire = false;
+
+	// Pain is heard from the replicated health instead of an RPC per hit
+	FNetworkShooterClientEvents* Events = FNetworkShooterClientEvents::Get(GetWorld());
+
+	if (Events != nullptr && !HealthChangedHandle.IsValid())
+	{
+		HealthChangedHandle = Events->OnHealthChanged.AddUObject(this, &ANetworkShooterCharacter::OnPlayerHealthChanged);
 	}
 }
 
+void ANetworkShooterCharacter::SetCurrentTeam(ETeam NewTeam)
+{
+	CurrentTeam = NewTeam;
+	MARK_PROPERTY_DIRTY_FROM_NAME(ANetworkShooterCharacter, CurrentTeam, this);
+
+	// RepNotifies don't run on a listen server
+	ApplyTeamColor();
+}
+
 ANetworkShooterPlayerState* ANetworkShooterCharacter::GetNetworkShooterPlayerState()
 {
 	if (NSPlayerState)
@@ -468,4 +1016,45 @@ void ANetworkShooterCharacter::LookUpAtRate(float Rate)
 {
 	// calculate delta for this frame from the rate information
 	AddControllerPitchInput(Rate * BaseLookUpRate * GetWorld()->GetDeltaSeconds());
-}
\ No newline at end of file
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Stats
+
+static void ReportPawnCost(const TArray<FString>& Args, UWorld* World)
+{
+	int32 NumPawns = 0;
+	int32 NumComponents = 0;
+	int32 NumRegistered = 0;
+	int32 NumTicking = 0;
+	SIZE_T Bytes = 0;
+
+	for (TActorIterator<ANetworkShooterCharacter> Iter(World); Iter; ++Iter)
+	{
+		NumPawns++;
+		Bytes += Iter->GetClass()->GetStructureSize();
+
+		TInlineComponentArray<UActorComponent*> Components(*Iter);
+
+		for (UActorComponent* Component : Components)
+		{
+			NumComponents++;
+			NumRegistered += Component->IsRegistered() ? 1 : 0;
+			NumTicking += Component->IsComponentTickEnabled() ? 1 : 0;
+
+			// The object itself plus what it allocated, bone transforms and the like
+			Bytes += Component->GetClass()->GetStructureSize() + Component->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+		}
+	}
+
+	const float Pawns = FMath::Max(NumPawns, 1);
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("PawnCost: %d characters, dedicated server %s, cosmetics %s. Per character %.1f components, %.1f registered, %.1f ticking, %.1f KB"),
+		NumPawns, World->GetNetMode() == NM_DedicatedServer ? TEXT("yes") : TEXT("no"), ShouldStripCosmetics() ? TEXT("never created") : TEXT("created"),
+		NumComponents / Pawns, NumRegistered / Pawns, NumTicking / Pawns, Bytes / 1024.0f / Pawns);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs PawnCostReportCommand(
+	TEXT("ns.Pawn.CostReport"),
+	TEXT("Logs components, ticking components and memory per character, compare a dedicated server with and without -KeepCosmetics"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&ReportPawnCost));
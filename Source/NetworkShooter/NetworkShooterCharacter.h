@@ -4,6 +4,9 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
+#include "NetworkShooterFireChannel.h"
+#include "NetworkShooterFireCommand.h"
+#include "NetworkShooterFireStream.h"
 #include "NetworkShooterGameMode.h"
 #include "NetworkShooterCharacter.generated.h"
 
@@ -60,7 +63,9 @@ public:
 	ANetworkShooterCharacter();
 
 protected:
+	virtual void PostInitializeComponents() override;
 	virtual void BeginPlay();
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:
 	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
@@ -87,6 +92,14 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Gameplay)
 	UAnimMontage* TP_FireAnimation;
 
+	/** Played instead of a ragdoll when the ragdoll budget is used up or the death is far away */
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	TArray<UAnimationAsset*> DeathAnimations;
+
+	/** Seconds between shots while fire is held, the server fires at this cadence whatever the client sends */
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float FireInterval;
+
 	/** particle system for 1st person gun shot effect */
 	UPROPERTY(EditAnywhere, Category = Gameplay)
 	UParticleSystemComponent* FP_GunShotParticle;
@@ -106,17 +119,75 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Gameplay)
 	uint8 bUsingMotionControllers : 1;
 
-	UPROPERTY(Replicated, BlueprintReadWrite, Category = Team)
+	// Push model replicated, set it through SetCurrentTeam
+	UPROPERTY(ReplicatedUsing = OnRep_CurrentTeam, BlueprintReadWrite, Category = Team)
 	ETeam CurrentTeam;
 
+	void SetCurrentTeam(ETeam NewTeam);
+
+	/** Pre-built body materials per team. When unset the game state builds shared ones from the mesh's material */
+	UPROPERTY(EditDefaultsOnly, Category = Team)
+	UMaterialInterface* BlueTeamMaterial;
+
+	UPROPERTY(EditDefaultsOnly, Category = Team)
+	UMaterialInterface* RedTeamMaterial;
+
+	// Puts the shared body material for CurrentTeam on both meshes and publishes the change, not on a dedicated server
+	void ApplyTeamColor();
+
 	class ANetworkShooterPlayerState* GetNetworkShooterPlayerState();
 	void SetNetworkShooterPlayerState(class ANetworkShooterPlayerState* newPS);
 	void Respawn();
 
+	// Pawn pooling, server only. Deactivates this character so the game mode can reuse it
+	void ReturnToPool();
+
+	// Brings a pooled character back to life, health and team are set up by the game mode
+	void ActivateFromPool();
+
+	bool IsInPool() const { return bInPool; }
+
+	// From the death multicast until the pawn is reused, lag compensation leaves the dead out
+	bool IsDead() const { return bDead; }
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	// Queues a single shot for the server, used by bots on the server. Players fire through the fire stream
+	void FireAt(const FVector& Origin, const FVector& Direction);
+
+	// Server only, records the traced shot and damages whoever it hit
+	void ApplyShot(const FVector& Start, const FVector& End, const FHitResult& HitRes);
+
+	// Third person fire animation, sound and particles, run on clients for every shot
+	void PlayShootEffects();
+
 protected:
 	
-	/** Fires a projectile. */
-	void OnFire();
+	// Fire held and released, shots follow at FireInterval while held
+	void OnStartFire();
+	void OnStopFire();
+
+	// Takes the trigger's next shot, plays the first person effects and queues it for the server
+	void FireLocalShot();
+
+	// Sends the queued fire events, once a frame from the locally controlled pawn
+	void SendFireEvents();
+
+	// Server only, runs the fire events of a packet that haven't been run yet
+	void ReceiveFireEvents(const FNetworkShooterFirePacket& Packet);
+	void RunFireEvent(const FNetworkShooterFireEvent& Event);
+
+	// Single shots skip the fire stream's cadence, so only bots on the server may send them
+	bool IsFirePacketAllowed(const FNetworkShooterFirePacket& Packet) const;
+
+	// Where the centre of the screen points, from the local player's viewport
+	void GetScreenCenterAim(FVector& Origin, FVector& Direction) const;
+
+	// Server only, traces one shot of a fire command and sends the effects
+	void ServerShot(const FNetworkShooterFireCommand& Command, float ClientTime);
+
+	// Fires what the fire stream has due
+	void TickFireStream();
 
 	/** Resets HMD orientation and position in VR. */
 	void OnResetVR();
@@ -139,12 +210,53 @@ protected:
 	 */
 	void LookUpAtRate(float Rate);
 
-	// will be called by the server to perform a raytrace
-	void Fire(const FVector pos, const FVector dir);
+	// will be called by the server to queue a raytrace, rewinding other characters to ClientTime
+	void Fire(const FVector& Start, const FVector& End, float ClientTime);
+
 
+	// The mesh's own material, the shared team materials are built from it
+	UPROPERTY(Transient)
+	UMaterialInterface* BodyMaterial;
 
-	class UMaterialInstanceDynamic* DynamicMat;
 	class ANetworkShooterPlayerState* NSPlayerState;
+
+	// Puts the mesh back on the capsule with its original collision after a ragdoll
+	void ResetRagdoll();
+
+	// Dedicated server only, unregisters whichever first person, VR and effect components were still created and stops their ticks
+	void StripCosmeticComponents();
+
+	UFUNCTION()
+	void OnRep_PoolGeneration();
+
+	UFUNCTION()
+	void OnRep_CurrentTeam();
+
+	// Plays the pain sound when the local player's health drops, bound while this is the locally controlled pawn
+	void OnPlayerHealthChanged(class ANetworkShooterPlayerState* PlayerState, float OldHealth, float NewHealth);
+
+	FDelegateHandle HealthChangedHandle;
+
+	// Bumped every time the pawn comes out of the pool, so clients reset it even if the server never sent the pooled state
+	UPROPERTY(ReplicatedUsing = OnRep_PoolGeneration)
+	uint8 PoolGeneration;
+
+	bool bInPool;
+	bool bDead;
+
+	// Fire events of the locally controlled pawn on their way to the server, and the server's end of them
+	FNetworkShooterFireSender FireSender;
+	FNetworkShooterFireReceiver FireReceiver;
+
+	// Client side burst of the locally controlled pawn, and whether fire is held while the weapon cycles
+	FNetworkShooterFireTrigger FireTrigger;
+	bool bWantsToFire;
+
+	// Server side burst being simulated for this pawn's player
+	FNetworkShooterFireStream FireStream;
+
+	FTransform MeshRelativeTransform;
+	FName MeshCollisionProfile;
 	
 protected:
 	// APawn interface
@@ -153,6 +265,7 @@ protected:
 	virtual float TakeDamage(float Damage, struct FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser) override;
 
 	virtual void PossessedBy(AController* NewController) override;
+	virtual void PawnClientRestart() override;
 	// End of APawn interface
 
 public:
@@ -163,9 +276,17 @@ public:
 
 	/** REMOTE PROCEDURE CALLS */
 private:
-	// Peform fire action on the server
+	// Fire events the server hasn't acknowledged yet, repeated in every packet until it does
+	UFUNCTION(Server, Unreliable, WithValidation)
+	void ServerFireEvents(const FNetworkShooterFirePacket& Packet);
+
+	// The same as one reliable RPC per packet, with ns.Fire.Reliable for comparison
 	UFUNCTION(Server, Reliable, WithValidation)
-	void ServerFire(const FVector pos, const FVector dir);
+	void ServerFireEventsReliable(const FNetworkShooterFirePacket& Packet);
+
+	// The newest fire event the server has run, everything up to it can stop being sent
+	UFUNCTION(Client, Unreliable)
+	void ClientAckFireEvents(uint16 Sequence);
 
 	// Multicast so all clients run shoot effects
 	UFUNCTION(NetMultiCast, unreliable)
@@ -174,13 +295,4 @@ private:
 	// Called on death for all clients for hilarious death
 	UFUNCTION(NetMultiCast, unreliable)
 	void MultiCastRagdoll();
-
-	// Play pain on owning client when hit
-	UFUNCTION(Client, Reliable)
-	void PlayPain();
-
-public:
-	// Set's team color
-	UFUNCTION(NetMulticast, Reliable)
-	void SetTeam(ETeam NewTeam);
 };
\ No newline at end of file
@@ -0,0 +1,13 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterClientEvents.h"
+#include "NSGameState.h"
+#include "Engine/World.h"
+
+FNetworkShooterClientEvents* FNetworkShooterClientEvents::Get(const UWorld* World)
+{
+	ANSGameState* thisGameState = World ? World->GetGameState<ANSGameState>() : nullptr;
+
+	return thisGameState ? &thisGameState->GetClientEvents() : nullptr;
+}
@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NetworkShooterGameMode.h"
+
+class ANetworkShooterCharacter;
+class ANetworkShooterPlayerState;
+class UWorld;
+
+/**
+ * Client side notifications for replicated game state, raised from RepNotifies and, since those
+ * don't run on a listen server, from the server setters too. The HUD, team materials and audio
+ * react to these instead of polling pawns and player states every frame.
+ * Owned by ANSGameState, so a subscriber that binds late should read the current state once.
+ */
+class NETWORKSHOOTER_API FNetworkShooterClientEvents
+{
+public:
+	// Health, score or deaths of a player changed
+	DECLARE_MULTICAST_DELEGATE_OneParam(FOnPlayerStatsChanged, ANetworkShooterPlayerState*);
+
+	// Old and new health, for reacting to damage
+	DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnHealthChanged, ANetworkShooterPlayerState*, float, float);
+
+	// A player joined, left, was renamed or switched team
+	DECLARE_MULTICAST_DELEGATE(FOnScoreboardChanged);
+
+	DECLARE_MULTICAST_DELEGATE_TwoParams(FOnCharacterTeamChanged, ANetworkShooterCharacter*, ETeam);
+
+	DECLARE_MULTICAST_DELEGATE_OneParam(FOnMenuChanged, bool);
+
+	FOnPlayerStatsChanged OnPlayerStatsChanged;
+	FOnHealthChanged OnHealthChanged;
+	FOnScoreboardChanged OnScoreboardChanged;
+	FOnCharacterTeamChanged OnCharacterTeamChanged;
+	FOnMenuChanged OnMenuChanged;
+
+	// The bus of World's game state, null until the game state exists
+	static FNetworkShooterClientEvents* Get(const UWorld* World);
+};
@@ -0,0 +1,207 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterEmitterPool.h"
+#include "NetworkShooter.h"
+#include "NSGameState.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Particles/ParticleSystem.h"
+#include "Particles/ParticleSystemComponent.h"
+
+static TAutoConsoleVariable<int32> CVarEmitterPoolSize(
+	TEXT("ns.EmitterPool.Size"),
+	32,
+	TEXT("Most pooled shot effect components per world."));
+
+static TAutoConsoleVariable<float> CVarEmitterPoolCullDistance(
+	TEXT("ns.EmitterPool.CullDistance"),
+	8000.0f,
+	TEXT("Shot effects further than this from the local view are not played, 0 disables."));
+
+static TAutoConsoleVariable<int32> CVarEmitterPoolFrameBudget(
+	TEXT("ns.EmitterPool.FrameBudget"),
+	16,
+	TEXT("Most pooled shot effects started in one frame, the rest are dropped."));
+
+static TAutoConsoleVariable<int32> CVarEmitterPoolMuzzleFrameBudget(
+	TEXT("ns.EmitterPool.MuzzleFrameBudget"),
+	16,
+	TEXT("Most muzzle flashes started in one frame, the rest are dropped. Separate from ns.EmitterPool.FrameBudget."));
+
+FNetworkShooterEmitterPool::FNetworkShooterEmitterPool()
+	: Created(0)
+	, Reused(0)
+	, Stolen(0)
+{
+}
+
+bool FNetworkShooterEmitterPool::ShouldPlay(const FVector& Location)
+{
+	return Admit(MuzzleBudget, CVarEmitterPoolMuzzleFrameBudget.GetValueOnGameThread(), Location);
+}
+
+bool FNetworkShooterEmitterPool::Admit(FBudget& Budget, int32 MaxPerFrame, const FVector& Location)
+{
+	AActor* OwnerActor = Owner.Get();
+	UWorld* World = OwnerActor ? OwnerActor->GetWorld() : nullptr;
+
+	// Nobody watches a dedicated server
+	if (World == nullptr || World->GetNetMode() == NM_DedicatedServer)
+	{
+		return false;
+	}
+
+	Budget.Requests++;
+
+	const float CullDistance = CVarEmitterPoolCullDistance.GetValueOnGameThread();
+	APlayerController* thisCont = World->GetFirstPlayerController();
+
+	if (CullDistance > 0.0f && thisCont != nullptr)
+	{
+		FVector ViewLocation;
+		FRotator ViewRotation;
+		thisCont->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+		if (FVector::DistSquared(ViewLocation, Location) > FMath::Square(CullDistance))
+		{
+			Budget.DistanceCulled++;
+			return false;
+		}
+	}
+
+	if (Budget.Frame != GFrameCounter)
+	{
+		Budget.Frame = GFrameCounter;
+		Budget.FrameSpawns = 0;
+	}
+
+	if (Budget.FrameSpawns >= MaxPerFrame)
+	{
+		Budget.Dropped++;
+		return false;
+	}
+
+	Budget.FrameSpawns++;
+
+	return true;
+}
+
+bool FNetworkShooterEmitterPool::Spawn(UParticleSystem* Template, const FVector& Location, const FRotator& Rotation)
+{
+	if (Template == nullptr || !Admit(PooledBudget, CVarEmitterPoolFrameBudget.GetValueOnGameThread(), Location))
+	{
+		return false;
+	}
+
+	UParticleSystemComponent* Component = Acquire(Template);
+
+	if (Component == nullptr)
+	{
+		return false;
+	}
+
+	Component->SetWorldLocationAndRotation(Location, Rotation);
+	Component->Activate(true);
+
+	return true;
+}
+
+UParticleSystemComponent* FNetworkShooterEmitterPool::Acquire(UParticleSystem* Template)
+{
+	const double Now = FPlatformTime::Seconds();
+
+	int32 Free = INDEX_NONE;
+	int32 Oldest = INDEX_NONE;
+
+	for (int32 i = 0; i < Entries.Num(); i++)
+	{
+		UParticleSystemComponent* Component = Entries[i].Component;
+
+		if (!Component->IsActive())
+		{
+			// Prefer one already set up with this template
+			if (Free == INDEX_NONE || Component->Template == Template)
+			{
+				Free = i;
+
+				if (Component->Template == Template)
+				{
+					break;
+				}
+			}
+		}
+		else if (Oldest == INDEX_NONE || Entries[i].LastUsed < Entries[Oldest].LastUsed)
+		{
+			Oldest = i;
+		}
+	}
+
+	int32 Index = Free;
+
+	if (Index != INDEX_NONE)
+	{
+		Reused++;
+	}
+	else if (Entries.Num() < CVarEmitterPoolSize.GetValueOnGameThread() && Owner.IsValid())
+	{
+		UParticleSystemComponent* Component = NewObject<UParticleSystemComponent>(Owner.Get());
+		Component->bAutoActivate = false;
+		Component->bAutoDestroy = false;
+		Component->SetTemplate(Template);
+		Component->RegisterComponent();
+
+		Index = Entries.Add({ Component, Now });
+		Created++;
+	}
+	else if (Oldest != INDEX_NONE)
+	{
+		// Every component is busy, cut the longest running effect short
+		Index = Oldest;
+		Entries[Index].Component->DeactivateImmediate();
+		Stolen++;
+	}
+	else
+	{
+		return nullptr;
+	}
+
+	UParticleSystemComponent* Component = Entries[Index].Component;
+
+	if (Component->Template != Template)
+	{
+		Component->SetTemplate(Template);
+	}
+
+	Entries[Index].LastUsed = Now;
+
+	return Component;
+}
+
+void FNetworkShooterEmitterPool::LogStats() const
+{
+	const int32 Played = Created + Reused + Stolen;
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Emitter pool: %d components, %d requests, %d created, %d reused, %d stolen (%.1f%% reuse), %d distance culled, %d over budget"),
+		Entries.Num(), PooledBudget.Requests, Created, Reused, Stolen, Played > 0 ? 100.0f * (Reused + Stolen) / Played : 0.0f,
+		PooledBudget.DistanceCulled, PooledBudget.Dropped);
+	UE_LOG(LogNetworkShooter, Display, TEXT("  muzzle flashes: %d requests, %d distance culled, %d over budget"),
+		MuzzleBudget.Requests, MuzzleBudget.DistanceCulled, MuzzleBudget.Dropped);
+}
+
+static void LogEmitterPoolStats(const TArray<FString>& Args, UWorld* World)
+{
+	ANSGameState* thisGameState = World ? World->GetGameState<ANSGameState>() : nullptr;
+
+	if (thisGameState != nullptr)
+	{
+		thisGameState->GetEmitterPool().LogStats();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs EmitterPoolStatsCommand(
+	TEXT("ns.EmitterPool.Stats"),
+	TEXT("Logs shot effect pool reuse and dropped effect counts"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LogEmitterPoolStats));
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AActor;
+class UParticleSystem;
+class UParticleSystemComponent;
+
+/**
+ * Fixed size pool of particle components for shot effects, one per world. Replaces a
+ * SpawnEmitterAtLocation per shot: finished components are reused, and when all are busy
+ * the least recently started one is taken over. Effects too far from the local view or over
+ * the per frame budget are dropped. Muzzle flashes have a budget of their own, so a frame full
+ * of them doesn't leave none for the pooled effects. Size, distance and budgets are the
+ * ns.EmitterPool cvars.
+ */
+class NETWORKSHOOTER_API FNetworkShooterEmitterPool
+{
+public:
+	FNetworkShooterEmitterPool();
+
+	// Components are created as Owner's, which keeps them alive for the pool
+	void SetOwner(AActor* InOwner) { Owner = InOwner; }
+
+	// Plays Template at Location from the pool, false if it was culled or dropped
+	bool Spawn(UParticleSystem* Template, const FVector& Location, const FRotator& Rotation);
+
+	// Distance and budget check for muzzle flashes, which have their own component. Counts against the muzzle budget when true
+	bool ShouldPlay(const FVector& Location);
+
+	void LogStats() const;
+
+private:
+	struct FEntry
+	{
+		UParticleSystemComponent* Component;
+		double LastUsed;
+	};
+
+	// One per frame budget and what was asked of it
+	struct FBudget
+	{
+		FBudget()
+			: Frame(0)
+			, FrameSpawns(0)
+			, Requests(0)
+			, DistanceCulled(0)
+			, Dropped(0)
+		{
+		}
+
+		uint64 Frame;
+		int32 FrameSpawns;
+
+		int32 Requests;
+		int32 DistanceCulled;
+		int32 Dropped;
+	};
+
+	// Counts one request against Budget, true if it is near enough and within MaxPerFrame
+	bool Admit(FBudget& Budget, int32 MaxPerFrame, const FVector& Location);
+
+	UParticleSystemComponent* Acquire(UParticleSystem* Template);
+
+	TWeakObjectPtr<AActor> Owner;
+	TArray<FEntry> Entries;
+
+	FBudget MuzzleBudget;
+	FBudget PooledBudget;
+
+	int32 Created;
+	int32 Reused;
+	int32 Stolen;
+};
@@ -0,0 +1,460 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterFireChannel.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterGameMode.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/CoreNet.h"
+
+static TAutoConsoleVariable<int32> CVarFireRedundancy(
+	TEXT("ns.Fire.Redundancy"),
+	8,
+	TEXT("Most unacknowledged fire events one packet carries, oldest first. Clamped to 1-16."));
+
+static TAutoConsoleVariable<float> CVarFireResendInterval(
+	TEXT("ns.Fire.ResendInterval"),
+	0.02f,
+	TEXT("Seconds between packets repeating unacknowledged fire events when nothing new was fired."));
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterFireEvent
+
+FNetworkShooterFireEvent FNetworkShooterFireEvent::Make(ENetworkShooterFireEvent InType, uint8 InBurst, const FNetworkShooterFireCommand& InCommand, uint16 InNumShots)
+{
+	FNetworkShooterFireEvent Event;
+	Event.Type = InType;
+	Event.Burst = InBurst;
+	Event.Command = InCommand;
+	Event.NumShots = InNumShots;
+
+	return Event;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterFirePacket
+
+FNetworkShooterFirePacket::FNetworkShooterFirePacket()
+	: FirstSequence(0)
+	, Generation(0)
+{
+}
+
+bool FNetworkShooterFirePacket::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	Ar << FirstSequence;
+	Ar << Generation;
+
+	uint32 NumEvents = Events.Num();
+	Ar.SerializeInt(NumEvents, MaxEvents + 1);
+
+	if (Ar.IsLoading())
+	{
+		if (NumEvents > MaxEvents)
+		{
+			Ar.SetError();
+			bOutSuccess = false;
+			return true;
+		}
+
+		Events.SetNum(NumEvents);
+	}
+
+	// Three bits of type, then only what that type uses
+	for (FNetworkShooterFireEvent& Event : Events)
+	{
+		uint32 Type = (uint32)Event.Type;
+		Ar.SerializeInt(Type, (uint32)ENetworkShooterFireEvent::Count);
+		Event.Type = (ENetworkShooterFireEvent)Type;
+
+		if (Event.Type != ENetworkShooterFireEvent::Shot)
+		{
+			Ar << Event.Burst;
+		}
+
+		if (Event.Type == ENetworkShooterFireEvent::Stop || Event.Type == ENetworkShooterFireEvent::Held)
+		{
+			Ar << Event.NumShots;
+		}
+		else
+		{
+			Event.Command.NetSerialize(Ar, Map, bOutSuccess);
+		}
+	}
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterFireSender
+
+FNetworkShooterFireSender::FNetworkShooterFireSender()
+	: FirstSequence(0)
+	, bHasNew(false)
+	, LastSendTime(0.0f)
+	, Dropped(0)
+	, bDropping(false)
+{
+}
+
+void FNetworkShooterFireSender::Add(const FNetworkShooterFireEvent& Event)
+{
+	if (Pending.Num() >= MaxPending)
+	{
+		FNetworkShooterFireEvent& Last = Pending.Last();
+
+		// The newest aim or held count of a burst stands in for the one before, the server only keeps the latest
+		if ((Event.Type == ENetworkShooterFireEvent::Aim || Event.Type == ENetworkShooterFireEvent::Held) && Last.Type == Event.Type && Last.Burst == Event.Burst)
+		{
+			Last = Event;
+			bHasNew = true;
+			return;
+		}
+
+		// Start and stop decide how many shots the server fires, the queue grows past the limit for them
+		if (DropForFull(Event))
+		{
+			return;
+		}
+	}
+
+	Pending.Add(Event);
+	bHasNew = true;
+}
+
+bool FNetworkShooterFireSender::DropForFull(const FNetworkShooterFireEvent& Event)
+{
+	const auto CanDrop = [](const FNetworkShooterFireEvent& Dropping)
+	{
+		return Dropping.Type == ENetworkShooterFireEvent::Shot || Dropping.Type == ENetworkShooterFireEvent::Aim || Dropping.Type == ENetworkShooterFireEvent::Held;
+	};
+
+	bool bDroppedEvent = false;
+
+	// Only the oldest can go without renumbering events the server may already have
+	if (CanDrop(Pending[0]))
+	{
+		Pending.RemoveAt(0, 1, false);
+		FirstSequence++;
+	}
+	else if (CanDrop(Event))
+	{
+		bDroppedEvent = true;
+	}
+	else
+	{
+		return false;
+	}
+
+	Dropped++;
+
+	if (!bDropping)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("FireSender: %d events unacknowledged, dropping shots and burst updates (%d dropped so far)"),
+			Pending.Num(), Dropped);
+		bDropping = true;
+	}
+
+	return bDroppedEvent;
+}
+
+void FNetworkShooterFireSender::Ack(uint16 Sequence)
+{
+	// Sequences wrap, so the ack counts from the oldest pending event
+	const int32 NumAcked = (int16)(uint16)(Sequence - FirstSequence) + 1;
+
+	if (NumAcked <= 0 || NumAcked > Pending.Num())
+	{
+		return;
+	}
+
+	Pending.RemoveAt(0, NumAcked, false);
+	FirstSequence += NumAcked;
+	bDropping = false;
+}
+
+bool FNetworkShooterFireSender::MakePacket(float Now, uint8 Generation, FNetworkShooterFirePacket& Packet)
+{
+	if (Pending.Num() == 0 || (!bHasNew && Now < LastSendTime + CVarFireResendInterval.GetValueOnGameThread()))
+	{
+		return false;
+	}
+
+	const int32 NumEvents = FMath::Min(Pending.Num(), FMath::Clamp(CVarFireRedundancy.GetValueOnGameThread(), 1, FNetworkShooterFirePacket::MaxEvents));
+
+	Packet.FirstSequence = FirstSequence;
+	Packet.Generation = Generation;
+	Packet.Events.Reset();
+	Packet.Events.Append(Pending.GetData(), NumEvents);
+
+	// Whatever didn't fit goes out next frame
+	bHasNew = NumEvents < Pending.Num();
+	LastSendTime = Now;
+
+	return true;
+}
+
+void FNetworkShooterFireSender::Reset()
+{
+	FirstSequence += Pending.Num();
+	Pending.Reset();
+	bHasNew = false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterFireReceiver
+
+FNetworkShooterFireReceiver::FNetworkShooterFireReceiver()
+{
+	Reset();
+}
+
+void FNetworkShooterFireReceiver::Reset()
+{
+	LastSequence = 0;
+	bHasReceived = false;
+	Duplicates = 0;
+	Lost = 0;
+	Stale = 0;
+}
+
+int32 FNetworkShooterFireReceiver::Receive(const FNetworkShooterFirePacket& Packet, uint8 Generation, FOnEvent OnEvent)
+{
+	// After a reset any sequence is taken, so a late packet of the pawn's last life would run
+	if (Packet.Generation != Generation)
+	{
+		Stale++;
+		return 0;
+	}
+
+	int32 NumRun = 0;
+
+	for (int32 i = 0; i < Packet.Events.Num(); i++)
+	{
+		const uint16 Sequence = Packet.FirstSequence + i;
+
+		if (bHasReceived)
+		{
+			// Newer means within half the range ahead
+			const int32 Ahead = (int16)(uint16)(Sequence - LastSequence);
+
+			if (Ahead <= 0)
+			{
+				Duplicates++;
+				continue;
+			}
+
+			Lost += Ahead - 1;
+		}
+
+		bHasReceived = true;
+		LastSequence = Sequence;
+
+		OnEvent(Packet.Events[i]);
+		NumRun++;
+	}
+
+	return NumRun;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterFireLatency
+
+FNetworkShooterFireLatency::FNetworkShooterFireLatency()
+{
+	Reset();
+}
+
+void FNetworkShooterFireLatency::Reset()
+{
+	FMemory::Memzero(Buckets);
+	Num = 0;
+	TotalSeconds = 0.0;
+	MaxSeconds = 0.0f;
+}
+
+void FNetworkShooterFireLatency::Add(float Seconds)
+{
+	// A client clock slightly ahead of ours reads as a shot from the future
+	Seconds = FMath::Max(Seconds, 0.0f);
+
+	Buckets[FMath::Min(FMath::FloorToInt(Seconds * 1000.0f), NumBuckets - 1)]++;
+	Num++;
+	TotalSeconds += Seconds;
+	MaxSeconds = FMath::Max(MaxSeconds, Seconds);
+}
+
+float FNetworkShooterFireLatency::GetPercentileMs(float Fraction) const
+{
+	const uint32 Target = FMath::CeilToInt(Num * Fraction);
+	uint32 Seen = 0;
+
+	for (int32 Bucket = 0; Bucket < NumBuckets; Bucket++)
+	{
+		Seen += Buckets[Bucket];
+
+		if (Seen >= Target)
+		{
+			return FMath::Min(float(Bucket + 1), MaxSeconds * 1000.0f);
+		}
+	}
+
+	return MaxSeconds * 1000.0f;
+}
+
+void FNetworkShooterFireLatency::LogStats(const TCHAR* Label) const
+{
+	UE_LOG(LogNetworkShooter, Display, TEXT("%s: %d shots, avg %.1fms, p50 %.0fms, p99 %.0fms, max %.1fms"),
+		Label, Num, Num > 0 ? TotalSeconds * 1000.0 / Num : 0.0, GetPercentileMs(0.5f), GetPercentileMs(0.99f), MaxSeconds * 1000.0f);
+}
+
+static void LogFireLatency(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("FireLatency: no NetworkShooter game mode, run this on the server"));
+		return;
+	}
+
+	GameMode->GetFireLatency().LogStats(TEXT("FireLatency"));
+
+	if (Args.Num() > 0 && Args[0] == TEXT("Reset"))
+	{
+		GameMode->GetFireLatency().Reset();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs FireLatencyStatsCommand(
+	TEXT("ns.Fire.LatencyStats"),
+	TEXT("Logs how long after the client fired the server ran each shot. Usage: ns.Fire.LatencyStats [Reset]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LogFireLatency));
+
+//////////////////////////////////////////////////////////////////////////
+// Test
+
+static void RunFireChannelTest(const TArray<FString>& Args)
+{
+	const int32 NumShots = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000;
+	const float Loss = (Args.Num() > 1 ? FCString::Atof(*Args[1]) : 2.0f) / 100.0f;
+	const float Lag = (Args.Num() > 2 ? FCString::Atof(*Args[2]) : 100.0f) / 1000.0f;
+
+	// Whole frames keep both versions on the same clock, packets go out and are read once a frame
+	const float FrameTime = 1.0f / 60.0f;
+	const int32 LagFrames = FMath::Max(FMath::CeilToInt(Lag / FrameTime), 1);
+	const int32 ShotFrames = 6;
+
+	// A lost reliable bunch is resent once the loss shows up in the acks, a round trip later
+	const int32 ResendFrames = 2 * LagFrames + 1;
+
+	FRandomStream Random(1337);
+
+	FNetworkShooterFireSender Sender;
+	FNetworkShooterFireReceiver Receiver;
+
+	FNetworkShooterFireLatency Unreliable;
+	FNetworkShooterFireLatency Reliable;
+
+	struct FInFlight
+	{
+		int32 DeliverFrame;
+		FNetworkShooterFirePacket Packet;
+	};
+
+	TArray<FInFlight> Packets;
+	TArray<TPair<int32, uint16>> Acks;
+	TArray<int32> FireFrames;
+	FireFrames.Reserve(NumShots);
+
+	int32 LastReliableFrame = 0;
+	int32 PacketsSent = 0;
+	int32 EventsSent = 0;
+	int32 ShotsRun = 0;
+
+	const int32 MaxFrames = NumShots * ShotFrames + 60 * 60;
+
+	for (int32 Frame = 0; Frame < MaxFrames && (ShotsRun < NumShots || FireFrames.Num() < NumShots); Frame++)
+	{
+		const float Now = Frame * FrameTime;
+
+		// Client: acks in, fire, send
+		for (int32 i = Acks.Num() - 1; i >= 0; i--)
+		{
+			if (Acks[i].Key <= Frame)
+			{
+				Sender.Ack(Acks[i].Value);
+				Acks.RemoveAtSwap(i, 1, false);
+			}
+		}
+
+		if (FireFrames.Num() < NumShots && Frame % ShotFrames == 0)
+		{
+			Sender.Add(FNetworkShooterFireEvent::Make(ENetworkShooterFireEvent::Shot, 0,
+				FNetworkShooterFireCommand::Make(FVector::ZeroVector, FVector::ZeroVector, FVector::ForwardVector, 0, Now)));
+
+			// The same shot as its own reliable RPC, held up by every earlier reliable still being resent
+			int32 DeliverFrame = Frame + LagFrames;
+
+			while (Random.FRand() < Loss)
+			{
+				DeliverFrame += ResendFrames;
+			}
+
+			DeliverFrame = FMath::Max(DeliverFrame, LastReliableFrame);
+			LastReliableFrame = DeliverFrame;
+
+			Reliable.Add((DeliverFrame - Frame) * FrameTime);
+			FireFrames.Add(Frame);
+		}
+
+		FInFlight Sent;
+
+		if (Sender.MakePacket(Now, 0, Sent.Packet))
+		{
+			PacketsSent++;
+			EventsSent += Sent.Packet.Events.Num();
+
+			if (Random.FRand() >= Loss)
+			{
+				Sent.DeliverFrame = Frame + LagFrames;
+				Packets.Add(Sent);
+			}
+		}
+
+		// Server: every packet that has arrived, then one ack back
+		bool bReceived = false;
+
+		while (Packets.Num() > 0 && Packets[0].DeliverFrame <= Frame)
+		{
+			Receiver.Receive(Packets[0].Packet, 0, [&](const FNetworkShooterFireEvent& Event)
+			{
+				Unreliable.Add((Frame - FireFrames[ShotsRun]) * FrameTime);
+				ShotsRun++;
+			});
+
+			Packets.RemoveAt(0, 1, false);
+			bReceived = true;
+		}
+
+		if (bReceived && Random.FRand() >= Loss)
+		{
+			Acks.Emplace(Frame + LagFrames, Receiver.GetAck());
+		}
+	}
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("FireChannel: %d shots every %.0fms, %.1f%% loss, %.0fms lag each way"),
+		NumShots, ShotFrames * FrameTime * 1000.0f, Loss * 100.0f, LagFrames * FrameTime * 1000.0f);
+	UE_LOG(LogNetworkShooter, Display, TEXT("FireChannel: %d packets for %d shots, %.2f events per packet, %d events arrived again, %d never arrived"),
+		PacketsSent, NumShots, float(EventsSent) / FMath::Max(PacketsSent, 1), Receiver.GetDuplicates(), Receiver.GetLost());
+
+	Unreliable.LogStats(TEXT("FireChannel redundant unreliable"));
+	Reliable.LogStats(TEXT("FireChannel reliable"));
+}
+
+static FAutoConsoleCommandWithArgs FireChannelTestCommand(
+	TEXT("ns.Fire.ChannelTest"),
+	TEXT("Compares when shots reach the server over the redundant unreliable fire channel and as reliable RPCs, on a simulated lossy connection. Usage: ns.Fire.ChannelTest [Shots=10000] [LossPercent=2] [LagMs=100]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&RunFireChannelTest));
@@ -0,0 +1,176 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NetworkShooterFireCommand.h"
+#include "NetworkShooterFireChannel.generated.h"
+
+enum class ENetworkShooterFireEvent : uint8
+{
+	// A single shot fired with FireAt, only accepted from bots on the server
+	Shot,
+	// First shot of a burst, then aim of each later shot and the burst's shot count
+	Start,
+	Aim,
+	Stop,
+	// Shots of a burst fired so far, for shots whose aim hasn't moved enough to send
+	Held,
+	Count
+};
+
+/** One thing the fire input did, numbered by the channel it is sent over */
+struct FNetworkShooterFireEvent
+{
+	ENetworkShooterFireEvent Type;
+	uint8 Burst;
+	FNetworkShooterFireCommand Command;
+	uint16 NumShots;
+
+	static FNetworkShooterFireEvent Make(ENetworkShooterFireEvent InType, uint8 InBurst, const FNetworkShooterFireCommand& InCommand, uint16 InNumShots = 0);
+};
+
+/**
+ * What the client sends with every unreliable fire RPC: the oldest fire events the server hasn't
+ * acknowledged, numbered from FirstSequence. Losing a packet costs nothing as long as a later one
+ * gets through, since it carries the same events again. Generation is the pawn's pool generation
+ * when the packet was sent, so one still in flight from a previous life can be told apart.
+ */
+USTRUCT()
+struct NETWORKSHOOTER_API FNetworkShooterFirePacket
+{
+	GENERATED_BODY()
+
+	// Hard limit of the encoding, ns.Fire.Redundancy picks how many are actually sent
+	static constexpr int32 MaxEvents = 16;
+
+	FNetworkShooterFirePacket();
+
+	uint16 GetLastSequence() const { return FirstSequence + Events.Num() - 1; }
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	uint16 FirstSequence;
+	uint8 Generation;
+	TArray<FNetworkShooterFireEvent, TInlineAllocator<MaxEvents>> Events;
+};
+
+template<>
+struct TStructOpsTypeTraits<FNetworkShooterFirePacket> : public TStructOpsTypeTraitsBase2<FNetworkShooterFirePacket>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
+
+/**
+ * Client end of the fire channel. Events stay queued until the server acknowledges them and go
+ * out again with every packet, in order, so the server sees every event exactly once even though
+ * nothing is sent reliably. Nothing waits on a lost packet the way later reliable RPCs do.
+ */
+class NETWORKSHOOTER_API FNetworkShooterFireSender
+{
+public:
+	// Beyond this aim and held updates are merged and shots and updates dropped, never a burst's start or stop.
+	// Only a connection that has stopped acking gets here
+	static constexpr int32 MaxPending = 64;
+
+	FNetworkShooterFireSender();
+
+	void Add(const FNetworkShooterFireEvent& Event);
+
+	// The server has every event up to and including Sequence. Acks for events not sent are ignored
+	void Ack(uint16 Sequence);
+
+	// Fills Packet when there are new events, or unacknowledged ones are due to go out again
+	bool MakePacket(float Now, uint8 Generation, FNetworkShooterFirePacket& Packet);
+
+	// Drops whatever is queued. Sequences carry on, so late packets of the last life stay older
+	void Reset();
+
+	int32 GetNumPending() const { return Pending.Num(); }
+
+	// Events given up on because the queue was full
+	int32 GetDropped() const { return Dropped; }
+
+private:
+	// Drops the oldest event if it is a shot or an update a later event covers, or else Event itself if it is one
+	bool DropForFull(const FNetworkShooterFireEvent& Event);
+
+	TArray<FNetworkShooterFireEvent> Pending;
+
+	// Sequence of Pending[0]
+	uint16 FirstSequence;
+
+	bool bHasNew;
+	float LastSendTime;
+
+	int32 Dropped;
+	bool bDropping;
+};
+
+/** Server end of the fire channel, runs each event of incoming packets once and in order */
+class NETWORKSHOOTER_API FNetworkShooterFireReceiver
+{
+public:
+	typedef TFunctionRef<void(const FNetworkShooterFireEvent& Event)> FOnEvent;
+
+	FNetworkShooterFireReceiver();
+
+	// Runs the events of Packet newer than any seen before, returns how many. A packet sent from
+	// another pool generation than Generation is from a previous life of the pawn and runs nothing
+	int32 Receive(const FNetworkShooterFirePacket& Packet, uint8 Generation, FOnEvent OnEvent);
+
+	// The newest event run, to send back as the ack
+	uint16 GetAck() const { return LastSequence; }
+
+	bool HasReceived() const { return bHasReceived; }
+
+	// Takes the next packet's sequences as they come, for a new controller
+	void Reset();
+
+	// Events that arrived again, events never seen because the sender dropped them, and packets
+	// of a previous life
+	int32 GetDuplicates() const { return Duplicates; }
+	int32 GetLost() const { return Lost; }
+	int32 GetStale() const { return Stale; }
+
+private:
+	uint16 LastSequence;
+	bool bHasReceived;
+
+	int32 Duplicates;
+	int32 Lost;
+	int32 Stale;
+};
+
+/**
+ * How long after the client fired the server ran each shot, in 1ms buckets up to a second. Fed
+ * by the character on the server, see ns.Fire.LatencyStats. The client's time is the server time
+ * it estimates, so an offset in that estimate shows up here as well.
+ */
+class NETWORKSHOOTER_API FNetworkShooterFireLatency
+{
+public:
+	static constexpr int32 NumBuckets = 1000;
+
+	FNetworkShooterFireLatency();
+
+	void Add(float Seconds);
+	void Reset();
+
+	int32 GetNum() const { return Num; }
+
+	// Milliseconds below which Fraction of the shots fall, to the millisecond
+	float GetPercentileMs(float Fraction) const;
+
+	void LogStats(const TCHAR* Label) const;
+
+private:
+	// The last bucket holds everything from a second on
+	uint32 Buckets[NumBuckets];
+	int32 Num;
+	double TotalSeconds;
+	float MaxSeconds;
+};
@@ -0,0 +1,154 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterFireCommand.h"
+#include "NetworkShooter.h"
+#include "Engine/NetSerialization.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/CoreNet.h"
+
+// Bits per origin axis, MaxOriginOffset / 2^(OriginBits - 1) is the step size
+static const int32 OriginBits = 12;
+
+static float SignNotZero(float Value)
+{
+	return Value >= 0.0f ? 1.0f : -1.0f;
+}
+
+static uint16 QuantizeUnit(float Value)
+{
+	return (uint16)FMath::RoundToInt((FMath::Clamp(Value, -1.0f, 1.0f) * 0.5f + 0.5f) * 65535.0f);
+}
+
+static float DequantizeUnit(uint16 Value)
+{
+	return Value / 65535.0f * 2.0f - 1.0f;
+}
+
+static uint16 WrapTimeStamp(float Time)
+{
+	return (uint16)(FMath::RoundToInt(Time * 1000.0f) & 0xFFFF);
+}
+
+FNetworkShooterFireCommand::FNetworkShooterFireCommand()
+	: OriginOffset(ForceInitToZero)
+	, OctX(0)
+	, OctY(0)
+	, Sequence(0)
+	, TimeStamp(0)
+{
+}
+
+FNetworkShooterFireCommand FNetworkShooterFireCommand::Make(const FVector& PawnLocation, const FVector& Origin, const FVector& Direction, uint8 Sequence, float Time)
+{
+	FNetworkShooterFireCommand Command;
+	Command.OriginOffset = (Origin - PawnLocation).BoundToCube(MaxOriginOffset);
+	Command.Sequence = Sequence;
+	Command.TimeStamp = WrapTimeStamp(Time);
+
+	// Project onto the octahedron, then fold the lower half over the upper one
+	FVector Dir = Direction.GetSafeNormal();
+
+	if (Dir.IsZero())
+	{
+		Dir = FVector::ForwardVector;
+	}
+
+	Dir /= FMath::Abs(Dir.X) + FMath::Abs(Dir.Y) + FMath::Abs(Dir.Z);
+
+	float X = Dir.X;
+	float Y = Dir.Y;
+
+	if (Dir.Z < 0.0f)
+	{
+		X = (1.0f - FMath::Abs(Dir.Y)) * SignNotZero(Dir.X);
+		Y = (1.0f - FMath::Abs(Dir.X)) * SignNotZero(Dir.Y);
+	}
+
+	Command.OctX = QuantizeUnit(X);
+	Command.OctY = QuantizeUnit(Y);
+
+	return Command;
+}
+
+FVector FNetworkShooterFireCommand::GetDirection() const
+{
+	const float X = DequantizeUnit(OctX);
+	const float Y = DequantizeUnit(OctY);
+
+	FVector Dir(X, Y, 1.0f - FMath::Abs(X) - FMath::Abs(Y));
+
+	if (Dir.Z < 0.0f)
+	{
+		Dir.X = (1.0f - FMath::Abs(Y)) * SignNotZero(X);
+		Dir.Y = (1.0f - FMath::Abs(X)) * SignNotZero(Y);
+	}
+
+	return Dir.GetUnsafeNormal();
+}
+
+float FNetworkShooterFireCommand::GetClientTime(float Now) const
+{
+	// Signed so a client clock running slightly ahead of ours doesn't wrap to a minute ago
+	const int16 Delta = (int16)(uint16)(WrapTimeStamp(Now) - TimeStamp);
+
+	return Now - Delta / 1000.0f;
+}
+
+bool FNetworkShooterFireCommand::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	SerializeFixedVector<MaxOriginOffset, OriginBits>(OriginOffset, Ar);
+
+	Ar << OctX;
+	Ar << OctY;
+	Ar << Sequence;
+	Ar << TimeStamp;
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Stats
+
+static void RunFireCommandStats(const TArray<FString>& Args)
+{
+	const int32 NumShots = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000;
+
+	FRandomStream Random(1337);
+
+	int64 TotalBits = 0;
+	float MaxAngleError = 0.0f;
+	float MaxOriginError = 0.0f;
+
+	for (int32 Shot = 0; Shot < NumShots; Shot++)
+	{
+		const FVector Pawn(Random.FRandRange(-5000.0f, 5000.0f), Random.FRandRange(-5000.0f, 5000.0f), 100.0f);
+		const FVector Origin = Pawn + Random.GetUnitVector() * Random.FRandRange(0.0f, 100.0f);
+		const FVector Direction = Random.GetUnitVector();
+
+		FNetworkShooterFireCommand Command = FNetworkShooterFireCommand::Make(Pawn, Origin, Direction, (uint8)Shot, Random.FRandRange(0.0f, 3600.0f));
+
+		bool bSuccess = false;
+		FNetBitWriter Writer(256);
+		Command.NetSerialize(Writer, nullptr, bSuccess);
+		TotalBits += Writer.GetNumBits();
+
+		FNetworkShooterFireCommand Received;
+		FNetBitReader Reader(nullptr, Writer.GetData(), Writer.GetNumBits());
+		Received.NetSerialize(Reader, nullptr, bSuccess);
+
+		const float Dot = FMath::Clamp(FVector::DotProduct(Direction, Received.GetDirection()), -1.0f, 1.0f);
+
+		MaxAngleError = FMath::Max(MaxAngleError, FMath::RadiansToDegrees(FMath::Acos(Dot)));
+		MaxOriginError = FMath::Max(MaxOriginError, FVector::Dist(Origin, Received.GetOrigin(Pawn)));
+	}
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("FireCommand: %d shots, %.1f bits/shot (raw vectors were %d), max direction error %.4f deg, max origin error %.3f units"),
+		NumShots, double(TotalBits) / FMath::Max(NumShots, 1), 2 * 3 * 32 + 32, MaxAngleError, MaxOriginError);
+}
+
+static FAutoConsoleCommandWithArgs FireCommandStatsCommand(
+	TEXT("ns.FireCommand.Stats"),
+	TEXT("Round trips random fire commands through NetSerialize and reports size and precision. Usage: ns.FireCommand.Stats [NumShots=10000]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&RunFireCommandStats));
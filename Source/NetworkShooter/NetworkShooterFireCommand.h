@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NetworkShooterFireCommand.generated.h"
+
+/**
+ * One shot as sent from the owning client to the server. Everything is quantized in NetSerialize:
+ *
+ *   Origin offset from the pawn    3 x 12 bits, +-128 units, 1/16 unit steps
+ *   Direction, octahedral          2 x 16 bits
+ *   Fire sequence                  8 bits
+ *   Client time, wrapped ms        16 bits
+ *
+ * 92 bits against the 224 of the two raw vectors and float it replaces. The server adds the offset
+ * to where it has the pawn and builds the trace end itself, so the client never sends an end point.
+ */
+USTRUCT()
+struct NETWORKSHOOTER_API FNetworkShooterFireCommand
+{
+	GENERATED_BODY()
+
+	// Furthest an origin may sit from the pawn, anything further is clamped
+	static constexpr int32 MaxOriginOffset = 128;
+
+	FNetworkShooterFireCommand();
+
+	// Client side, Time is the server world time the client sees
+	static FNetworkShooterFireCommand Make(const FVector& PawnLocation, const FVector& Origin, const FVector& Direction, uint8 Sequence, float Time);
+
+	FVector GetOrigin(const FVector& PawnLocation) const { return PawnLocation + OriginOffset; }
+
+	// Always unit length
+	FVector GetDirection() const;
+
+	// Rebuilds the client time from the wrapped stamp, valid for shots within 32 seconds of Now
+	float GetClientTime(float Now) const;
+
+	uint8 GetSequence() const { return Sequence; }
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+private:
+	FVector OriginOffset;
+
+	// Octahedral encoded direction, each axis mapped from [-1, 1]
+	uint16 OctX;
+	uint16 OctY;
+
+	uint8 Sequence;
+
+	// Client time in milliseconds, wrapped to 16 bits
+	uint16 TimeStamp;
+};
+
+template<>
+struct TStructOpsTypeTraits<FNetworkShooterFireCommand> : public TStructOpsTypeTraitsBase2<FNetworkShooterFireCommand>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
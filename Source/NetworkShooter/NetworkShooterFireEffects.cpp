@@ -0,0 +1,137 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterFireEffects.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterGameMode.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/CoreNet.h"
+
+static TAutoConsoleVariable<int32> CVarFireEffectsBatch(
+	TEXT("ns.FireEffects.Batch"),
+	1,
+	TEXT("Send shot effects to clients once per server frame.\n")
+	TEXT(" 0: one multicast per shot\n")
+	TEXT(" 1: one batched multicast per frame"));
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterFireEffectBatch
+
+bool FNetworkShooterFireEffectBatch::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint8 Num = (uint8)FMath::Min(Effects.Num(), MaxEffects);
+	Ar << Num;
+
+	if (Ar.IsLoading())
+	{
+		Effects.SetNum(Num);
+	}
+
+	bOutSuccess = true;
+
+	for (int32 i = 0; i < Num; i++)
+	{
+		FNetworkShooterFireEffect& Effect = Effects[i];
+
+		UObject* Shooter = Effect.Shooter.Get();
+
+		// A shooter that isn't relevant to this client comes through as null and is skipped on replay
+		if (Map != nullptr)
+		{
+			Map->SerializeObject(Ar, ANetworkShooterCharacter::StaticClass(), Shooter);
+		}
+
+		Ar << Effect.TimeOffset;
+
+		if (Ar.IsLoading())
+		{
+			Effect.Shooter = Cast<ANetworkShooterCharacter>(Shooter);
+		}
+	}
+
+	bOutSuccess &= !Ar.IsError();
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterFireEffectQueue
+
+FNetworkShooterFireEffectQueue::FNetworkShooterFireEffectQueue()
+	: TotalShots(0)
+	, TotalBatches(0)
+	, MaxBatchSize(0)
+{
+	Pending.Reserve(FNetworkShooterFireEffectBatch::MaxEffects);
+}
+
+bool FNetworkShooterFireEffectQueue::IsBatching()
+{
+	return CVarFireEffectsBatch.GetValueOnGameThread() != 0;
+}
+
+void FNetworkShooterFireEffectQueue::Add(ANetworkShooterCharacter* Shooter, float Time)
+{
+	Pending.Add({ Shooter, Time });
+	TotalShots++;
+}
+
+bool FNetworkShooterFireEffectQueue::Flush(FNetworkShooterFireEffectBatch& OutBatch)
+{
+	OutBatch.Effects.Reset();
+
+	if (Pending.Num() == 0)
+	{
+		return false;
+	}
+
+	// Anything past a full batch waits for the next frame
+	const int32 Num = FMath::Min(Pending.Num(), (int32)FNetworkShooterFireEffectBatch::MaxEffects);
+
+	// Shooters' fire times come in the order their packets arrived, not the order they fired
+	float FirstTime = Pending[0].Time;
+
+	for (int32 i = 1; i < Num; i++)
+	{
+		FirstTime = FMath::Min(FirstTime, Pending[i].Time);
+	}
+
+	for (int32 i = 0; i < Num; i++)
+	{
+		FNetworkShooterFireEffect Effect;
+		Effect.Shooter = Pending[i].Shooter;
+		Effect.TimeOffset = (uint8)FMath::Clamp(FMath::RoundToInt((Pending[i].Time - FirstTime) * 1000.0f), 0, 255);
+
+		OutBatch.Effects.Add(Effect);
+	}
+
+	Pending.RemoveAt(0, Num, false);
+
+	TotalBatches++;
+	MaxBatchSize = FMath::Max(MaxBatchSize, Num);
+
+	return true;
+}
+
+void FNetworkShooterFireEffectQueue::LogStats() const
+{
+	UE_LOG(LogNetworkShooter, Display, TEXT("Fire effects: %d shots in %d batched multicasts (%.2f shots/multicast, max %d), %d pending, batching %s"),
+		TotalShots, TotalBatches, TotalBatches > 0 ? float(TotalShots) / TotalBatches : 0.0f, MaxBatchSize, Pending.Num(),
+		IsBatching() ? TEXT("on") : TEXT("off"));
+}
+
+static void LogFireEffectStats(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode != nullptr)
+	{
+		GameMode->GetFireEffects().LogStats();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs FireEffectStatsCommand(
+	TEXT("ns.FireEffects.Stats"),
+	TEXT("Logs how many shots were sent per fire effect multicast"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LogFireEffectStats));
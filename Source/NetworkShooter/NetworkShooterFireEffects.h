@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NetworkShooterFireEffects.generated.h"
+
+class ANetworkShooterCharacter;
+
+/** One shot to replay on clients */
+struct FNetworkShooterFireEffect
+{
+	TWeakObjectPtr<ANetworkShooterCharacter> Shooter;
+
+	// Milliseconds after the earliest shot of the batch
+	uint8 TimeOffset;
+};
+
+/**
+ * Every shot the server ran in one frame, sent to clients as a single multicast instead
+ * of one MultiCastShootEffects RPC per shot. Serialized as a count followed by the
+ * shooter reference and an 8 bit time offset per shot.
+ */
+USTRUCT()
+struct NETWORKSHOOTER_API FNetworkShooterFireEffectBatch
+{
+	GENERATED_BODY()
+
+	static constexpr int32 MaxEffects = 255;
+
+	TArray<FNetworkShooterFireEffect, TInlineAllocator<64>> Effects;
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FNetworkShooterFireEffectBatch> : public TStructOpsTypeTraitsBase2<FNetworkShooterFireEffectBatch>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
+
+/**
+ * Server side collection of the shots fired this frame, flushed once per game mode tick.
+ * ns.FireEffects.Batch 0 falls back to the per shot multicast for comparison.
+ */
+class NETWORKSHOOTER_API FNetworkShooterFireEffectQueue
+{
+public:
+	FNetworkShooterFireEffectQueue();
+
+	static bool IsBatching();
+
+	// Time is when the shot was fired, not when the server ran it, so shots a stream caught up
+	// on in one frame keep their cadence on clients
+	void Add(ANetworkShooterCharacter* Shooter, float Time);
+
+	// Moves up to MaxEffects pending shots into OutBatch, false if there were none
+	bool Flush(FNetworkShooterFireEffectBatch& OutBatch);
+
+	void LogStats() const;
+
+private:
+	struct FPending
+	{
+		TWeakObjectPtr<ANetworkShooterCharacter> Shooter;
+		float Time;
+	};
+
+	TArray<FPending> Pending;
+
+	int32 TotalShots;
+	int32 TotalBatches;
+	int32 MaxBatchSize;
+};
@@ -0,0 +1,464 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterFireStream.h"
+#include "NetworkShooterFireChannel.h"
+#include "NetworkShooter.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<float> CVarFireAimAngle(
+	TEXT("ns.Fire.AimAngle"),
+	1.0f,
+	TEXT("Degrees the aim has to turn during a burst before the client sends an aim update."));
+
+static TAutoConsoleVariable<float> CVarFireAimDistance(
+	TEXT("ns.Fire.AimDistance"),
+	30.0f,
+	TEXT("Distance the shot origin has to move during a burst before the client sends an aim update."));
+
+static TAutoConsoleVariable<float> CVarFireAimInterval(
+	TEXT("ns.Fire.AimInterval"),
+	0.2f,
+	TEXT("Least seconds between two aim updates of a burst."));
+
+static TAutoConsoleVariable<float> CVarFireStreamTolerance(
+	TEXT("ns.Fire.StreamTolerance"),
+	0.1f,
+	TEXT("Seconds of jitter and resends allowed for when clamping a stop's shot count to the burst's elapsed time."));
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterFireTrigger
+
+FNetworkShooterFireTrigger::FNetworkShooterFireTrigger()
+	: bHeld(false)
+	, Burst(0)
+	, StartTime(0.0f)
+	, Shots(0)
+	, NextPressTime(0.0f)
+	, SentOrigin(FVector::ZeroVector)
+	, SentDirection(FVector::ForwardVector)
+	, SentTime(0.0f)
+{
+}
+
+bool FNetworkShooterFireTrigger::Press(float Now)
+{
+	if (bHeld || Now < NextPressTime)
+	{
+		return false;
+	}
+
+	bHeld = true;
+	Burst++;
+	StartTime = Now;
+	Shots = 0;
+
+	return true;
+}
+
+bool FNetworkShooterFireTrigger::IsShotDue(float Now, float Interval) const
+{
+	return bHeld && Now >= StartTime + Shots * Interval;
+}
+
+int32 FNetworkShooterFireTrigger::Release(float Interval)
+{
+	if (!bHeld)
+	{
+		return 0;
+	}
+
+	bHeld = false;
+	NextPressTime = StartTime + Shots * Interval;
+
+	return Shots;
+}
+
+bool FNetworkShooterFireTrigger::ShouldSendAim(const FVector& Origin, const FVector& Direction, float Now) const
+{
+	if (Now < SentTime + CVarFireAimInterval.GetValueOnGameThread())
+	{
+		return false;
+	}
+
+	return (Direction | SentDirection) < FMath::Cos(FMath::DegreesToRadians(CVarFireAimAngle.GetValueOnGameThread())) ||
+		FVector::DistSquared(Origin, SentOrigin) > FMath::Square(CVarFireAimDistance.GetValueOnGameThread());
+}
+
+void FNetworkShooterFireTrigger::AimSent(const FVector& Origin, const FVector& Direction, float Now)
+{
+	SentOrigin = Origin;
+	SentDirection = Direction;
+	SentTime = Now;
+}
+
+void FNetworkShooterFireTrigger::Reset()
+{
+	// Burst keeps counting so the server never mixes up the old pawn's last burst with a new one
+	bHeld = false;
+	Shots = 0;
+	NextPressTime = 0.0f;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterFireStream
+
+FNetworkShooterFireStream::FNetworkShooterFireStream()
+	: ClampedStops(0)
+{
+	Reset();
+}
+
+void FNetworkShooterFireStream::Reset()
+{
+	bActive = false;
+	Burst = 0;
+	StartArrivalTime = 0.0f;
+	StartServerTime = 0.0f;
+	StartClientTime = 0.0f;
+	LastShotServerTime = -MAX_flt;
+	ShotsFired = 0;
+	ShotsConfirmed = 0;
+	ShotLimit = INDEX_NONE;
+	AimShot = INDEX_NONE;
+	AimClientTime = 0.0f;
+}
+
+void FNetworkShooterFireStream::Start(uint8 InBurst, const FNetworkShooterFireCommand& Command, float ClientTime, float Now, float Interval, FOnShot OnShot)
+{
+	// The last burst is behind its cadence or never got its stop, e.g. the client's pawn was reset.
+	// It gets the shots the client confirmed, nothing past that is owed
+	if (bActive)
+	{
+		Tick(Now, Interval, OnShot);
+	}
+
+	bActive = true;
+	Burst = InBurst;
+	StartArrivalTime = Now;
+
+	// Clicking faster than the weapon cycles doesn't fire faster
+	StartServerTime = FMath::Max(Now, LastShotServerTime + Interval);
+	StartClientTime = ClientTime;
+
+	ShotsFired = 0;
+	ShotsConfirmed = 1;
+	ShotLimit = INDEX_NONE;
+
+	Aim = Command;
+	AimShot = 0;
+	AimClientTime = ClientTime;
+}
+
+void FNetworkShooterFireStream::UpdateAim(uint8 InBurst, const FNetworkShooterFireCommand& Command, float ClientTime)
+{
+	if (!bActive || InBurst != Burst)
+	{
+		return;
+	}
+
+	// Sequences wrap every 256 shots, taken as the one within half the range of where the burst is
+	const int32 Reference = FMath::Max(ShotsConfirmed, ShotsFired);
+	const int32 Shot = Reference + (int8)(uint8)(Command.GetSequence() - (uint8)Reference);
+
+	if (Shot < ShotsConfirmed - 1 || Shot <= AimShot || (ShotLimit != INDEX_NONE && Shot >= ShotLimit))
+	{
+		return;
+	}
+
+	ShotsConfirmed = FMath::Max(ShotsConfirmed, Shot + 1);
+
+	Aim = Command;
+	AimShot = Shot;
+	AimClientTime = ClientTime;
+}
+
+void FNetworkShooterFireStream::Confirm(uint8 InBurst, int32 NumShots)
+{
+	if (!bActive || InBurst != Burst || ShotLimit != INDEX_NONE)
+	{
+		return;
+	}
+
+	ShotsConfirmed = FMath::Max(ShotsConfirmed, NumShots);
+}
+
+void FNetworkShooterFireStream::Stop(uint8 InBurst, int32 NumShots, float Now, float Interval)
+{
+	if (!bActive || InBurst != Burst)
+	{
+		return;
+	}
+
+	// Shots the client could have fired since the start left it, give or take the network's jitter
+	const int32 Allowed = FMath::FloorToInt((Now - StartArrivalTime + CVarFireStreamTolerance.GetValueOnGameThread()) / Interval) + 1;
+
+	if (NumShots > Allowed)
+	{
+		ClampedStops++;
+		NumShots = Allowed;
+	}
+
+	// Everything fired was confirmed, so only a clamped stop can be under it
+	ShotLimit = FMath::Max(NumShots, ShotsFired);
+
+	if (ShotsFired >= ShotLimit)
+	{
+		bActive = false;
+	}
+}
+
+int32 FNetworkShooterFireStream::Tick(float Now, float Interval, FOnShot OnShot)
+{
+	if (!bActive)
+	{
+		return 0;
+	}
+
+	const int32 FirstShot = ShotsFired;
+	const int32 Confirmed = ShotLimit != INDEX_NONE ? ShotLimit : ShotsConfirmed;
+
+	while (ShotsFired < Confirmed)
+	{
+		const float ShotServerTime = StartServerTime + ShotsFired * Interval;
+
+		if (Now < ShotServerTime)
+		{
+			break;
+		}
+
+		// Shots without their own aim update rewind to where the cadence puts them on the client
+		OnShot(Aim, AimShot == ShotsFired ? AimClientTime : StartClientTime + ShotsFired * Interval);
+
+		LastShotServerTime = ShotServerTime;
+		ShotsFired++;
+	}
+
+	if (ShotLimit != INDEX_NONE && ShotsFired >= ShotLimit)
+	{
+		bActive = false;
+	}
+
+	return ShotsFired - FirstShot;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Test
+
+static void RunFireStreamTest(const TArray<FString>& Args)
+{
+	const int32 NumBursts = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1000;
+	const float Loss = (Args.Num() > 1 ? FCString::Atof(*Args[1]) : 5.0f) / 100.0f;
+
+	const float Interval = 0.1f;
+	const float FrameTime = 1.0f / 60.0f;
+	const float Latency = 0.05f;
+	const float Jitter = 0.02f;
+
+	FRandomStream Random(1337);
+
+	// Both ends of the character's fire RPCs, only the connection in between is simulated
+	FNetworkShooterFireTrigger Trigger;
+	FNetworkShooterFireSender Sender;
+	FNetworkShooterFireReceiver Receiver;
+	FNetworkShooterFireStream Stream;
+
+	struct FInFlight
+	{
+		float DeliverTime;
+		FNetworkShooterFirePacket Packet;
+	};
+
+	TArray<FInFlight> Packets;
+	TArray<TPair<float, uint16>> Acks;
+
+	int32 PacketsSent = 0;
+	int32 PacketsLost = 0;
+	int32 EventsAdded = 0;
+
+	TArray<int32> ClientShots;
+	TArray<int32> ServerShots;
+	ClientShots.Reserve(NumBursts);
+	ServerShots.Reserve(NumBursts);
+
+	int32 ServerBurst = INDEX_NONE;
+
+	auto CountShot = [&](const FNetworkShooterFireCommand& Aim, float ClientTime)
+	{
+		ServerShots[ServerBurst]++;
+	};
+
+	auto Add = [&](const FNetworkShooterFireEvent& Event)
+	{
+		Sender.Add(Event);
+		EventsAdded++;
+	};
+
+	float Now = 0.0f;
+	float ReleaseTime = 0.0f;
+	float PressTime = 0.0f;
+	bool bWantsToFire = false;
+	FVector AimDirection = FVector::ForwardVector;
+
+	// Run on past the last burst until everything has landed
+	const float DrainTime = 2.0f;
+	float EndTime = MAX_flt;
+
+	while (Now < EndTime)
+	{
+		// Client: acks in, hold for a random time, wait a random time, press again
+		for (int32 i = Acks.Num() - 1; i >= 0; i--)
+		{
+			if (Acks[i].Key <= Now)
+			{
+				Sender.Ack(Acks[i].Value);
+				Acks.RemoveAtSwap(i, 1, false);
+			}
+		}
+
+		if (!bWantsToFire && ClientShots.Num() < NumBursts && Now >= PressTime)
+		{
+			bWantsToFire = true;
+		}
+
+		if (bWantsToFire && !Trigger.bHeld && Trigger.Press(Now))
+		{
+			ClientShots.Add(0);
+			ReleaseTime = Now + Random.FRandRange(0.01f, 1.5f);
+		}
+
+		while (Trigger.IsShotDue(Now, Interval))
+		{
+			const int32 Shot = Trigger.TakeShot();
+
+			// Tracking something, the aim drifts a little with every shot
+			AimDirection = FRotator(Random.FRandRange(-0.5f, 0.5f), Random.FRandRange(-1.0f, 1.0f), 0.0f).RotateVector(AimDirection);
+
+			if (Shot > 0 && !Trigger.ShouldSendAim(FVector::ZeroVector, AimDirection, Now))
+			{
+				Add(FNetworkShooterFireEvent::Make(ENetworkShooterFireEvent::Held, Trigger.Burst, FNetworkShooterFireCommand(), (uint16)(Shot + 1)));
+				continue;
+			}
+
+			Trigger.AimSent(FVector::ZeroVector, AimDirection, Now);
+
+			Add(FNetworkShooterFireEvent::Make(Shot == 0 ? ENetworkShooterFireEvent::Start : ENetworkShooterFireEvent::Aim, Trigger.Burst,
+				FNetworkShooterFireCommand::Make(FVector::ZeroVector, FVector::ZeroVector, AimDirection, (uint8)Shot, Now)));
+		}
+
+		if (Trigger.bHeld && Now >= ReleaseTime)
+		{
+			const int32 NumShots = Trigger.Release(Interval);
+
+			ClientShots.Last() = NumShots;
+			Add(FNetworkShooterFireEvent::Make(ENetworkShooterFireEvent::Stop, Trigger.Burst, FNetworkShooterFireCommand(), (uint16)NumShots));
+
+			bWantsToFire = false;
+			PressTime = Now + Random.FRandRange(0.0f, 0.5f);
+
+			if (ClientShots.Num() == NumBursts)
+			{
+				EndTime = Now + DrainTime;
+			}
+		}
+
+		FInFlight Sent;
+
+		if (Sender.MakePacket(Now, 0, Sent.Packet))
+		{
+			PacketsSent++;
+
+			if (Random.FRand() < Loss)
+			{
+				PacketsLost++;
+			}
+			else
+			{
+				Sent.DeliverTime = Now + Latency + Random.FRandRange(-Jitter, Jitter);
+				Packets.Add(Sent);
+			}
+		}
+
+		// Server: every packet that has arrived in arrival order, one ack back, then tick
+		Packets.StableSort([](const FInFlight& A, const FInFlight& B) { return A.DeliverTime < B.DeliverTime; });
+
+		int32 Delivered = 0;
+
+		for (; Delivered < Packets.Num() && Packets[Delivered].DeliverTime <= Now; Delivered++)
+		{
+			Receiver.Receive(Packets[Delivered].Packet, 0, [&](const FNetworkShooterFireEvent& Event)
+			{
+				const float ClientTime = Event.Command.GetClientTime(Now);
+
+				switch (Event.Type)
+				{
+				case ENetworkShooterFireEvent::Start:
+					Stream.Start(Event.Burst, Event.Command, ClientTime, Now, Interval, CountShot);
+					ServerBurst = ServerShots.Add(0);
+					break;
+
+				case ENetworkShooterFireEvent::Aim:
+					Stream.UpdateAim(Event.Burst, Event.Command, ClientTime);
+					break;
+
+				case ENetworkShooterFireEvent::Held:
+					Stream.Confirm(Event.Burst, Event.NumShots);
+					break;
+
+				case ENetworkShooterFireEvent::Stop:
+					Stream.Stop(Event.Burst, Event.NumShots, Now, Interval);
+					break;
+
+				default:
+					break;
+				}
+			});
+		}
+
+		Packets.RemoveAt(0, Delivered, false);
+
+		if (Delivered > 0 && Receiver.HasReceived() && Random.FRand() >= Loss)
+		{
+			Acks.Emplace(Now + Latency + Random.FRandRange(-Jitter, Jitter), Receiver.GetAck());
+		}
+
+		if (ServerBurst != INDEX_NONE)
+		{
+			Stream.Tick(Now, Interval, CountShot);
+		}
+
+		Now += FrameTime;
+	}
+
+	int32 Overshot = 0;
+	int32 Undershot = 0;
+	int32 TotalShots = 0;
+
+	for (int32 i = 0; i < ClientShots.Num(); i++)
+	{
+		TotalShots += ClientShots[i];
+
+		const int32 Fired = ServerShots.IsValidIndex(i) ? ServerShots[i] : 0;
+
+		Overshot += Fired > ClientShots[i] ? 1 : 0;
+		Undershot += Fired < ClientShots[i] ? 1 : 0;
+	}
+
+	const int32 Bursts = FMath::Max(ClientShots.Num(), 1);
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("FireStream: %d bursts, %d shots at %.1f%% loss (%d of %d packets lost, %d events arrived again): server fired more in %d bursts, fewer in %d, %d stops clamped"),
+		ClientShots.Num(), TotalShots, Loss * 100.0f, PacketsLost, PacketsSent, Receiver.GetDuplicates(), Overshot, Undershot, Stream.GetClampedStops());
+	UE_LOG(LogNetworkShooter, Display, TEXT("FireStream: %.2f events and %.2f packets per burst, %.2f shots per burst"),
+		float(EventsAdded) / Bursts, float(PacketsSent) / Bursts, float(TotalShots) / Bursts);
+
+	// Every burst has to end with exactly the client's count, a shot more is as wrong as one less
+	if (Overshot > 0 || Undershot > 0 || Receiver.GetLost() > 0)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("FireStream test failed"));
+	}
+}
+
+static FAutoConsoleCommandWithArgs FireStreamTestCommand(
+	TEXT("ns.Fire.StreamTest"),
+	TEXT("Runs the start/stop fire protocol through the fire channel over a simulated lossy connection and compares the server's shots with the client's. Usage: ns.Fire.StreamTest [Bursts=1000] [LossPercent=5]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&RunFireStreamTest));
@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NetworkShooterFireCommand.h"
+
+/**
+ * Client side of the fire protocol. While the trigger is held a shot is due every Interval
+ * seconds from the press, the weapon has to cycle before the next burst can start.
+ */
+struct NETWORKSHOOTER_API FNetworkShooterFireTrigger
+{
+	FNetworkShooterFireTrigger();
+
+	// Starts a burst unless one is running or the weapon is still cycling. Shot 0 is due right away
+	bool Press(float Now);
+
+	// Shots of the held burst due by Now and not yet taken, take them with TakeShot
+	bool IsShotDue(float Now, float Interval) const;
+	int32 TakeShot() { return Shots++; }
+
+	// Ends the burst, returns how many shots it fired
+	int32 Release(float Interval);
+
+	// Whether a shot's aim moved past ns.Fire.AimAngle or ns.Fire.AimDistance from the last one sent,
+	// at most every ns.Fire.AimInterval. The server keeps firing a burst with the last aim it got,
+	// other shots only send the burst's shot count
+	bool ShouldSendAim(const FVector& Origin, const FVector& Direction, float Now) const;
+	void AimSent(const FVector& Origin, const FVector& Direction, float Now);
+
+	void Reset();
+
+	bool bHeld;
+	uint8 Burst;
+	float StartTime;
+	int32 Shots;
+	float NextPressTime;
+
+	FVector SentOrigin;
+	FVector SentDirection;
+	float SentTime;
+};
+
+/**
+ * Server side of the fire protocol. The client sends a start with the first shot's aim, then for
+ * every later shot an aim update if its aim has moved enough or else the shot count so far, and a
+ * stop with the burst's shot count, all over the fire channel which delivers them in order. The
+ * server fires on its own tick at the weapon cadence, but only shots the client has confirmed
+ * firing, so the stop's count is the burst's count. The stop is clamped to what the burst's
+ * elapsed time allows.
+ */
+class NETWORKSHOOTER_API FNetworkShooterFireStream
+{
+public:
+	// Runs one shot with the latest aim, ClientTime is when the client fired it for lag compensation
+	typedef TFunctionRef<void(const FNetworkShooterFireCommand& Aim, float ClientTime)> FOnShot;
+
+	FNetworkShooterFireStream();
+
+	// Shot 0 of Burst. A burst still running is cut to the shots confirmed so far, the rest is dropped
+	void Start(uint8 InBurst, const FNetworkShooterFireCommand& Command, float ClientTime, float Now, float Interval, FOnShot OnShot);
+
+	// Aim of shot Command.GetSequence() of Burst, which confirms the client fired up to it
+	void UpdateAim(uint8 InBurst, const FNetworkShooterFireCommand& Command, float ClientTime);
+
+	// The client has fired NumShots in Burst and still holds the trigger
+	void Confirm(uint8 InBurst, int32 NumShots);
+
+	// The client fired NumShots in Burst, no more than the time since the start allows
+	void Stop(uint8 InBurst, int32 NumShots, float Now, float Interval);
+
+	// Fires every confirmed shot that is due at the cadence by Now, returns how many
+	int32 Tick(float Now, float Interval, FOnShot OnShot);
+
+	void Reset();
+
+	bool IsActive() const { return bActive; }
+
+	// Stops whose count was more than the burst's time allowed
+	int32 GetClampedStops() const { return ClampedStops; }
+
+private:
+	bool bActive;
+	uint8 Burst;
+
+	// When the start arrived, and when shot 0 goes off once the weapon has cycled
+	float StartArrivalTime;
+	float StartServerTime;
+	float StartClientTime;
+	float LastShotServerTime;
+
+	int32 ShotsFired;
+	int32 ShotsConfirmed;
+	int32 ShotLimit;
+
+	FNetworkShooterFireCommand Aim;
+	int32 AimShot;
+	float AimClientTime;
+
+	int32 ClampedStops;
+};
@@ -0,0 +1,202 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterFrameBudget.h"
+#include "NetworkShooter.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_STAT(STAT_NS_GameModeTick);
+DEFINE_STAT(STAT_NS_HitscanResolve);
+DEFINE_STAT(STAT_NS_Spawn);
+DEFINE_STAT(STAT_NS_Respawn);
+DEFINE_STAT(STAT_NS_Fire);
+DEFINE_STAT(STAT_NS_TakeDamage);
+DEFINE_STAT(STAT_NS_SpawnPointOccupancy);
+DEFINE_STAT(STAT_NS_DrawHUD);
+
+DEFINE_STAT(STAT_NS_Shots);
+DEFINE_STAT(STAT_NS_Characters);
+DEFINE_STAT(STAT_NS_SimulatedRagdolls);
+DEFINE_STAT(STAT_NS_DeathAnimations);
+
+DEFINE_STAT(STAT_NS_LagCompensationMemory);
+DEFINE_STAT(STAT_NS_HitscanQueueMemory);
+DEFINE_STAT(STAT_NS_ShotTraceMemory);
+DEFINE_STAT(STAT_NS_LoadTestMemory);
+
+static TAutoConsoleVariable<int32> CVarFrameBudgetSummary(
+	TEXT("ns.FrameBudget.Summary"),
+	1,
+	TEXT("Write Saved/FrameBudget/FrameBudget-<Map>-<Date>.csv with p50/p99 per gameplay scope when a match ends on the server."));
+
+// Only costs anything while a CSV capture is running, e.g. -csvCaptureFrames=N on the dedicated server
+CSV_DEFINE_CATEGORY_MODULE(NETWORKSHOOTER_API, NetworkShooter, true);
+
+static const TCHAR* ScopeNames[] =
+{
+	TEXT("GameModeTick"),
+	TEXT("HitscanResolve"),
+	TEXT("Spawn"),
+	TEXT("Respawn"),
+	TEXT("Fire"),
+	TEXT("TakeDamage"),
+	TEXT("SpawnPointOccupancy"),
+	TEXT("DrawHUD"),
+};
+
+static_assert(UE_ARRAY_COUNT(ScopeNames) == (int32)ENetworkShooterScope::Count, "Every scope needs a name");
+
+FNetworkShooterFrameBudget& FNetworkShooterFrameBudget::Get()
+{
+	static FNetworkShooterFrameBudget Budget;
+	return Budget;
+}
+
+FNetworkShooterFrameBudget::FNetworkShooterFrameBudget()
+{
+	Reset();
+}
+
+void FNetworkShooterFrameBudget::Reset()
+{
+	FMemory::Memzero(FrameCycles);
+	FMemory::Memzero(FrameCalls);
+	FMemory::Memzero(Histories);
+	Frames = 0;
+	LastEndFrameTime = 0.0;
+	LastFrameSeconds = 0.0;
+}
+
+void FNetworkShooterFrameBudget::EndFrame()
+{
+	for (int32 i = 0; i < (int32)ENetworkShooterScope::Count; i++)
+	{
+		if (FrameCalls[i] == 0)
+		{
+			continue;
+		}
+
+		FScopeHistory& History = Histories[i];
+		const double Seconds = FPlatformTime::ToSeconds64(FrameCycles[i]);
+		const double Microseconds = Seconds * 1000000.0;
+
+		const int32 Bucket = Microseconds > 1.0 ? FMath::Min(FMath::FloorToInt(FMath::Log2(Microseconds) * BucketsPerOctave), NumBuckets - 1) : 0;
+
+		History.Buckets[Bucket]++;
+		History.Frames++;
+		History.Calls += FrameCalls[i];
+		History.TotalSeconds += Seconds;
+		History.MaxSeconds = FMath::Max(History.MaxSeconds, Seconds);
+
+		FrameCycles[i] = 0;
+		FrameCalls[i] = 0;
+	}
+
+	const double Now = FPlatformTime::Seconds();
+
+	LastFrameSeconds = LastEndFrameTime > 0.0 ? Now - LastEndFrameTime : 0.0;
+	LastEndFrameTime = Now;
+
+	Frames++;
+}
+
+float FNetworkShooterFrameBudget::GetPercentileMs(const FScopeHistory& History, float Fraction) const
+{
+	const uint32 Target = FMath::CeilToInt(History.Frames * Fraction);
+	uint32 Seen = 0;
+
+	for (int32 Bucket = 0; Bucket < NumBuckets; Bucket++)
+	{
+		Seen += History.Buckets[Bucket];
+
+		if (Seen >= Target)
+		{
+			// Upper edge of the bucket, never more than the slowest frame actually seen
+			const double Microseconds = FMath::Pow(2.0f, float(Bucket + 1) / BucketsPerOctave);
+			return FMath::Min(Microseconds / 1000.0, History.MaxSeconds * 1000.0);
+		}
+	}
+
+	return History.MaxSeconds * 1000.0;
+}
+
+bool FNetworkShooterFrameBudget::WriteSummary(const FString& Filename) const
+{
+	TArray<FString> Rows;
+	Rows.Add(TEXT("Scope,Frames,FramesRun,CallsPerFrameRun,AvgMs,P50Ms,P99Ms,MaxMs"));
+
+	for (int32 i = 0; i < (int32)ENetworkShooterScope::Count; i++)
+	{
+		const FScopeHistory& History = Histories[i];
+
+		if (History.Frames == 0)
+		{
+			continue;
+		}
+
+		Rows.Add(FString::Printf(TEXT("%s,%d,%d,%.2f,%.4f,%.4f,%.4f,%.4f"),
+			ScopeNames[i], Frames, History.Frames, double(History.Calls) / History.Frames,
+			History.TotalSeconds * 1000.0 / History.Frames,
+			GetPercentileMs(History, 0.5f), GetPercentileMs(History, 0.99f),
+			History.MaxSeconds * 1000.0));
+	}
+
+	return FFileHelper::SaveStringArrayToFile(Rows, *Filename);
+}
+
+FString FNetworkShooterFrameBudget::MakeSummaryFilename(const FString& MapName)
+{
+	return FPaths::ProjectSavedDir() / TEXT("FrameBudget") / FString::Printf(TEXT("FrameBudget-%s-%s.csv"), *MapName, *FDateTime::Now().ToString());
+}
+
+void FNetworkShooterFrameBudget::EndMatch(const FString& MapName)
+{
+	if (CVarFrameBudgetSummary.GetValueOnGameThread() != 0 && Frames > 0)
+	{
+		const FString Filename = MakeSummaryFilename(MapName);
+
+		if (WriteSummary(Filename))
+		{
+			UE_LOG(LogNetworkShooter, Display, TEXT("Frame budget for %d frames written to %s"), Frames, *Filename);
+		}
+		else
+		{
+			UE_LOG(LogNetworkShooter, Warning, TEXT("Unable to write the frame budget to %s"), *Filename);
+		}
+	}
+
+	Reset();
+}
+
+static void DumpFrameBudget(const TArray<FString>& Args, UWorld* World)
+{
+	const FString Filename = Args.Num() > 0 ? Args[0] : FNetworkShooterFrameBudget::MakeSummaryFilename(World ? World->GetMapName() : TEXT("None"));
+
+	if (FNetworkShooterFrameBudget::Get().WriteSummary(Filename))
+	{
+		UE_LOG(LogNetworkShooter, Display, TEXT("Frame budget for %d frames written to %s"), FNetworkShooterFrameBudget::Get().GetFrames(), *Filename);
+	}
+	else
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("Unable to write the frame budget to %s"), *Filename);
+	}
+}
+
+static void ResetFrameBudget(const TArray<FString>& Args, UWorld* World)
+{
+	FNetworkShooterFrameBudget::Get().Reset();
+}
+
+static FAutoConsoleCommandWithWorldAndArgs DumpFrameBudgetCommand(
+	TEXT("ns.FrameBudget.Dump"),
+	TEXT("Writes p50/p99 per gameplay scope since the match started. Usage: ns.FrameBudget.Dump [Filename]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&DumpFrameBudget));
+
+static FAutoConsoleCommandWithWorldAndArgs ResetFrameBudgetCommand(
+	TEXT("ns.FrameBudget.Reset"),
+	TEXT("Clears the frame budget histograms"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&ResetFrameBudget));
@@ -0,0 +1,135 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Stats/Stats.h"
+
+DECLARE_STATS_GROUP(TEXT("NetworkShooter"), STATGROUP_NetworkShooter, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("GameMode Tick"), STAT_NS_GameModeTick, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Hitscan Resolve"), STAT_NS_HitscanResolve, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Spawn"), STAT_NS_Spawn, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Respawn"), STAT_NS_Respawn, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Fire"), STAT_NS_Fire, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("TakeDamage"), STAT_NS_TakeDamage, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("SpawnPoint Occupancy"), STAT_NS_SpawnPointOccupancy, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DrawHUD"), STAT_NS_DrawHUD, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Shots"), STAT_NS_Shots, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Characters"), STAT_NS_Characters, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Simulated Ragdolls"), STAT_NS_SimulatedRagdolls, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Death Animations"), STAT_NS_DeathAnimations, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Lag Compensation"), STAT_NS_LagCompensationMemory, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Hitscan Queue"), STAT_NS_HitscanQueueMemory, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Shot Trace"), STAT_NS_ShotTraceMemory, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Load Test"), STAT_NS_LoadTestMemory, STATGROUP_NetworkShooter, NETWORKSHOOTER_API);
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(NETWORKSHOOTER_API, NetworkShooter);
+
+/** Gameplay scopes tracked by the frame budget, one per NS_SCOPE_CYCLE_COUNTER name */
+enum class ENetworkShooterScope : uint8
+{
+	GameModeTick,
+	HitscanResolve,
+	Spawn,
+	Respawn,
+	Fire,
+	TakeDamage,
+	SpawnPointOccupancy,
+	DrawHUD,
+	Count
+};
+
+/**
+ * Per frame time of each gameplay scope over a match, kept as a log scale histogram so a full
+ * match costs a fixed few kilobytes. Game mode EndPlay writes p50/p99 per scope to
+ * Saved/FrameBudget, so a server's frame time can be broken down without attaching a profiler.
+ * Samples are the total a scope took in a frame, counted only for frames where it ran.
+ */
+class NETWORKSHOOTER_API FNetworkShooterFrameBudget
+{
+public:
+	// 8 buckets per doubling from 1us, the last one holds everything past about a second
+	static constexpr int32 BucketsPerOctave = 8;
+	static constexpr int32 NumBuckets = 20 * BucketsPerOctave;
+
+	static FNetworkShooterFrameBudget& Get();
+
+	FNetworkShooterFrameBudget();
+
+	void Add(ENetworkShooterScope Scope, uint64 Cycles)
+	{
+		FrameCycles[(int32)Scope] += Cycles;
+		FrameCalls[(int32)Scope]++;
+	}
+
+	// Folds this frame's totals into the histograms, bound to the end of every engine frame
+	void EndFrame();
+
+	void Reset();
+
+	// Writes one CSV row per scope that ran. Returns false if the file couldn't be written
+	bool WriteSummary(const FString& Filename) const;
+
+	// Saved/FrameBudget/FrameBudget-<MapName>-<Date>.csv
+	static FString MakeSummaryFilename(const FString& MapName);
+
+	// Writes the match's summary unless ns.FrameBudget.Summary is off, then starts over
+	void EndMatch(const FString& MapName);
+
+	int32 GetFrames() const { return Frames; }
+
+	// The whole last frame, end to end, not just the scopes that ran in it
+	double GetLastFrameSeconds() const { return LastFrameSeconds; }
+
+private:
+	struct FScopeHistory
+	{
+		uint32 Buckets[NumBuckets];
+		int32 Frames;
+		int64 Calls;
+		double TotalSeconds;
+		double MaxSeconds;
+	};
+
+	// Milliseconds below which Fraction of the scope's frames fall, to bucket precision
+	float GetPercentileMs(const FScopeHistory& History, float Fraction) const;
+
+	uint64 FrameCycles[(int32)ENetworkShooterScope::Count];
+	uint32 FrameCalls[(int32)ENetworkShooterScope::Count];
+
+	FScopeHistory Histories[(int32)ENetworkShooterScope::Count];
+	int32 Frames;
+
+	double LastEndFrameTime;
+	double LastFrameSeconds;
+};
+
+/** Adds the time until it goes out of scope to the frame budget, game thread only */
+class FNetworkShooterBudgetScope
+{
+public:
+	explicit FNetworkShooterBudgetScope(ENetworkShooterScope InScope)
+		: Scope(InScope)
+		, StartCycles(FPlatformTime::Cycles64())
+	{
+	}
+
+	~FNetworkShooterBudgetScope()
+	{
+		FNetworkShooterFrameBudget::Get().Add(Scope, FPlatformTime::Cycles64() - StartCycles);
+	}
+
+private:
+	ENetworkShooterScope Scope;
+	uint64 StartCycles;
+};
+
+// Stat cycle counter, CSV profiler timing and frame budget sample for one gameplay scope
+#define NS_SCOPE_CYCLE_COUNTER(Scope) \
+	SCOPE_CYCLE_COUNTER(STAT_NS_##Scope); \
+	CSV_SCOPED_TIMING_STAT(NetworkShooter, Scope); \
+	FNetworkShooterBudgetScope NSBudgetScope_##Scope(ENetworkShooterScope::Scope)
@@ -6,11 +6,18 @@
 #include "NetworkShooterPlayerState.h"
 #include "NetworkShooterSpawnPoint.h"
 #include "NetworkShooterCharacter.h"
+#include "NetworkShooterBotController.h"
+#include "NetworkShooterFrameBudget.h"
 #include "UObject/ConstructorHelpers.h"
 #include "EngineUtils.h" 
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
 #include "NSGameState.h"
 
-bool ANetworkShooterGameMode::bInGameMenu = true;
+static TAutoConsoleVariable<int32> CVarLoginQueue(
+	TEXT("ns.Login.Queue"),
+	1,
+	TEXT("Queue remote players for a pawn on login and admit a few a frame, see ns.Login.MaxPerFrame. 0 spawns them inside the login."));
 
 ANetworkShooterGameMode::ANetworkShooterGameMode()
 	: Super()
@@ -26,15 +33,33 @@ ANetworkShooterGameMode::ANetworkShooterGameMode()
 	bReplicates = true;
 
 	GameStateClass = ANSGameState::StaticClass();
+
+	// Tick after character movement so the hitbox history holds what gets replicated this frame
+	PrimaryActorTick.TickGroup = TG_PostPhysics;
+
+	NumBots = 0;
+	JoinStormFrames = 0;
+	JoinStormMaxFrameSeconds = 0.0;
+	JoinStormStartTime = 0.0;
+	JoinStormFrame = 0;
+	NumTravelers = 0;
+	MapLoadedTime = 0.0;
+	TravelStartTime = 0.0;
+	SelectorFrame = 0;
+	LivingFrame = 0;
 }
 
 void ANetworkShooterGameMode::BeginPlay()
 {
 	Super::BeginPlay();
 
+	// Summaries cover one match, see EndPlay
+	FNetworkShooterFrameBudget::Get().Reset();
+
 	if (GetLocalRole() == ROLE_Authority)
 	{
-		Cast<ANSGameState>(GameState)->bInMenu = bInGameMenu;
+		// The lobby and the match share a map, travel to the match adds ?Match to the URL
+		Cast<ANSGameState>(GameState)->SetInMenu(!UGameplayStatics::HasOption(OptionsString, TEXT("Match")));
 
 		for (TActorIterator<ANetworkShooterSpawnPoint> Iter(GetWorld()); Iter; ++Iter)
 		{
@@ -48,15 +73,47 @@ void ANetworkShooterGameMode::BeginPlay()
 			}
 		}
 
+		for (auto Spawn : RedSpawns)
+		{
+			Spawn->OnSpawnPointFreed.AddUObject(this, &ANetworkShooterGameMode::OnSpawnPointFreed);
+		}
+
+		for (auto Spawn : BlueSpawns)
+		{
+			Spawn->OnSpawnPointFreed.AddUObject(this, &ANetworkShooterGameMode::OnSpawnPointFreed);
+		}
+
+		TArray<FVector> RedLocations;
+		TArray<FVector> BlueLocations;
+
+		for (auto Spawn : RedSpawns)
+		{
+			RedLocations.Add(Spawn->GetActorLocation());
+		}
+
+		for (auto Spawn : BlueSpawns)
+		{
+			BlueLocations.Add(Spawn->GetActorLocation());
+		}
+
+		SpawnSelector.SetSpawnLocations(RedLocations, BlueLocations);
+
 		// Spawn the server
 		APlayerController* thisCont = GetWorld()->GetFirstPlayerController();
 
-		if (thisCont)
+		ANetworkShooterCharacter* thisChar = thisCont ? Cast<ANetworkShooterCharacter>(thisCont->GetPawn()) : nullptr;
+		ANetworkShooterPlayerState* thisPS = thisCont ? thisCont->GetPlayerState<ANetworkShooterPlayerState>() : nullptr;
+
+		if (thisChar != nullptr && thisPS != nullptr)
 		{
-			ANetworkShooterCharacter* thisChar = Cast<ANetworkShooterCharacter>(thisCont->GetPawn());
+			// Blue in the lobby, the match keeps the team it brought over travel
+			if (!thisPS->HasTeam())
+			{
+				thisPS->SetTeam(ETeam::BLUE_TEAM);
+			}
 
-			thisChar->SetTeam(ETeam::BLUE_TEAM);
-			BlueTeam.Add(thisChar);
+			thisChar->SetNetworkShooterPlayerState(thisPS);
+			JoinTeam(thisChar, thisPS->Team);
 			Spawn(thisChar);
 		}
 
@@ -66,32 +123,94 @@ void ANetworkShooterGameMode::BeginPlay()
 
 void ANetworkShooterGameMode::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	if (EndPlayReason == EEndPlayReason::Quit || EndPlayReason == EEndPlayReason::EndPlayInEditor)
+	// Write out whatever a running load test has so far
+	LoadTest.Stop();
+	PushModelBench.Stop();
+
+	if (GetLocalRole() == ROLE_Authority)
 	{
-		bInGameMenu = true;
+		FNetworkShooterFrameBudget::Get().EndMatch(GetWorld()->GetMapName());
 	}
 }
 
 void ANetworkShooterGameMode::Tick(float DeltaSeconds)
 {
+	NS_SCOPE_CYCLE_COUNTER(GameModeTick);
+
 	if(GetLocalRole() == ROLE_Authority)
 	{
 		APlayerController* thisCont = GetWorld()->GetFirstPlayerController();
 
-		if (ToBeSpawned.Num() != 0)
+		INC_DWORD_STAT_BY(STAT_NS_Shots, HitscanQueue.Num());
+		SET_DWORD_STAT(STAT_NS_Characters, RedTeam.Num() + BlueTeam.Num());
+		CSV_CUSTOM_STAT(NetworkShooter, Shots, HitscanQueue.Num(), ECsvCustomStatOp::Set);
+		CSV_CUSTOM_STAT(NetworkShooter, Characters, RedTeam.Num() + BlueTeam.Num(), ECsvCustomStatOp::Set);
+
+		// Every fire packet of this frame has been received by now, stream shots of characters that tick later wait a frame
 		{
-			for (auto charToSpawn : ToBeSpawned)
+			NS_SCOPE_CYCLE_COUNTER(HitscanResolve);
+
+			HitscanQueue.Resolve(GetWorld(), LagCompensation, [](const FNetworkShooterHitscanQueue::FShot& Shot)
 			{
-				Spawn(charToSpawn);
-			}
+				ANetworkShooterCharacter* Shooter = Shot.Shooter.Get();
+
+				if (Shooter != nullptr && !Shooter->IsInPool())
+				{
+					Shooter->ApplyShot(Shot.Start, Shot.End, Shot.Hit);
+				}
+			});
+		}
+
+		LagCompensation.Snapshot(GetWorld()->GetTimeSeconds());
+
+		// Before this frame's admissions, the last frame's time is the one they cost
+		UpdateJoinStorm();
+
+		// Players that logged in, a few a frame so a map change full of them doesn't hitch
+		Admissions.Update(GetWorld()->GetTimeSeconds(), [this](AController* Controller)
+		{
+			AdmitPlayer(Controller);
+		});
+
+		UpdateTravelTiming();
+
+		PawnPool.Update(GetWorld()->GetTimeSeconds());
+
+		// Only does work when a spawn point freed up for someone waiting
+		SpawnQueue.Update(GetWorld()->GetTimeSeconds(), [this](ANetworkShooterCharacter* Character)
+		{
+			return TrySpawn(Character);
+		});
+
+		// Every shot of this frame has been run by now, send their effects in one go
+		if (FireEffects.Flush(FireEffectBatch))
+		{
+			LoadTest.CountMulticast();
+			Cast<ANSGameState>(GameState)->MultiCastFireEffects(FireEffectBatch);
+
+			// The game state's profile updates it a couple of times a second, unreliable multicasts
+			// wait for the next update and only net.MaxRPCPerNetUpdate go out with it
+			GameState->ForceNetUpdate();
 		}
 
-		if (thisCont != nullptr && thisCont->IsInputKeyDown(EKeys::R))
+		LoadTest.Tick(GetWorld(), DeltaSeconds);
+		PushModelBench.Tick(this);
+
+		SET_MEMORY_STAT(STAT_NS_LagCompensationMemory, LagCompensation.GetAllocatedSize());
+		SET_MEMORY_STAT(STAT_NS_HitscanQueueMemory, HitscanQueue.GetAllocatedSize());
+		SET_MEMORY_STAT(STAT_NS_LoadTestMemory, LoadTest.GetAllocatedSize());
+#if NS_WITH_SHOT_TRACE
+		SET_MEMORY_STAT(STAT_NS_ShotTraceMemory, ShotTrace.GetAllocatedSize());
+#endif
+
+		// Seamless, so connections and player states come along, see HandleSeamlessTravelPlayer
+		if (thisCont != nullptr && thisCont->IsInputKeyDown(EKeys::R) && !GetWorld()->IsInSeamlessTravel())
 		{
-			bInGameMenu = false;
-			GetWorld()->ServerTravel(L"/Game/FirstPersonCPP/Maps/FirstPersonExampleMap?Listen");
+			// The game mode that starts a seamless travel is gone by the time players spawn on the new map,
+			// so the URL carries the start over. A travel that fails leaves nothing behind for the next one
+			GetWorld()->ServerTravel(FString::Printf(TEXT("/Game/FirstPersonCPP/Maps/FirstPersonExampleMap?Listen?Match?TravelStart=%.3f"), FPlatformTime::Seconds()));
 
-			Cast<ANSGameState>(GameState)->bInMenu = bInGameMenu;
+			Cast<ANSGameState>(GameState)->SetInMenu(false);
 		}
 	}
 }
@@ -108,95 +227,487 @@ void ANetworkShooterGameMode::PostLogin(APlayerController* NewPlayer)
 		Teamless->SetNetworkShooterPlayerState(NPlayerState);
 	}
 
-	// Assign Team and spawn
+	// Players that got a pawn during the login, queued ones get their team and spawn on admission
 	if (GetLocalRole() == ROLE_Authority && Teamless != nullptr)
 	{
-		if (BlueTeam.Num() > RedTeam.Num())
+		AssignTeam(Teamless, NPlayerState);
+		Spawn(Teamless);
+	}
+}
+
+void ANetworkShooterGameMode::Logout(AController* Exiting)
+{
+	Admissions.Remove(Exiting);
+
+	if (Exiting->PlayerState != nullptr)
+	{
+		TravelRoster.Remove(Exiting->PlayerState->GetPlayerId());
+	}
+
+	Super::Logout(Exiting);
+}
+
+void ANetworkShooterGameMode::HandleStartingNewPlayer_Implementation(APlayerController* NewPlayer)
+{
+	// Queued players can't restart yet, so Super leaves them without a pawn until admission
+	QueueNewPlayer(NewPlayer);
+
+	Super::HandleStartingNewPlayer_Implementation(NewPlayer);
+}
+
+bool ANetworkShooterGameMode::QueueNewPlayer(AController* NewPlayer)
+{
+	// Remote players wait their turn for a pawn, the listen server's own player starts right away.
+	// Bots count as remote, IsLocalController is true for every AI controller on the server
+	if (GetLocalRole() != ROLE_Authority || NewPlayer->IsLocalPlayerController() || CVarLoginQueue.GetValueOnGameThread() == 0)
+	{
+		return false;
+	}
+
+	EnqueueAdmission(NewPlayer);
+
+	return true;
+}
+
+bool ANetworkShooterGameMode::PlayerCanRestart_Implementation(APlayerController* Player)
+{
+	// Also keeps the match start from spawning everyone who is still waiting
+	return !Admissions.Contains(Player) && Super::PlayerCanRestart_Implementation(Player);
+}
+
+void ANetworkShooterGameMode::GetSeamlessTravelActorList(bool bToTransition, TArray<AActor*>& ActorList)
+{
+	Super::GetSeamlessTravelActorList(bToTransition, ActorList);
+
+	// Bot controllers don't travel, their player states would be left behind without one
+	ActorList.RemoveAll([](AActor* Actor)
+	{
+		APlayerState* thisPS = Cast<APlayerState>(Actor);
+
+		return thisPS != nullptr && Cast<APlayerController>(thisPS->GetOwner()) == nullptr;
+	});
+}
+
+void ANetworkShooterGameMode::PostSeamlessTravel()
+{
+	MapLoadedTime = FPlatformTime::Seconds();
+	TravelStartTime = FCString::Atod(*UGameplayStatics::ParseOption(OptionsString, TEXT("TravelStart")));
+
+	// Every traveling player's team in one go, so late joiners are balanced against players still loading
+	for (FConstControllerIterator Iter = GetWorld()->GetControllerIterator(); Iter; ++Iter)
+	{
+		APlayerController* thisCont = Cast<APlayerController>(Iter->Get());
+		ANetworkShooterPlayerState* thisPS = thisCont ? thisCont->GetPlayerState<ANetworkShooterPlayerState>() : nullptr;
+
+		if (thisPS != nullptr && thisPS->HasTeam())
 		{
-			RedTeam.Add(Teamless);
-			NPlayerState->Team = ETeam::RED_TEAM;
+			TravelRoster.Add(thisPS->GetPlayerId(), thisPS->Team);
 		}
-		else if (BlueTeam.Num() < RedTeam.Num())
+	}
+
+	NumTravelers = TravelRoster.Num();
+
+	Super::PostSeamlessTravel();
+}
+
+void ANetworkShooterGameMode::HandleSeamlessTravelPlayer(AController*& C)
+{
+	// APlayerState::Reset zeroes the score before it is copied, the match keeps the lobby's
+	const float Score = C->PlayerState != nullptr ? C->PlayerState->GetScore() : 0.0f;
+
+	if (C->PlayerState != nullptr)
+	{
+		TravelRoster.Remove(C->PlayerState->GetPlayerId());
+	}
+
+	// Copies the player state over and, through HandleStartingNewPlayer, queues the player with its team
+	Super::HandleSeamlessTravelPlayer(C);
+
+	ANetworkShooterPlayerState* thisPS = C->GetPlayerState<ANetworkShooterPlayerState>();
+
+	if (thisPS == nullptr)
+	{
+		return;
+	}
+
+	thisPS->SetScore(Score);
+
+	// Without the login queue Super gave it a pawn, and PostLogin doesn't run for travelers
+	ANetworkShooterCharacter* thisChar = Cast<ANetworkShooterCharacter>(C->GetPawn());
+
+	if (thisChar != nullptr && !Admissions.Contains(C))
+	{
+		thisChar->SetNetworkShooterPlayerState(thisPS);
+
+		if (thisPS->HasTeam())
 		{
-			BlueTeam.Add(Teamless);
-			NPlayerState->Team = ETeam::BLUE_TEAM;
+			JoinTeam(thisChar, thisPS->Team);
 		}
 		else
 		{
-			BlueTeam.Add(Teamless);
-			NPlayerState->Team = ETeam::BLUE_TEAM;
+			AssignTeam(thisChar, thisPS);
 		}
 
-		Teamless->CurrentTeam = NPlayerState->Team;
-		Teamless->SetTeam(NPlayerState->Team);
-		Spawn(Teamless);
+		Spawn(thisChar);
+	}
+}
+
+void ANetworkShooterGameMode::UpdateTravelTiming()
+{
+	if (NumTravelers == 0 || TravelRoster.Num() > 0 || Admissions.Num() > 0)
+	{
+		return;
+	}
+
+	const double Now = FPlatformTime::Seconds();
+
+	// TravelStartTime is unset when the travel came from the servertravel command
+	if (TravelStartTime > 0.0)
+	{
+		UE_LOG(LogNetworkShooter, Display, TEXT("Seamless travel: %d players spawned %.2fs after the travel started, %.2fs after the map loaded"),
+			NumTravelers, Now - TravelStartTime, Now - MapLoadedTime);
+	}
+	else
+	{
+		UE_LOG(LogNetworkShooter, Display, TEXT("Seamless travel: %d players spawned %.2fs after the map loaded"), NumTravelers, Now - MapLoadedTime);
+	}
+
+	NumTravelers = 0;
+	TravelStartTime = 0.0;
+}
+
+void ANetworkShooterGameMode::EnqueueAdmission(AController* Controller)
+{
+	ANetworkShooterPlayerState* thisPS = Controller->GetPlayerState<ANetworkShooterPlayerState>();
+
+	if (thisPS == nullptr)
+	{
+		return;
+	}
+
+	// Picked now so the team replicates while the player waits, players coming from the lobby keep theirs
+	if (!thisPS->HasTeam())
+	{
+		thisPS->SetTeam(ChooseTeam());
+	}
+
+	Admissions.Enqueue(Controller, thisPS->Team, GetWorld()->GetTimeSeconds());
+}
+
+void ANetworkShooterGameMode::AdmitPlayer(AController* Controller)
+{
+	ANetworkShooterPlayerState* thisPS = Controller->GetPlayerState<ANetworkShooterPlayerState>();
+
+	RestartPlayer(Controller);
+
+	ANetworkShooterCharacter* thisChar = Cast<ANetworkShooterCharacter>(Controller->GetPawn());
+
+	if (thisChar == nullptr || thisPS == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("Unable to admit %s"), *Controller->GetName());
+		return;
+	}
+
+	thisChar->SetNetworkShooterPlayerState(thisPS);
+	JoinTeam(thisChar, thisPS->Team);
+	Spawn(thisChar);
+}
+
+ETeam ANetworkShooterGameMode::ChooseTeam() const
+{
+	int32 NumBlue = BlueTeam.Num() + Admissions.Num(ETeam::BLUE_TEAM);
+	int32 NumRed = RedTeam.Num() + Admissions.Num(ETeam::RED_TEAM);
+
+	for (const TPair<int32, ETeam>& Traveler : TravelRoster)
+	{
+		(Traveler.Value == ETeam::RED_TEAM ? NumRed : NumBlue)++;
+	}
+
+	return NumBlue > NumRed ? ETeam::RED_TEAM : ETeam::BLUE_TEAM;
+}
+
+void ANetworkShooterGameMode::JoinTeam(ANetworkShooterCharacter* Character, ETeam Team)
+{
+	if (Team == ETeam::RED_TEAM)
+	{
+		RedTeam.Add(Character);
+	}
+	else
+	{
+		BlueTeam.Add(Character);
+	}
+
+	Character->SetCurrentTeam(Team);
+}
+
+void ANetworkShooterGameMode::AssignTeam(ANetworkShooterCharacter* Character, ANetworkShooterPlayerState* PlayerState)
+{
+	PlayerState->SetTeam(ChooseTeam());
+	JoinTeam(Character, PlayerState->Team);
+}
+
+ANetworkShooterCharacter* ANetworkShooterGameMode::AddBot()
+{
+	if (GetLocalRole() != ROLE_Authority)
+	{
+		return nullptr;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	ANetworkShooterBotController* Bot = GetWorld()->SpawnActor<ANetworkShooterBotController>(SpawnParams);
+	ANetworkShooterCharacter* BotChar = Cast<ANetworkShooterCharacter>(GetWorld()->SpawnActor(DefaultPawnClass, nullptr, nullptr, SpawnParams));
+	ANetworkShooterPlayerState* BotPS = Bot ? Bot->GetPlayerState<ANetworkShooterPlayerState>() : nullptr;
+
+	if (BotChar == nullptr || BotPS == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("Unable to spawn a bot"));
+		return nullptr;
+	}
+
+	BotPS->SetPlayerName(FString::Printf(TEXT("Bot%d"), ++NumBots));
+	Bot->Possess(BotChar);
+
+	AssignTeam(BotChar, BotPS);
+	Spawn(BotChar);
+
+	return BotChar;
+}
+
+void ANetworkShooterGameMode::SimulateJoinStorm(int32 NumPlayers)
+{
+	if (GetLocalRole() != ROLE_Authority)
+	{
+		return;
+	}
+
+	if (JoinStormBots.Num() > 0)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("JoinStorm: the last one is still draining"));
+		return;
+	}
+
+	bool bQueued = false;
+	const double StartTime = FPlatformTime::Seconds();
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	for (int32 i = 0; i < NumPlayers; i++)
+	{
+		// A bot logs in without a pawn, like a client coming back from a map change
+		ANetworkShooterBotController* Bot = GetWorld()->SpawnActor<ANetworkShooterBotController>(SpawnParams);
+		ANetworkShooterPlayerState* BotPS = Bot ? Bot->GetPlayerState<ANetworkShooterPlayerState>() : nullptr;
+
+		if (BotPS == nullptr)
+		{
+			continue;
+		}
+
+		BotPS->SetPlayerName(FString::Printf(TEXT("Bot%d"), ++NumBots));
+		JoinStormBots.Add(Bot);
+
+		// The queue decision a remote player's HandleStartingNewPlayer makes, which only takes player controllers
+		bQueued = QueueNewPlayer(Bot);
+
+		if (!bQueued)
+		{
+			BotPS->SetTeam(ChooseTeam());
+			AdmitPlayer(Bot);
+		}
+	}
+
+	JoinStormFrames = 0;
+	JoinStormMaxFrameSeconds = 0.0;
+	JoinStormStartTime = StartTime;
+	JoinStormFrame = GFrameCounter;
+
+	// The whole frames until the last bot is admitted are logged once it has, see UpdateJoinStorm
+	UE_LOG(LogNetworkShooter, Display, TEXT("JoinStorm: %d players %s, %.2fms joining them"),
+		JoinStormBots.Num(), bQueued ? TEXT("queued for admission") : TEXT("admitted inline"), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+}
+
+void ANetworkShooterGameMode::UpdateJoinStorm()
+{
+	// The console command may run before our tick, its frame is only over by the next one
+	if (JoinStormBots.Num() == 0 || GFrameCounter == JoinStormFrame)
+	{
+		return;
+	}
+
+	JoinStormFrames++;
+	JoinStormMaxFrameSeconds = FMath::Max(JoinStormMaxFrameSeconds, FNetworkShooterFrameBudget::Get().GetLastFrameSeconds());
+
+	for (const TWeakObjectPtr<AController>& Bot : JoinStormBots)
+	{
+		if (Bot.IsValid() && Admissions.Contains(Bot.Get()))
+		{
+			return;
+		}
+	}
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("JoinStorm: %d players in %.2fs over %d frames, worst whole frame %.2fms"),
+		JoinStormBots.Num(), FPlatformTime::Seconds() - JoinStormStartTime, JoinStormFrames, JoinStormMaxFrameSeconds * 1000.0);
+
+	for (const TWeakObjectPtr<AController>& Bot : JoinStormBots)
+	{
+		if (Bot.IsValid())
+		{
+			RemoveBot(Bot.Get());
+		}
+	}
+
+	JoinStormBots.Reset();
+}
+
+void ANetworkShooterGameMode::RemoveBot(AController* Bot)
+{
+	Admissions.Remove(Bot);
+
+	if (ANetworkShooterCharacter* BotChar = Cast<ANetworkShooterCharacter>(Bot->GetPawn()))
+	{
+		RedTeam.Remove(BotChar);
+		BlueTeam.Remove(BotChar);
+		SpawnQueue.Remove(BotChar);
+
+		BotChar->Destroy();
 	}
+
+	// Takes its player state along
+	Bot->Destroy();
 }
 
 void ANetworkShooterGameMode::Spawn(ANetworkShooterCharacter* Character)
 {
+	NS_SCOPE_CYCLE_COUNTER(Spawn);
+
 	if (GetLocalRole() == ROLE_Authority)
 	{
-		// Find Spawn point that is not blocked
-		ANetworkShooterSpawnPoint* thisSpawn{ nullptr };
-		TArray<ANetworkShooterSpawnPoint*>* targetTeam{ nullptr };
-
-		if (Character->CurrentTeam == ETeam::BLUE_TEAM)
+		if (TrySpawn(Character))
 		{
-			targetTeam = &BlueSpawns;
+			SpawnQueue.Remove(Character);
 		}
 		else
 		{
-			targetTeam = &RedSpawns;
+			SpawnQueue.Enqueue(Character, Character->CurrentTeam, GetWorld()->GetTimeSeconds());
 		}
+	}
+}
 
-		for (auto Spawn : (*targetTeam))
-		{
-			Spawn->UpdateOverlaps();
-			if (!Spawn->GetBlocked())
-			{
-				// Remove from spawn queue location
-				if (ToBeSpawned.Find(Character) != INDEX_NONE)
-				{
-					ToBeSpawned.Remove(Character);
-				}
+bool ANetworkShooterGameMode::TrySpawn(ANetworkShooterCharacter* Character)
+{
+	// Find the best scoring spawn point that is not blocked
+	TArray<ANetworkShooterSpawnPoint*>* targetTeam{ nullptr };
 
-				// Otherwise set actor location
-				Character->SetActorLocation(Spawn->GetActorLocation());
+	if (Character->CurrentTeam == ETeam::BLUE_TEAM)
+	{
+		targetTeam = &BlueSpawns;
+	}
+	else
+	{
+		targetTeam = &RedSpawns;
+	}
 
-				Spawn->UpdateOverlaps();
+	// Built at most once a frame, a join storm or a drained spawn queue spawns many characters in one
+	if (SelectorFrame != GFrameCounter)
+	{
+		UpdateSpawnSelectorCharacters();
+		SelectorFrame = GFrameCounter;
+	}
 
-				return;
-			}
+	const int32 SpawnIndex = SpawnSelector.SelectSpawn(Character->CurrentTeam, [targetTeam](int32 Index)
+	{
+		return !(*targetTeam)[Index]->GetBlocked();
+	});
+
+	if (SpawnIndex == INDEX_NONE)
+	{
+		return false;
+	}
+
+	// Move onto the point, the move raises the overlap that marks it blocked
+	Character->SetActorLocation((*targetTeam)[SpawnIndex]->GetActorLocation());
+
+	// A pawn from the pool waits hidden wherever it last died until it gets here
+	Character->SetActorHiddenInGame(false);
+
+	return true;
+}
+
+void ANetworkShooterGameMode::OnSpawnPointFreed(ANetworkShooterSpawnPoint* SpawnPoint)
+{
+	SpawnQueue.Wake(SpawnPoint->Team);
+}
+
+const TArray<ANetworkShooterCharacter*>& ANetworkShooterGameMode::GetLivingCharacters()
+{
+	if (LivingFrame == GFrameCounter)
+	{
+		return LivingCharacters;
+	}
+
+	LivingFrame = GFrameCounter;
+	LivingCharacters.Reset();
+
+	for (TActorIterator<ANetworkShooterCharacter> Iter(GetWorld()); Iter; ++Iter)
+	{
+		ANetworkShooterPlayerState* thisPS = Iter->GetNetworkShooterPlayerState();
+
+		if (!Iter->IsInPool() && !Iter->IsDead() && thisPS != nullptr && thisPS->Health > 0)
+		{
+			LivingCharacters.Add(*Iter);
 		}
+	}
+
+	return LivingCharacters;
+}
+
+void ANetworkShooterGameMode::UpdateSpawnSelectorCharacters()
+{
+	SelectorLocations.Reset();
+	SelectorTeams.Reset();
 
-		if (ToBeSpawned.Find(Character) == INDEX_NONE)
+	for (ANetworkShooterCharacter* thisChar : GetLivingCharacters())
+	{
+		// Bots may have gathered the list before someone died this frame
+		if (IsValid(thisChar) && !thisChar->IsInPool() && !thisChar->IsDead())
 		{
-			ToBeSpawned.Add(Character);
+			SelectorLocations.Add(thisChar->GetActorLocation());
+			SelectorTeams.Add(thisChar->GetNetworkShooterPlayerState()->Team);
 		}
 	}
+
+	SpawnSelector.SetCharacters(SelectorLocations, SelectorTeams);
 }
 
 void ANetworkShooterGameMode::Respawn(ANetworkShooterCharacter* Character)
 {
+	NS_SCOPE_CYCLE_COUNTER(Respawn);
+
 	if (GetLocalRole() == ROLE_Authority)
 	{
 		AController* thisPC = Character->GetController();
+		ANetworkShooterPlayerState* thisPS = Cast<ANetworkShooterPlayerState>(thisPC->PlayerState);
 		Character->DetachFromControllerPendingDestroy();
 
-		ANetworkShooterCharacter* newChar = Cast<ANetworkShooterCharacter>(GetWorld()->SpawnActor(DefaultPawnClass));
+		// Another pooled pawn, the dead one stays a corpse for a while before it joins the pool
+		ANetworkShooterCharacter* newChar = PawnPool.Acquire(thisPS->Team);
+		PawnPool.ReleaseLater(Character, thisPS->Team, GetWorld()->GetTimeSeconds());
+
+		if (newChar == nullptr)
+		{
+			newChar = Cast<ANetworkShooterCharacter>(GetWorld()->SpawnActor(DefaultPawnClass));
+		}
 
 		if (newChar)
 		{
 			thisPC->Possess(newChar);
-			ANetworkShooterPlayerState* thisPS = Cast<ANetworkShooterPlayerState>(newChar->GetController()->PlayerState);
 
-			newChar->CurrentTeam = thisPS->Team;
+			newChar->SetCurrentTeam(thisPS->Team);
 			newChar->SetNetworkShooterPlayerState(thisPS);
 
 			Spawn(newChar);
-
-			newChar->SetTeam(newChar->GetNetworkShooterPlayerState()->Team);
 		}
 	}
 }
\ No newline at end of file
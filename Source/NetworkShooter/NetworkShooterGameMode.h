@@ -4,9 +4,21 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/GameMode.h"
+#include "NetworkShooterAdmissionQueue.h"
+#include "NetworkShooterFireChannel.h"
+#include "NetworkShooterFireEffects.h"
+#include "NetworkShooterHitscanQueue.h"
+#include "NetworkShooterLagCompensation.h"
+#include "NetworkShooterLoadTest.h"
+#include "NetworkShooterPawnPool.h"
+#include "NetworkShooterPushModelBench.h"
+#include "NetworkShooterShotTrace.h"
+#include "NetworkShooterSpawnQueue.h"
+#include "NetworkShooterSpawnSelector.h"
 #include "NetworkShooterGameMode.generated.h"
 
 class ANetworkShooterCharacter;
+class ANetworkShooterPlayerState;
 class ANetworkShooterSpawnPoint;
 
 UENUM(BlueprintType)
@@ -27,11 +39,41 @@ public:
 	virtual void BeginPlay() override;
 	virtual void Tick(float DeltaSeconds) override;
 	virtual void PostLogin(APlayerController* NewPlayer) override;
+	virtual void Logout(AController* Exiting) override;
+	virtual void HandleStartingNewPlayer_Implementation(APlayerController* NewPlayer) override;
+	virtual bool PlayerCanRestart_Implementation(APlayerController* Player) override;
+	virtual void GetSeamlessTravelActorList(bool bToTransition, TArray<AActor*>& ActorList) override;
+	virtual void PostSeamlessTravel() override;
+	virtual void HandleSeamlessTravelPlayer(AController*& C) override;
 	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	void Respawn(ANetworkShooterCharacter* Character);
 	void Spawn(ANetworkShooterCharacter* Character);
 
+	// Spawns a server side bot on the smaller team, see ns.Bots.Add
+	ANetworkShooterCharacter* AddBot();
+
+	// Joins NumPlayers bots in one frame the way a map change brings players back, and removes them once admitted. See ns.Login.JoinStorm
+	void SimulateJoinStorm(int32 NumPlayers);
+
+	FNetworkShooterLagCompensation& GetLagCompensation() { return LagCompensation; }
+	FNetworkShooterHitscanQueue& GetHitscanQueue() { return HitscanQueue; }
+	FNetworkShooterFireEffectQueue& GetFireEffects() { return FireEffects; }
+	FNetworkShooterPawnPool& GetPawnPool() { return PawnPool; }
+	FNetworkShooterSpawnQueue& GetSpawnQueue() { return SpawnQueue; }
+	FNetworkShooterLoadTest& GetLoadTest() { return LoadTest; }
+	FNetworkShooterPushModelBench& GetPushModelBench() { return PushModelBench; }
+	FNetworkShooterFireLatency& GetFireLatency() { return FireLatency; }
+	FNetworkShooterAdmissionQueue& GetAdmissions() { return Admissions; }
+
+	// Characters alive and out of the pool, gathered once a frame by whoever asks first. Some may
+	// have died since, callers check IsDead
+	const TArray<ANetworkShooterCharacter*>& GetLivingCharacters();
+
+#if NS_WITH_SHOT_TRACE
+	FNetworkShooterShotTrace& GetShotTrace() { return ShotTrace; }
+#endif
+
 private:
 	TArray<ANetworkShooterCharacter*> RedTeam;
 	TArray<ANetworkShooterCharacter*> BlueTeam;
@@ -39,10 +81,97 @@ private:
 	TArray<ANetworkShooterSpawnPoint*> RedSpawns;
 	TArray<ANetworkShooterSpawnPoint*> BlueSpawns;
 
-	TArray<ANetworkShooterCharacter*> ToBeSpawned;
+	// Puts a new player on the smaller team
+	void AssignTeam(ANetworkShooterCharacter* Character, ANetworkShooterPlayerState* PlayerState);
+
+	// The smaller team, counting players still waiting for admission
+	ETeam ChooseTeam() const;
+
+	void JoinTeam(ANetworkShooterCharacter* Character, ETeam Team);
+
+	// Picks the team of a player that has logged in, unless it brought one over travel, and queues it for a pawn
+	void EnqueueAdmission(AController* Controller);
+
+	// Queues a player that just logged in unless it is local or ns.Login.Queue is off, false if it should get its pawn now
+	bool QueueNewPlayer(AController* NewPlayer);
+
+	// Gives a player whose turn has come its pawn and spawns it for its team
+	void AdmitPlayer(AController* Controller);
+
+	// Logged in players waiting for a pawn, a few are admitted every frame
+	FNetworkShooterAdmissionQueue Admissions;
+
+	// Teams of the players still loading this map after seamless travel by PlayerId, so team balance counts them
+	TMap<int32, ETeam> TravelRoster;
+
+	// Players that came along on seamless travel, logs how long they took to spawn once they all have
+	void UpdateTravelTiming();
+	int32 NumTravelers;
+	double MapLoadedTime;
+
+	// When the travel here started, from the ?TravelStart= option the R key travel adds to the URL
+	double TravelStartTime;
+
+	// Places Character on the best free spawn point of its team, false if they are all blocked
+	bool TrySpawn(ANetworkShooterCharacter* Character);
+
+	void OnSpawnPointFreed(ANetworkShooterSpawnPoint* SpawnPoint);
+
+	// Characters waiting for a spawn point to free up
+	FNetworkShooterSpawnQueue SpawnQueue;
+
+	// Feeds the spawn selector the living characters, where they were when the frame's first spawn asked
+	void UpdateSpawnSelectorCharacters();
+	uint64 SelectorFrame;
+
+	// See GetLivingCharacters, shared by the spawn selector and every bot's target search
+	TArray<ANetworkShooterCharacter*> LivingCharacters;
+	uint64 LivingFrame;
+
+	// Scores RedSpawns/BlueSpawns by where the living characters are
+	FNetworkShooterSpawnSelector SpawnSelector;
+	TArray<FVector> SelectorLocations;
+	TArray<ETeam> SelectorTeams;
+
+	// Hitbox history used to rewind characters for shots
+	FNetworkShooterLagCompensation LagCompensation;
+
+	// Shots received this frame, traced together in Tick
+	FNetworkShooterHitscanQueue HitscanQueue;
+
+	// Shots run this frame, multicast to clients together
+	FNetworkShooterFireEffectQueue FireEffects;
+	FNetworkShooterFireEffectBatch FireEffectBatch;
+
+	// Dead characters kept for reuse on respawn
+	FNetworkShooterPawnPool PawnPool;
+
+	// CSV metrics for load test runs, see ns.LoadTest.Start
+	FNetworkShooterLoadTest LoadTest;
+	int32 NumBots;
+
+	// Replication cost with push model on and off, see ns.Net.PushModelBench
+	FNetworkShooterPushModelBench PushModelBench;
+
+	// Bots of the running ns.Login.JoinStorm and the whole frames it has taken so far. Once none is
+	// waiting for admission any more the storm is logged and they leave again
+	void UpdateJoinStorm();
+	void RemoveBot(AController* Bot);
+	TArray<TWeakObjectPtr<AController>> JoinStormBots;
+	int32 JoinStormFrames;
+	double JoinStormMaxFrameSeconds;
+	double JoinStormStartTime;
+	uint64 JoinStormFrame;
+
+	// Delay between a client firing and the server running the shot, see ns.Fire.LatencyStats
+	FNetworkShooterFireLatency FireLatency;
+
+#if NS_WITH_SHOT_TRACE
+	// Recent server shots for debugging, see ns.ShotTrace
+	FNetworkShooterShotTrace ShotTrace;
+#endif
 
 	bool bGameStarted;
-	static bool bInGameMenu;
 };
 
 
@@ -2,28 +2,90 @@
 
 #include "NetworkShooterHUD.h"
 #include "Engine/Canvas.h"
+#include "Engine/Engine.h"
 #include "Engine/Texture2D.h"
 #include "TextureResource.h"
 #include "CanvasItem.h"
-#include "NetworkShooterCharacter.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterClientEvents.h"
+#include "NetworkShooterFrameBudget.h"
 #include "NetworkShooterGameMode.h"
 #include "NetworkShooterPlayerState.h"
 #include "NSGameState.h"
-#include "Kismet/GameplayStatics.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/LowLevelMemStats.h"
+#include "HAL/LowLevelMemTracker.h"
 #include "UObject/ConstructorHelpers.h"
 
+#if !UE_BUILD_SHIPPING && ENABLE_LOW_LEVEL_MEM_TRACKER
+
+// Memory the HUD's own code allocates, the first project tag. Canvas batching is the engine's, see DrawCanvasItem
+static const ELLMTag HUDLLMTag = (ELLMTag)((int32)ELLMTag::ProjectTagStart + 0);
+
+DECLARE_LLM_MEMORY_STAT(TEXT("NetworkShooter HUD"), STAT_NS_HUDLLM, STATGROUP_LLMFULL);
+DEFINE_STAT(STAT_NS_HUDLLM);
+
+#define NS_HUD_LLM_SCOPE() LLM_SCOPE(HUDLLMTag)
+
+#else
+
+#define NS_HUD_LLM_SCOPE()
+
+#endif
+
 ANetworkShooterHUD::ANetworkShooterHUD()
 {
 	// Set the crosshair texture
 	static ConstructorHelpers::FObjectFinder<UTexture2D> CrosshairTexObj(TEXT("/Game/FirstPerson/Textures/FirstPersonCrosshair"));
 	CrosshairTex = CrosshairTexObj.Object;
+
+	// Room for a full lobby plus the two team headers
+	ScoreboardLines.Reserve(66);
+	bScoreboardDirty = true;
+	ScoreboardClipY = -1.0f;
+	bStatusDirty = true;
+	bInMenu = false;
+
+	BlueTeamText = FText::FromString(TEXT("BLUE TEAM:"));
+	RedTeamText = FText::FromString(TEXT("RED TEAM:"));
+	StartGameText = FText::FromString(TEXT("Press R to start game"));
+	WaitingText = FText::FromString(TEXT("Waiting on Server!!"));
+
+#if !UE_BUILD_SHIPPING
+	AllocationTestFrames = 0;
+	AllocationTestFramesLeft = 0;
+	AllocationTestLastBytes = 0;
+	AllocationTestTotal = 0;
+	AllocationTestWorstFrame = 0;
+#endif
+
+#if !UE_BUILD_SHIPPING && ENABLE_LOW_LEVEL_MEM_TRACKER
+	static bool bRegisteredLLMTag = false;
+
+	if (!bRegisteredLLMTag)
+	{
+		FLowLevelMemTracker::Get().RegisterProjectTag((int32)HUDLLMTag, TEXT("NetworkShooterHUD"), GET_STATFNAME(STAT_NS_HUDLLM), NAME_None);
+		bRegisteredLLMTag = true;
+	}
+#endif
 }
 
 
 void ANetworkShooterHUD::DrawHUD()
 {
+	NS_SCOPE_CYCLE_COUNTER(DrawHUD);
+
 	Super::DrawHUD();
 
+#if !UE_BUILD_SHIPPING
+	if (AllocationTestFramesLeft > 0)
+	{
+		EndAllocationTestFrame();
+	}
+#endif
+
+	NS_HUD_LLM_SCOPE();
+
 	// Draw very simple crosshair
 
 	// find center of the Canvas
@@ -36,73 +98,262 @@ void ANetworkShooterHUD::DrawHUD()
 	// draw the crosshair
 	FCanvasTileItem TileItem( CrosshairDrawPosition, CrosshairTex->Resource, FLinearColor::White);
 	TileItem.BlendMode = SE_BLEND_Translucent;
-	Canvas->DrawItem( TileItem );
-
-	ANSGameState* thisGameState{ Cast<ANSGameState>(GetWorld()->GetGameState()) };
-	
-	if (thisGameState != nullptr && thisGameState->bInMenu)
-	{
-		int BlueScreenPos = 50;
-		int RedScreenPos = Center.Y + 50;
-		int nameSpacing = 25;
-		int NumBlueteam = 1;
-		int NumRedteam = 1;
+	DrawCanvasItem( TileItem );
 
-		FString thisString = "BLUE TEAM:";
-		DrawText(thisString, FColor::Cyan, 50, BlueScreenPos);
+	ANSGameState* thisGameState = BoundGameState.Get();
 
-		thisString = "RED TEAM:";
-		DrawText(thisString, FColor::Red, 50, RedScreenPos);
+	if (thisGameState == nullptr)
+	{
+		thisGameState = GetWorld()->GetGameState<ANSGameState>();
 
-		for (auto player : thisGameState->PlayerArray)
+		if (thisGameState != nullptr)
 		{
-			ANetworkShooterPlayerState* thisPS{ Cast<ANetworkShooterPlayerState>(player) };
-
-			if (thisPS)
-			{
-				if (thisPS->Team == ETeam::BLUE_TEAM)
-				{
-					thisString = thisPS->GetPlayerName();
-
-					DrawText(thisString, FColor::Cyan, 50, BlueScreenPos + nameSpacing * NumBlueteam);
-
-					NumBlueteam++;
-				}
-				else
-				{
-					thisString = thisPS->GetPlayerName();
+			BindClientEvents(thisGameState);
+		}
+	}
 
-					DrawText(thisString, FColor::Red, 50, RedScreenPos + nameSpacing * NumRedteam);
+	if (thisGameState != nullptr && bInMenu)
+	{
+		UpdateScoreboard(thisGameState);
 
-					NumRedteam++;
-				}
-			}
+		for (const FScoreboardLine& Line : ScoreboardLines)
+		{
+			DrawCachedText(Line.Text, Line.Color, 50, Line.Y);
 		}
 
 		if (GetWorld()->GetAuthGameMode())
 		{
-			thisString = "Press R to start game";
-			DrawText(thisString, FColor::Yellow, Center.X, Center.Y);
+			DrawCachedText(StartGameText, FColor::Yellow, Center.X, Center.Y);
 		}
 		else
 		{
-			thisString = "Waiting on Server!!";
-			DrawText(thisString, FColor::Yellow, Center.X, Center.Y);
+			DrawCachedText(WaitingText, FColor::Yellow, Center.X, Center.Y);
 		}
 	}
 	else
 	{
-		ANetworkShooterCharacter* ThisChar = Cast<ANetworkShooterCharacter>(UGameplayStatics::GetPlayerPawn(GetWorld(), 0));
+		// Only cast again when the owner's player state is swapped, e.g. after seamless travel
+		APlayerState* OwnerPS = PlayerOwner ? PlayerOwner->PlayerState : nullptr;
+
+		if (OwnerPS != StatusPlayerState.Get())
+		{
+			StatusPlayerState = Cast<ANetworkShooterPlayerState>(OwnerPS);
+			bStatusDirty = true;
+		}
+
+		if (ANetworkShooterPlayerState* thisPS = StatusPlayerState.Get())
+		{
+			UpdateStatus(thisPS);
+
+			DrawCachedText(StatusText, FColor::Yellow, 50, 50);
+		}
+	}
+}
+
+void ANetworkShooterHUD::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	UnbindClientEvents();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ANetworkShooterHUD::BindClientEvents(ANSGameState* GameState)
+{
+	UnbindClientEvents();
+
+	FNetworkShooterClientEvents& Events = GameState->GetClientEvents();
+
+	PlayerStatsChangedHandle = Events.OnPlayerStatsChanged.AddUObject(this, &ANetworkShooterHUD::OnPlayerStatsChanged);
+	ScoreboardChangedHandle = Events.OnScoreboardChanged.AddUObject(this, &ANetworkShooterHUD::OnScoreboardChanged);
+	MenuChangedHandle = Events.OnMenuChanged.AddUObject(this, &ANetworkShooterHUD::OnMenuChanged);
+
+	BoundGameState = GameState;
+
+	// Anything that replicated before now was missed
+	bInMenu = GameState->bInMenu;
+	bScoreboardDirty = true;
+	bStatusDirty = true;
+}
+
+void ANetworkShooterHUD::UnbindClientEvents()
+{
+	if (ANSGameState* thisGameState = BoundGameState.Get())
+	{
+		FNetworkShooterClientEvents& Events = thisGameState->GetClientEvents();
+
+		Events.OnPlayerStatsChanged.Remove(PlayerStatsChangedHandle);
+		Events.OnScoreboardChanged.Remove(ScoreboardChangedHandle);
+		Events.OnMenuChanged.Remove(MenuChangedHandle);
+	}
+
+	BoundGameState.Reset();
+}
+
+void ANetworkShooterHUD::OnPlayerStatsChanged(ANetworkShooterPlayerState* PlayerState)
+{
+	if (PlayerState == StatusPlayerState.Get())
+	{
+		bStatusDirty = true;
+	}
+}
+
+void ANetworkShooterHUD::OnScoreboardChanged()
+{
+	bScoreboardDirty = true;
+}
+
+void ANetworkShooterHUD::OnMenuChanged(bool bNewInMenu)
+{
+	bInMenu = bNewInMenu;
+}
+
+void ANetworkShooterHUD::DrawCachedText(const FText& Text, const FLinearColor& Color, float ScreenX, float ScreenY)
+{
+	FCanvasTextItem TextItem(FVector2D(FMath::FloorToFloat(ScreenX), FMath::FloorToFloat(ScreenY)), Text, GEngine->GetMediumFont(), Color);
+
+	DrawCanvasItem(TextItem);
+}
+
+void ANetworkShooterHUD::DrawCanvasItem(FCanvasItem& Item)
+{
+	// Whatever the canvas allocates to batch the draw is the engine's, not the HUD's
+	LLM_SCOPE(ELLMTag::UI);
+
+	Canvas->DrawItem(Item);
+}
+
+void ANetworkShooterHUD::UpdateScoreboard(ANSGameState* GameState)
+{
+	if (!bScoreboardDirty && Canvas->ClipY == ScoreboardClipY)
+	{
+		return;
+	}
+
+	bScoreboardDirty = false;
+	ScoreboardClipY = Canvas->ClipY;
+
+	const float BlueScreenPos = 50;
+	const float RedScreenPos = Canvas->ClipY * 0.5f + 50;
+	const float nameSpacing = 25;
+	int NumBlueteam = 1;
+	int NumRedteam = 1;
 
-		if (ThisChar != nullptr)
+	ScoreboardLines.Reset();
+	ScoreboardLines.Add({ BlueTeamText, FColor::Cyan, BlueScreenPos });
+	ScoreboardLines.Add({ RedTeamText, FColor::Red, RedScreenPos });
+
+	for (APlayerState* player : GameState->PlayerArray)
+	{
+		ANetworkShooterPlayerState* thisPS{ Cast<ANetworkShooterPlayerState>(player) };
+
+		if (thisPS)
 		{
-			if (ThisChar->GetNetworkShooterPlayerState())
+			if (thisPS->Team == ETeam::BLUE_TEAM)
+			{
+				ScoreboardLines.Add({ FText::FromString(thisPS->GetPlayerName()), FColor::Cyan, BlueScreenPos + nameSpacing * NumBlueteam });
+
+				NumBlueteam++;
+			}
+			else
 			{
-				FString HUDString = FString::Printf(TEXT("Health: %f, Score: %d, Deaths: %d"), ThisChar->GetNetworkShooterPlayerState()->Health,
-					ThisChar->GetNetworkShooterPlayerState()->GetScore(), ThisChar->GetNetworkShooterPlayerState()->Deaths);
+				ScoreboardLines.Add({ FText::FromString(thisPS->GetPlayerName()), FColor::Red, RedScreenPos + nameSpacing * NumRedteam });
 
-				DrawText(HUDString, FColor::Yellow, 50, 50);
+				NumRedteam++;
 			}
 		}
 	}
 }
+
+void ANetworkShooterHUD::UpdateStatus(ANetworkShooterPlayerState* PlayerState)
+{
+	if (!bStatusDirty)
+	{
+		return;
+	}
+
+	bStatusDirty = false;
+
+	StatusText = FText::FromString(FString::Printf(TEXT("Health: %f, Score: %d, Deaths: %d"), PlayerState->Health,
+		FMath::RoundToInt(PlayerState->GetScore()), PlayerState->Deaths));
+}
+
+#if !UE_BUILD_SHIPPING
+
+void ANetworkShooterHUD::StartAllocationTest(int32 NumFrames)
+{
+	AllocationTestFrames = FMath::Max(NumFrames, 1);
+	AllocationTestFramesLeft = AllocationTestFrames + 1;
+	AllocationTestLastBytes = GetAllocatedBytes();
+	AllocationTestTotal = 0;
+	AllocationTestWorstFrame = 0;
+}
+
+int64 ANetworkShooterHUD::GetAllocatedBytes()
+{
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	return FLowLevelMemTracker::Get().GetTagAmountForTracker(ELLMTracker::Default, HUDLLMTag);
+#else
+	return 0;
+#endif
+}
+
+void ANetworkShooterHUD::EndAllocationTestFrame()
+{
+	// LLM folds its counts together once a frame, so this is what the HUD kept from the last one
+	const int64 Bytes = GetAllocatedBytes();
+
+	// The first frame of a test only warms the caches
+	if (AllocationTestFramesLeft <= AllocationTestFrames)
+	{
+		const int64 Growth = FMath::Max<int64>(Bytes - AllocationTestLastBytes, 0);
+
+		AllocationTestTotal += Growth;
+		AllocationTestWorstFrame = FMath::Max(AllocationTestWorstFrame, Growth);
+	}
+
+	AllocationTestLastBytes = Bytes;
+
+	if (--AllocationTestFramesLeft > 0)
+	{
+		return;
+	}
+
+	if (AllocationTestTotal == 0)
+	{
+		UE_LOG(LogNetworkShooter, Display, TEXT("HUD allocation test passed: HUD memory didn't grow over %d frames"), AllocationTestFrames);
+	}
+	else
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("HUD allocation test failed: HUD memory grew %lld bytes over %d frames, %lld in the worst frame"),
+			AllocationTestTotal, AllocationTestFrames, AllocationTestWorstFrame);
+	}
+}
+
+static void RunHUDAllocationTest(const TArray<FString>& Args, UWorld* World)
+{
+	APlayerController* thisPC = World ? World->GetFirstPlayerController() : nullptr;
+	ANetworkShooterHUD* thisHUD = thisPC ? Cast<ANetworkShooterHUD>(thisPC->GetHUD()) : nullptr;
+
+	if (thisHUD == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("ns.HUD.AllocTest needs a local player with the game HUD"));
+		return;
+	}
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	if (!FLowLevelMemTracker::IsEnabled())
+#endif
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("ns.HUD.AllocTest needs the low level memory tracker, run with -llm"));
+		return;
+	}
+
+	thisHUD->StartAllocationTest(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 300);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs HUDAllocationTestCommand(
+	TEXT("ns.HUD.AllocTest"),
+	TEXT("Fails if the memory the HUD's own code holds grows in any of the next frames, canvas batching excluded. Needs -llm. Usage: ns.HUD.AllocTest [Frames=300]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunHUDAllocationTest));
+
+#endif // !UE_BUILD_SHIPPING
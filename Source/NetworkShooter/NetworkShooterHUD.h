@@ -17,9 +17,74 @@ public:
 	/** Primary draw call for the HUD */
 	virtual void DrawHUD() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+#if !UE_BUILD_SHIPPING
+	/** Watches the low level memory tracker's HUD tag for NumFrames frames, see ns.HUD.AllocTest */
+	void StartAllocationTest(int32 NumFrames);
+#endif
+
 private:
 	/** Crosshair asset pointer */
 	class UTexture2D* CrosshairTex;
 
+	/** Like DrawText, minus the FText it builds from an FString on every call */
+	void DrawCachedText(const FText& Text, const FLinearColor& Color, float ScreenX, float ScreenY);
+	void DrawCanvasItem(class FCanvasItem& Item);
+
+	/** Subscribes to the game state's client events once it has replicated, and reads the current state */
+	void BindClientEvents(class ANSGameState* GameState);
+	void UnbindClientEvents();
+
+	void OnPlayerStatsChanged(class ANetworkShooterPlayerState* PlayerState);
+	void OnScoreboardChanged();
+	void OnMenuChanged(bool bNewInMenu);
+
+	/** Rebuilds the scoreboard lines if a player changed or the canvas was resized */
+	void UpdateScoreboard(class ANSGameState* GameState);
+
+	/** Reformats the health/score/deaths line if the local player's stats changed */
+	void UpdateStatus(class ANetworkShooterPlayerState* PlayerState);
+
+	TWeakObjectPtr<class ANSGameState> BoundGameState;
+	FDelegateHandle PlayerStatsChangedHandle;
+	FDelegateHandle ScoreboardChangedHandle;
+	FDelegateHandle MenuChangedHandle;
+
+	bool bInMenu;
+
+	struct FScoreboardLine
+	{
+		FText Text;
+		FLinearColor Color;
+		float Y;
+	};
+
+	/** Team headers and player names, laid out once per scoreboard change */
+	TArray<FScoreboardLine> ScoreboardLines;
+	bool bScoreboardDirty;
+	float ScoreboardClipY;
+
+	FText StatusText;
+	TWeakObjectPtr<class ANetworkShooterPlayerState> StatusPlayerState;
+	bool bStatusDirty;
+
+	FText BlueTeamText;
+	FText RedTeamText;
+	FText StartGameText;
+	FText WaitingText;
+
+#if !UE_BUILD_SHIPPING
+	/** Bytes the low level memory tracker has under the HUD's tag, 0 without it */
+	static int64 GetAllocatedBytes();
+
+	void EndAllocationTestFrame();
+
+	int32 AllocationTestFrames;
+	int32 AllocationTestFramesLeft;
+	int64 AllocationTestLastBytes;
+	int64 AllocationTestTotal;
+	int64 AllocationTestWorstFrame;
+#endif
 };
 
@@ -0,0 +1,344 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterHitscanBroadphase.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterGameMode.h"
+#include "Components/CapsuleComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+FNetworkShooterHitscanBroadphase::FNetworkShooterHitscanBroadphase()
+	: Count(0)
+{
+	// Enough for a full server so building never allocates mid match
+	CenterX.Reserve(64);
+	CenterY.Reserve(64);
+	CenterZ.Reserve(64);
+	Radius.Reserve(64);
+	SegmentHalfHeight.Reserve(64);
+	Characters.Reserve(64);
+}
+
+void FNetworkShooterHitscanBroadphase::Reset()
+{
+	CenterX.Reset();
+	CenterY.Reset();
+	CenterZ.Reset();
+	Radius.Reset();
+	SegmentHalfHeight.Reset();
+	Characters.Reset();
+	Count = 0;
+}
+
+void FNetworkShooterHitscanBroadphase::Add(ANetworkShooterCharacter* Character, const FVector& Location, float InRadius, float HalfHeight)
+{
+	// Fill the padding lane left by the last Add, or start a new group of four
+	if (Count == CenterX.Num())
+	{
+		CenterX.AddZeroed(4);
+		CenterY.AddZeroed(4);
+		CenterZ.AddZeroed(4);
+		Radius.AddZeroed(4);
+		SegmentHalfHeight.AddZeroed(4);
+	}
+
+	CenterX[Count] = Location.X;
+	CenterY[Count] = Location.Y;
+	CenterZ[Count] = Location.Z;
+	Radius[Count] = InRadius;
+	SegmentHalfHeight[Count] = FMath::Max(HalfHeight - InRadius, 0.0f);
+	Characters.Add(Character);
+
+	Count++;
+}
+
+SIZE_T FNetworkShooterHitscanBroadphase::GetAllocatedSize() const
+{
+	return CenterX.GetAllocatedSize() + CenterY.GetAllocatedSize() + CenterZ.GetAllocatedSize() + Radius.GetAllocatedSize() +
+		SegmentHalfHeight.GetAllocatedSize() + Characters.GetAllocatedSize();
+}
+
+// Square root of lanes already known to be positive where it matters, clamped so the rest stay finite
+static FORCEINLINE VectorRegister SqrtClamped(const VectorRegister& Value)
+{
+	const VectorRegister Safe = VectorMax(Value, VectorSetFloat1(SMALL_NUMBER));
+
+	return VectorMultiply(Safe, VectorReciprocalSqrtAccurate(Safe));
+}
+
+// Entry distance of a unit ray into spheres offset OffsetZ from the lane centers, Miss where it doesn't
+static FORCEINLINE VectorRegister RaySpheres(const VectorRegister& PlanarB, const VectorRegister& PlanarC, const VectorRegister& OffsetZ,
+	const VectorRegister& DirZ, const VectorRegister& RadiusSq, const VectorRegister& Miss)
+{
+	const VectorRegister Zero = VectorZero();
+	const VectorRegister B = VectorMultiplyAdd(OffsetZ, DirZ, PlanarB);
+	const VectorRegister C = VectorSubtract(VectorMultiplyAdd(OffsetZ, OffsetZ, PlanarC), RadiusSq);
+	const VectorRegister Disc = VectorSubtract(VectorMultiply(B, B), C);
+	const VectorRegister Root = SqrtClamped(Disc);
+
+	const VectorRegister Enter = VectorMax(VectorSubtract(VectorNegate(B), Root), Zero);
+	const VectorRegister Exit = VectorSubtract(Root, B);
+	const VectorRegister Valid = VectorBitwiseAnd(VectorCompareGE(Disc, Zero), VectorCompareGE(Exit, Zero));
+
+	return VectorSelect(Valid, Enter, Miss);
+}
+
+int32 FNetworkShooterHitscanBroadphase::Raycast(const FVector& Start, const FVector& End, const AActor* Ignore, float& OutDistance) const
+{
+	const FVector Delta = End - Start;
+	const float Length = Delta.Size();
+
+	if (Count == 0 || Length < KINDA_SMALL_NUMBER)
+	{
+		return INDEX_NONE;
+	}
+
+	const FVector Dir = Delta / Length;
+	const float PlanarSq = Dir.X * Dir.X + Dir.Y * Dir.Y;
+
+	const VectorRegister Zero = VectorZero();
+	const VectorRegister Miss = VectorSetFloat1(BIG_NUMBER);
+	const VectorRegister StartX = VectorSetFloat1(Start.X);
+	const VectorRegister StartY = VectorSetFloat1(Start.Y);
+	const VectorRegister StartZ = VectorSetFloat1(Start.Z);
+	const VectorRegister DirX = VectorSetFloat1(Dir.X);
+	const VectorRegister DirY = VectorSetFloat1(Dir.Y);
+	const VectorRegister DirZ = VectorSetFloat1(Dir.Z);
+
+	// A straight up or down ray can only enter through the hemispheres
+	const VectorRegister A = VectorSetFloat1(PlanarSq);
+	const VectorRegister InvA = VectorSetFloat1(PlanarSq > KINDA_SMALL_NUMBER ? 1.0f / PlanarSq : 0.0f);
+	const VectorRegister HasSide = VectorCompareGT(A, VectorSetFloat1(KINDA_SMALL_NUMBER));
+
+	MS_ALIGN(16) float Lanes[4] GCC_ALIGN(16);
+
+	int32 Best = INDEX_NONE;
+	float BestDistance = Length;
+
+	for (int32 i = 0; i < Count; i += 4)
+	{
+		const VectorRegister OX = VectorSubtract(StartX, VectorLoadAligned(&CenterX[i]));
+		const VectorRegister OY = VectorSubtract(StartY, VectorLoadAligned(&CenterY[i]));
+		const VectorRegister OZ = VectorSubtract(StartZ, VectorLoadAligned(&CenterZ[i]));
+		const VectorRegister R = VectorLoadAligned(&Radius[i]);
+		const VectorRegister H = VectorLoadAligned(&SegmentHalfHeight[i]);
+		const VectorRegister RadiusSq = VectorMultiply(R, R);
+
+		// Side of the capsule, an infinite cylinder solved in the plane and cut to the straight part
+		const VectorRegister PlanarB = VectorMultiplyAdd(OX, DirX, VectorMultiply(OY, DirY));
+		const VectorRegister PlanarC = VectorMultiplyAdd(OX, OX, VectorMultiply(OY, OY));
+		const VectorRegister C = VectorSubtract(PlanarC, RadiusSq);
+		const VectorRegister Disc = VectorSubtract(VectorMultiply(PlanarB, PlanarB), VectorMultiply(A, C));
+		const VectorRegister Root = SqrtClamped(Disc);
+
+		const VectorRegister Enter = VectorMax(VectorMultiply(VectorSubtract(VectorNegate(PlanarB), Root), InvA), Zero);
+		const VectorRegister Exit = VectorMultiply(VectorSubtract(Root, PlanarB), InvA);
+		const VectorRegister EnterZ = VectorAbs(VectorMultiplyAdd(Enter, DirZ, OZ));
+
+		VectorRegister Valid = VectorBitwiseAnd(HasSide, VectorCompareGE(Disc, Zero));
+		Valid = VectorBitwiseAnd(Valid, VectorCompareGE(Exit, Zero));
+		Valid = VectorBitwiseAnd(Valid, VectorCompareLE(EnterZ, H));
+
+		VectorRegister Distance = VectorSelect(Valid, Enter, Miss);
+
+		// Hemispheres at either end, a capsule is entered wherever the first of the three is
+		Distance = VectorMin(Distance, RaySpheres(PlanarB, PlanarC, VectorSubtract(OZ, H), DirZ, RadiusSq, Miss));
+		Distance = VectorMin(Distance, RaySpheres(PlanarB, PlanarC, VectorAdd(OZ, H), DirZ, RadiusSq, Miss));
+
+		VectorStoreAligned(Distance, Lanes);
+
+		const int32 NumLanes = FMath::Min(Count - i, 4);
+
+		for (int32 Lane = 0; Lane < NumLanes; Lane++)
+		{
+			if (Lanes[Lane] <= BestDistance && (Ignore == nullptr || Characters[i + Lane] != Ignore))
+			{
+				Best = i + Lane;
+				BestDistance = Lanes[Lane];
+			}
+		}
+	}
+
+	OutDistance = BestDistance;
+
+	return Best;
+}
+
+void FNetworkShooterHitscanBroadphase::MakeHit(int32 Index, const FVector& Start, const FVector& End, float Distance, FHitResult& OutHit) const
+{
+	const FVector Dir = (End - Start).GetSafeNormal();
+	const FVector Location = Start + Dir * Distance;
+	const FVector Center(CenterX[Index], CenterY[Index], CenterZ[Index]);
+
+	// Normal points away from the closest point on the capsule's axis
+	const float AxisZ = FMath::Clamp(Location.Z - Center.Z, -SegmentHalfHeight[Index], SegmentHalfHeight[Index]);
+	const FVector Normal = (Location - (Center + FVector(0.0f, 0.0f, AxisZ))).GetSafeNormal();
+
+	ANetworkShooterCharacter* Character = Characters[Index];
+
+	OutHit = FHitResult(Character, Character ? Character->GetCapsuleComponent() : nullptr, Location, Normal);
+	OutHit.bBlockingHit = true;
+	OutHit.TraceStart = Start;
+	OutHit.TraceEnd = End;
+	OutHit.Distance = Distance;
+	OutHit.Time = Distance / FMath::Max((End - Start).Size(), KINDA_SMALL_NUMBER);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Benchmark
+
+// One capsule at a time with the engine's segment distance, what the SIMD path has to agree with
+static bool RaycastReference(const FVector& Start, const FVector& End, const TArray<FVector>& Centers, float CapsuleRadius, float SegmentHalfHeight)
+{
+	FVector OnRay;
+	FVector OnAxis;
+
+	for (const FVector& Center : Centers)
+	{
+		FMath::SegmentDistToSegmentSafe(Start, End, Center - FVector(0.0f, 0.0f, SegmentHalfHeight), Center + FVector(0.0f, 0.0f, SegmentHalfHeight), OnRay, OnAxis);
+
+		if (FVector::DistSquared(OnRay, OnAxis) <= FMath::Square(CapsuleRadius))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void RunBroadphaseBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 NumPlayers = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 64;
+	const int32 NumRays = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 100000;
+	const float CapsuleRadius = 55.0f;
+	const float CapsuleHalfHeight = 96.0f;
+
+	FRandomStream Random(1337);
+
+	// Synthetic players on a 10000 unit square, rays from one player toward another with some spread
+	FNetworkShooterHitscanBroadphase Broadphase;
+	TArray<FVector> Centers;
+
+	for (int32 i = 0; i < NumPlayers; i++)
+	{
+		const FVector Center(Random.FRandRange(-5000.0f, 5000.0f), Random.FRandRange(-5000.0f, 5000.0f), 100.0f);
+
+		Broadphase.Add(nullptr, Center, CapsuleRadius, CapsuleHalfHeight);
+		Centers.Add(Center);
+	}
+
+	TArray<FVector> Starts;
+	TArray<FVector> Ends;
+
+	for (int32 i = 0; i < NumRays; i++)
+	{
+		const FVector Start = Centers[Random.RandRange(0, NumPlayers - 1)] + FVector(0.0f, 0.0f, 60.0f);
+		const FVector Aim = Centers[Random.RandRange(0, NumPlayers - 1)] + Random.GetUnitVector() * 150.0f;
+
+		Starts.Add(Start);
+		Ends.Add(Start + (Aim - Start).GetSafeNormal() * 10000000.0f);
+	}
+
+	// Rays start inside their shooter, push them out past it so both paths skip it the same way
+	for (int32 i = 0; i < NumRays; i++)
+	{
+		Starts[i] += (Ends[i] - Starts[i]).GetSafeNormal() * (CapsuleRadius * 2.0f + 1.0f);
+	}
+
+	float Distance = 0.0f;
+	int32 BroadphaseHits = 0;
+
+	const double BroadphaseStart = FPlatformTime::Seconds();
+
+	for (int32 i = 0; i < NumRays; i++)
+	{
+		BroadphaseHits += Broadphase.Raycast(Starts[i], Ends[i], nullptr, Distance) != INDEX_NONE ? 1 : 0;
+	}
+
+	const double BroadphaseElapsed = FPlatformTime::Seconds() - BroadphaseStart;
+
+	int32 ReferenceHits = 0;
+	int32 Mismatches = 0;
+
+	const double ReferenceStart = FPlatformTime::Seconds();
+
+	for (int32 i = 0; i < NumRays; i++)
+	{
+		ReferenceHits += RaycastReference(Starts[i], Ends[i], Centers, CapsuleRadius, CapsuleHalfHeight - CapsuleRadius) ? 1 : 0;
+	}
+
+	const double ReferenceElapsed = FPlatformTime::Seconds() - ReferenceStart;
+
+	for (int32 i = 0; i < NumRays; i++)
+	{
+		const bool bBroadphaseHit = Broadphase.Raycast(Starts[i], Ends[i], nullptr, Distance) != INDEX_NONE;
+
+		if (bBroadphaseHit != RaycastReference(Starts[i], Ends[i], Centers, CapsuleRadius, CapsuleHalfHeight - CapsuleRadius))
+		{
+			Mismatches++;
+		}
+	}
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Broadphase synthetic: %d players, %d rays, %d hits"), NumPlayers, NumRays, BroadphaseHits);
+	UE_LOG(LogNetworkShooter, Display, TEXT("  SIMD capsules   %12.0f rays/s"), NumRays / FMath::Max(BroadphaseElapsed, 1e-9));
+	UE_LOG(LogNetworkShooter, Display, TEXT("  scalar capsules %12.0f rays/s, %d hits, %d disagree"), NumRays / FMath::Max(ReferenceElapsed, 1e-9), ReferenceHits, Mismatches);
+
+	// Against the running server: the physics trace shots used to take versus the capsules built from its history
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode == nullptr)
+	{
+		return;
+	}
+
+	GameMode->GetLagCompensation().BuildBroadphase(GameMode->GetLagCompensation().GetLatestTime(), Broadphase);
+
+	// Characters and walls in one query, the same work a shot does without the broadphase
+	const FCollisionObjectQueryParams ObjQuery = FNetworkShooterHitscanQueue::GetShotObjectParams();
+	FCollisionQueryParams ColQuery;
+	FHitResult HitRes;
+
+	int32 PhysicsHits = 0;
+	const double PhysicsStart = FPlatformTime::Seconds();
+
+	for (int32 i = 0; i < NumRays; i++)
+	{
+		const bool bHit = World->LineTraceSingleByObjectType(HitRes, Starts[i], Ends[i], ObjQuery, ColQuery);
+
+		// Walls stop rays here too, only the characters hit count
+		PhysicsHits += bHit && Cast<ANetworkShooterCharacter>(HitRes.GetActor()) != nullptr ? 1 : 0;
+	}
+
+	const double PhysicsElapsed = FPlatformTime::Seconds() - PhysicsStart;
+
+	int32 LiveHits = 0;
+	int32 Occlusions = 0;
+	const double LiveStart = FPlatformTime::Seconds();
+
+	for (int32 i = 0; i < NumRays; i++)
+	{
+		const int32 Index = Broadphase.Raycast(Starts[i], Ends[i], nullptr, Distance);
+
+		if (Index != INDEX_NONE)
+		{
+			LiveHits++;
+
+			// Same wall check the hitscan queue does for every capsule hit
+			const FVector HitLocation = Starts[i] + (Ends[i] - Starts[i]).GetSafeNormal() * Distance;
+			Occlusions += World->LineTraceTestByObjectType(Starts[i], HitLocation, FCollisionObjectQueryParams(FCollisionObjectQueryParams::AllStaticObjects), ColQuery) ? 1 : 0;
+		}
+	}
+
+	const double LiveElapsed = FPlatformTime::Seconds() - LiveStart;
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Broadphase live world: %d characters, %d rays"), Broadphase.Num(), NumRays);
+	UE_LOG(LogNetworkShooter, Display, TEXT("  physics trace   %12.0f rays/s, %d characters hit"), NumRays / FMath::Max(PhysicsElapsed, 1e-9), PhysicsHits);
+	UE_LOG(LogNetworkShooter, Display, TEXT("  capsules + wall %12.0f rays/s, %d hits, %d behind walls"), NumRays / FMath::Max(LiveElapsed, 1e-9), LiveHits, Occlusions);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BroadphaseBenchmarkCommand(
+	TEXT("ns.Hitscan.BroadphaseBench"),
+	TEXT("Rays per second of the capsule broadphase against a scalar test and, on a server, the physics trace. Usage: ns.Hitscan.BroadphaseBench [NumPlayers=64] [NumRays=100000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunBroadphaseBenchmark));
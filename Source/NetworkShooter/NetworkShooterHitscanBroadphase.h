@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+
+class AActor;
+class ANetworkShooterCharacter;
+
+/**
+ * Character capsules for hitscan, rebuilt for every batch of shots from the lag compensation
+ * history so nobody has to be moved to trace against where they were. Capsules are kept as a
+ * structure of arrays and tested four at a time. Characters only ever yaw, so every capsule is
+ * upright and its side reduces to a 2D circle test.
+ */
+class NETWORKSHOOTER_API FNetworkShooterHitscanBroadphase
+{
+public:
+	FNetworkShooterHitscanBroadphase();
+
+	void Reset();
+
+	// Character may be null for synthetic capsules
+	void Add(ANetworkShooterCharacter* Character, const FVector& Location, float Radius, float HalfHeight);
+
+	// Nearest capsule along Start->End that isn't Ignore's, INDEX_NONE if the ray misses them all
+	int32 Raycast(const FVector& Start, const FVector& End, const AActor* Ignore, float& OutDistance) const;
+
+	// Blocking hit on capsule Index, Distance along Start->End
+	void MakeHit(int32 Index, const FVector& Start, const FVector& End, float Distance, FHitResult& OutHit) const;
+
+	int32 Num() const { return Count; }
+
+	ANetworkShooterCharacter* GetCharacter(int32 Index) const { return Characters[Index]; }
+
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	// Padded to a multiple of four, lanes past Count are never reported
+	TArray<float, TAlignedHeapAllocator<16>> CenterX;
+	TArray<float, TAlignedHeapAllocator<16>> CenterY;
+	TArray<float, TAlignedHeapAllocator<16>> CenterZ;
+	TArray<float, TAlignedHeapAllocator<16>> Radius;
+
+	// Half height of the straight part between the two hemispheres
+	TArray<float, TAlignedHeapAllocator<16>> SegmentHalfHeight;
+
+	TArray<ANetworkShooterCharacter*> Characters;
+
+	int32 Count;
+};
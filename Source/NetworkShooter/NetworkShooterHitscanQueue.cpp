@@ -0,0 +1,298 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterHitscanQueue.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterGameMode.h"
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<float> CVarHitscanRewindBucket(
+	TEXT("ns.Hitscan.RewindBucket"),
+	0.016f,
+	TEXT("Shots whose rewind times fall within this many seconds share one rewind, 0 rewinds every distinct time separately."));
+
+static TAutoConsoleVariable<int32> CVarHitscanParallelMin(
+	TEXT("ns.Hitscan.ParallelMin"),
+	4,
+	TEXT("Shots sharing a rewind are traced in parallel once there are at least this many, 0 never does."));
+
+static TAutoConsoleVariable<int32> CVarHitscanBroadphase(
+	TEXT("ns.Hitscan.Broadphase"),
+	1,
+	TEXT("1 tests shots against rewound character capsules and only traces for walls on a hit, 0 moves characters and traces the physics scene."));
+
+FNetworkShooterHitscanQueue::FNetworkShooterHitscanQueue()
+	: TotalShots(0)
+	, TotalFrames(0)
+	, TotalGroups(0)
+	, MaxShotsPerFrame(0)
+	, TotalCapsuleHits(0)
+	, TotalOccluded(0)
+{
+	Shots.Reserve(64);
+}
+
+void FNetworkShooterHitscanQueue::Add(ANetworkShooterCharacter* Shooter, const FVector& Start, const FVector& End, float RewindTime)
+{
+	FShot& Shot = Shots.AddDefaulted_GetRef();
+	Shot.Shooter = Shooter;
+	Shot.Start = Start;
+	Shot.End = End;
+	Shot.RewindTime = RewindTime;
+}
+
+void FNetworkShooterHitscanQueue::Resolve(UWorld* World, FNetworkShooterLagCompensation& LagCompensation, TFunctionRef<void(const FShot&)> OnResolved)
+{
+	if (Shots.Num() == 0)
+	{
+		return;
+	}
+
+	const float Now = World->GetTimeSeconds();
+
+	Order.Reset();
+
+	for (int32 i = 0; i < Shots.Num(); i++)
+	{
+		Shots[i].RewindTime = LagCompensation.ClampRewindTime(Shots[i].RewindTime, Now);
+		Order.Add(i);
+	}
+
+	Order.Sort([this](int32 A, int32 B) { return Shots[A].RewindTime < Shots[B].RewindTime; });
+
+	// Walk the sorted shots, closing a group once the next one is a bucket past its first
+	const float Bucket = CVarHitscanRewindBucket.GetValueOnGameThread();
+	int32 First = 0;
+
+	for (int32 i = 1; i <= Order.Num(); i++)
+	{
+		if (i == Order.Num() || Shots[Order[i]].RewindTime - Shots[Order[First]].RewindTime > Bucket)
+		{
+			TraceGroup(World, LagCompensation, First, i - First);
+			First = i;
+		}
+	}
+
+	// Damage after every trace, so no shot is traced against a world another shot already changed
+	for (const FShot& Shot : Shots)
+	{
+		OnResolved(Shot);
+	}
+
+	TotalShots += Shots.Num();
+	TotalFrames++;
+	MaxShotsPerFrame = FMath::Max(MaxShotsPerFrame, Shots.Num());
+
+	Shots.Reset();
+}
+
+void FNetworkShooterHitscanQueue::TraceGroup(UWorld* World, FNetworkShooterLagCompensation& LagCompensation, int32 First, int32 Count)
+{
+	Segments.Reset();
+
+	float TimeSum = 0.0f;
+	TArray<const AActor*, TInlineAllocator<64>> Ignored;
+
+	for (int32 i = 0; i < Count; i++)
+	{
+		const FShot& Shot = Shots[Order[First + i]];
+
+		Segments.Add({ Shot.Start, Shot.End });
+		Ignored.Add(Shot.Shooter.Get());
+		TimeSum += Shot.RewindTime;
+	}
+
+	const FCollisionObjectQueryParams ObjQuery = GetShotObjectParams();
+
+	const bool bBroadphase = CVarHitscanBroadphase.GetValueOnGameThread() != 0;
+
+	if (bBroadphase)
+	{
+		LagCompensation.BuildBroadphase(TimeSum / Count, Broadphase);
+	}
+	else
+	{
+		// Nobody is left out of the rewind, each trace ignores its own shooter instead
+		LagCompensation.Rewind(TimeSum / Count, Segments);
+	}
+
+	auto TraceShot = [this, World, First, bBroadphase, &ObjQuery, &Ignored](int32 i)
+	{
+		FShot& Shot = Shots[Order[First + i]];
+
+		FCollisionQueryParams ColQuery;
+
+		if (Ignored[i] != nullptr)
+		{
+			ColQuery.AddIgnoredActor(Ignored[i]);
+		}
+
+		if (bBroadphase)
+		{
+			TraceBroadphase(World, Shot, Ignored[i], ColQuery);
+		}
+		else
+		{
+			World->LineTraceSingleByObjectType(Shot.Hit, Shot.Start, Shot.End, ObjQuery, ColQuery);
+		}
+	};
+
+	// Scene queries only read the physics scene, which is safe from several threads at once
+	const int32 ParallelMin = CVarHitscanParallelMin.GetValueOnGameThread();
+
+	if (ParallelMin > 0 && Count >= ParallelMin)
+	{
+		ParallelFor(Count, TraceShot);
+	}
+	else
+	{
+		for (int32 i = 0; i < Count; i++)
+		{
+			TraceShot(i);
+		}
+	}
+
+	if (!bBroadphase)
+	{
+		LagCompensation.Restore();
+	}
+
+	TotalGroups++;
+}
+
+void FNetworkShooterHitscanQueue::TraceBroadphase(UWorld* World, FShot& Shot, const AActor* Shooter, const FCollisionQueryParams& Params)
+{
+	float Distance = 0.0f;
+	const int32 Index = Broadphase.Raycast(Shot.Start, Shot.End, Shooter, Distance);
+
+	if (Index == INDEX_NONE)
+	{
+		Shot.Hit = FHitResult(Shot.Start, Shot.End);
+		return;
+	}
+
+	TotalCapsuleHits++;
+
+	// The only scene query a shot makes, and only once it lines up with someone. A wall in the way is what it hits instead
+	const FVector HitLocation = Shot.Start + (Shot.End - Shot.Start).GetSafeNormal() * Distance;
+
+	if (World->LineTraceSingleByObjectType(Shot.Hit, Shot.Start, HitLocation, FCollisionObjectQueryParams(FCollisionObjectQueryParams::AllStaticObjects), Params))
+	{
+		TotalOccluded++;
+		return;
+	}
+
+	Broadphase.MakeHit(Index, Shot.Start, Shot.End, Distance, Shot.Hit);
+}
+
+FCollisionObjectQueryParams FNetworkShooterHitscanQueue::GetShotObjectParams()
+{
+	// The same walls the broadphase path checks its capsule hits against
+	FCollisionObjectQueryParams ObjQuery(FCollisionObjectQueryParams::AllStaticObjects);
+	ObjQuery.AddObjectTypesToQuery(ECC_GameTraceChannel1);
+
+	return ObjQuery;
+}
+
+void FNetworkShooterHitscanQueue::LogStats() const
+{
+	UE_LOG(LogNetworkShooter, Display, TEXT("Hitscan queue: %d shots over %d frames (%.2f/frame, max %d), %d rewinds (%.2f shots/rewind)"),
+		TotalShots, TotalFrames, TotalFrames > 0 ? float(TotalShots) / TotalFrames : 0.0f, MaxShotsPerFrame,
+		TotalGroups, TotalGroups > 0 ? float(TotalShots) / TotalGroups : 0.0f);
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Hitscan broadphase: %d capsule hits, %d stopped by walls"), TotalCapsuleHits.Load(), TotalOccluded.Load());
+}
+
+static void LogHitscanStats(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode != nullptr)
+	{
+		GameMode->GetHitscanQueue().LogStats();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs HitscanStatsCommand(
+	TEXT("ns.Hitscan.Stats"),
+	TEXT("Logs shots per frame and per rewind of the hitscan queue"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LogHitscanStats));
+
+//////////////////////////////////////////////////////////////////////////
+// Benchmark
+
+static void RunHitscanBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("ns.Hitscan.Bench only works on the server"));
+		return;
+	}
+
+	const int32 MaxShots = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 256;
+	const int32 NumFrames = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 50;
+
+	FNetworkShooterLagCompensation& LagComp = GameMode->GetLagCompensation();
+	FNetworkShooterHitscanQueue Queue;
+
+	const FCollisionObjectQueryParams ObjQuery = FNetworkShooterHitscanQueue::GetShotObjectParams();
+	FCollisionQueryParams ColQuery;
+	FHitResult HitRes;
+
+	const float Now = World->GetTimeSeconds();
+
+	// Same shots for both paths, from random spots in random directions
+	TArray<FNetworkShooterLagCompensation::FSegment> BenchShots;
+	TArray<float> BenchTimes;
+	FRandomStream Random(1337);
+
+	for (int32 i = 0; i < MaxShots; i++)
+	{
+		const FVector Start(Random.FRandRange(-5000.0f, 5000.0f), Random.FRandRange(-5000.0f, 5000.0f), 100.0f);
+
+		BenchShots.Add({ Start, Start + Random.GetUnitVector() * 10000000.0f });
+		BenchTimes.Add(Now - Random.FRandRange(0.0f, 0.2f));
+	}
+
+	for (int32 ShotsPerFrame = 1; ShotsPerFrame <= MaxShots; ShotsPerFrame *= 2)
+	{
+		const double SerialStart = FPlatformTime::Seconds();
+
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			for (int32 i = 0; i < ShotsPerFrame; i++)
+			{
+				LagComp.LineTrace(World, HitRes, nullptr, BenchShots[i].Start, BenchShots[i].End, BenchTimes[i], ObjQuery, ColQuery);
+			}
+		}
+
+		const double SerialElapsed = FPlatformTime::Seconds() - SerialStart;
+		const double QueuedStart = FPlatformTime::Seconds();
+
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			for (int32 i = 0; i < ShotsPerFrame; i++)
+			{
+				Queue.Add(nullptr, BenchShots[i].Start, BenchShots[i].End, BenchTimes[i]);
+			}
+
+			Queue.Resolve(World, LagComp, [](const FNetworkShooterHitscanQueue::FShot& Shot) {});
+		}
+
+		const double QueuedElapsed = FPlatformTime::Seconds() - QueuedStart;
+
+		UE_LOG(LogNetworkShooter, Display, TEXT("Hitscan %4d shots/frame: per shot %8.2f us/frame, queued %8.2f us/frame (%.2fx)"),
+			ShotsPerFrame, SerialElapsed * 1000000.0 / NumFrames, QueuedElapsed * 1000000.0 / NumFrames,
+			QueuedElapsed > 0.0 ? SerialElapsed / QueuedElapsed : 0.0);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs HitscanBenchmarkCommand(
+	TEXT("ns.Hitscan.Bench"),
+	TEXT("Times per shot traces against the hitscan queue for 1, 2, 4... shots per frame. Usage: ns.Hitscan.Bench [MaxShots=256] [NumFrames=50]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunHitscanBenchmark));
@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+#include "Templates/Atomic.h"
+#include "NetworkShooterHitscanBroadphase.h"
+#include "NetworkShooterLagCompensation.h"
+
+class AActor;
+class ANetworkShooterCharacter;
+class UWorld;
+
+/**
+ * Shots received this frame, resolved together once per server tick instead of one trace per
+ * shot. Shots are sorted by rewind time and grouped into ns.Hitscan.RewindBucket wide
+ * buckets. Each bucket rewinds the characters near any of its shots once, runs its traces in
+ * parallel, and restores. Damage is applied afterwards on the game thread in arrival order.
+ *
+ * With ns.Hitscan.Broadphase set nobody is moved at all: each bucket builds the rewound capsules
+ * into an FNetworkShooterHitscanBroadphase, and a shot only queries the physics scene, for a
+ * wall in front of its target, when it hits one of them. Either way walls stop shots.
+ */
+class NETWORKSHOOTER_API FNetworkShooterHitscanQueue
+{
+public:
+	struct FShot
+	{
+		TWeakObjectPtr<ANetworkShooterCharacter> Shooter;
+		FVector Start;
+		FVector End;
+		float RewindTime;
+		FHitResult Hit;
+	};
+
+	FNetworkShooterHitscanQueue();
+
+	void Add(ANetworkShooterCharacter* Shooter, const FVector& Start, const FVector& End, float RewindTime);
+
+	// Traces every queued shot, then calls OnResolved for each in the order they were added
+	void Resolve(UWorld* World, FNetworkShooterLagCompensation& LagCompensation, TFunctionRef<void(const FShot&)> OnResolved);
+
+	int32 Num() const { return Shots.Num(); }
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return Shots.GetAllocatedSize() + Order.GetAllocatedSize() + Segments.GetAllocatedSize() + Broadphase.GetAllocatedSize();
+	}
+
+	void LogStats() const;
+
+	// What a shot traced against the physics scene stops at, characters and static geometry
+	static FCollisionObjectQueryParams GetShotObjectParams();
+
+private:
+	void TraceGroup(UWorld* World, FNetworkShooterLagCompensation& LagCompensation, int32 First, int32 Count);
+	void TraceBroadphase(UWorld* World, FShot& Shot, const AActor* Shooter, const FCollisionQueryParams& Params);
+
+	TArray<FShot> Shots;
+
+	// Shot indices sorted by rewind time
+	TArray<int32> Order;
+	TArray<FNetworkShooterLagCompensation::FSegment> Segments;
+	FNetworkShooterHitscanBroadphase Broadphase;
+
+	int32 TotalShots;
+	int32 TotalFrames;
+	int32 TotalGroups;
+	int32 MaxShotsPerFrame;
+
+	// Broadphase only, written from the trace workers
+	TAtomic<int32> TotalCapsuleHits;
+	TAtomic<int32> TotalOccluded;
+};
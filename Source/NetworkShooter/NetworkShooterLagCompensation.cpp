@@ -0,0 +1,431 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterLagCompensation.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterGameMode.h"
+#include "NetworkShooterHitscanBroadphase.h"
+#include "Components/CapsuleComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<float> CVarLagCompMaxRewind(
+	TEXT("ns.LagComp.MaxRewind"),
+	0.5f,
+	TEXT("Furthest back in seconds the server will rewind characters for a shot."));
+
+// Extra room around the capsule so the mesh sticking out of it still counts as near the ray
+static const float HitboxSlack = 32.0f;
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterHitboxHistory
+
+FNetworkShooterHitboxHistory::FNetworkShooterHitboxHistory()
+{
+	Reset();
+}
+
+void FNetworkShooterHitboxHistory::Reset()
+{
+	Head = 0;
+	Count = 0;
+}
+
+void FNetworkShooterHitboxHistory::Add(float Time, const FVector& Location, const FQuat& Rotation)
+{
+	FNetworkShooterHitboxFrame& Frame = Frames[Head];
+	Frame.Time = Time;
+	Frame.Location = Location;
+	Frame.Rotation = Rotation;
+
+	Head = (Head + 1) % Capacity;
+	Count = FMath::Min(Count + 1, Capacity);
+}
+
+bool FNetworkShooterHitboxHistory::Sample(float Time, FVector& OutLocation, FQuat& OutRotation) const
+{
+	if (Count == 0)
+	{
+		return false;
+	}
+
+	const FNetworkShooterHitboxFrame& Oldest = GetFrame(0);
+	const FNetworkShooterHitboxFrame& Newest = GetFrame(Count - 1);
+
+	if (Time <= Oldest.Time)
+	{
+		OutLocation = Oldest.Location;
+		OutRotation = Oldest.Rotation;
+		return true;
+	}
+
+	if (Time >= Newest.Time)
+	{
+		OutLocation = Newest.Location;
+		OutRotation = Newest.Rotation;
+		return true;
+	}
+
+	// Binary search for the last frame at or before Time
+	int32 Low = 0;
+	int32 High = Count - 1;
+
+	while (High - Low > 1)
+	{
+		const int32 Mid = (Low + High) / 2;
+
+		if (GetFrame(Mid).Time <= Time)
+		{
+			Low = Mid;
+		}
+		else
+		{
+			High = Mid;
+		}
+	}
+
+	const FNetworkShooterHitboxFrame& Before = GetFrame(Low);
+	const FNetworkShooterHitboxFrame& After = GetFrame(High);
+	const float Span = After.Time - Before.Time;
+	const float Alpha = Span > SMALL_NUMBER ? (Time - Before.Time) / Span : 1.0f;
+
+	OutLocation = FMath::Lerp(Before.Location, After.Location, Alpha);
+	OutRotation = FQuat::Slerp(Before.Rotation, After.Rotation, Alpha);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterLagCompensation
+
+FNetworkShooterLagCompensation::FNetworkShooterLagCompensation()
+	: LatestTime(0.0f)
+{
+	// Enough for a full server so registering never grows the array mid match
+	Slots.Reserve(64);
+}
+
+void FNetworkShooterLagCompensation::Register(ANetworkShooterCharacter* Character)
+{
+	if (Character == nullptr || FindSlot(Character) != INDEX_NONE)
+	{
+		return;
+	}
+
+	const int32 Slot = AllocateSlot();
+	const UCapsuleComponent* Capsule = Character->GetCapsuleComponent();
+
+	Slots[Slot].Character = Character;
+	Slots[Slot].BoundsRadius = Capsule->GetScaledCapsuleHalfHeight() + HitboxSlack;
+	Slots[Slot].CapsuleRadius = Capsule->GetScaledCapsuleRadius();
+	Slots[Slot].CapsuleHalfHeight = Capsule->GetScaledCapsuleHalfHeight();
+}
+
+void FNetworkShooterLagCompensation::Unregister(ANetworkShooterCharacter* Character)
+{
+	const int32 Slot = FindSlot(Character);
+
+	if (Slot != INDEX_NONE)
+	{
+		Slots[Slot].Character = nullptr;
+		Slots[Slot].bInUse = false;
+	}
+}
+
+int32 FNetworkShooterLagCompensation::AddSyntheticSlot(float CapsuleRadius, float CapsuleHalfHeight)
+{
+	const int32 Slot = AllocateSlot();
+
+	Slots[Slot].BoundsRadius = CapsuleHalfHeight + HitboxSlack;
+	Slots[Slot].CapsuleRadius = CapsuleRadius;
+	Slots[Slot].CapsuleHalfHeight = CapsuleHalfHeight;
+
+	return Slot;
+}
+
+int32 FNetworkShooterLagCompensation::FindSlot(const ANetworkShooterCharacter* Character) const
+{
+	if (Character != nullptr)
+	{
+		for (int32 i = 0; i < Slots.Num(); i++)
+		{
+			if (Slots[i].bInUse && Slots[i].Character.Get() == Character)
+			{
+				return i;
+			}
+		}
+	}
+
+	return INDEX_NONE;
+}
+
+int32 FNetworkShooterLagCompensation::AllocateSlot()
+{
+	int32 Slot = INDEX_NONE;
+
+	// Reuse a free slot so the history storage stays put
+	for (int32 i = 0; i < Slots.Num(); i++)
+	{
+		if (!Slots[i].bInUse)
+		{
+			Slot = i;
+			break;
+		}
+	}
+
+	if (Slot == INDEX_NONE)
+	{
+		Slot = Slots.AddDefaulted();
+	}
+
+	Slots[Slot].Character = nullptr;
+	Slots[Slot].History.Reset();
+	Slots[Slot].BoundsRadius = 0.0f;
+	Slots[Slot].CapsuleRadius = 0.0f;
+	Slots[Slot].CapsuleHalfHeight = 0.0f;
+	Slots[Slot].bInUse = true;
+
+	return Slot;
+}
+
+void FNetworkShooterLagCompensation::Snapshot(float Time)
+{
+	LatestTime = Time;
+
+	for (FSlot& Slot : Slots)
+	{
+		ANetworkShooterCharacter* Character = Slot.Character.Get();
+
+		if (Slot.bInUse && Character != nullptr)
+		{
+			Slot.History.Add(Time, Character->GetActorLocation(), Character->GetActorQuat());
+		}
+	}
+}
+
+void FNetworkShooterLagCompensation::GatherCandidates(const FVector& Start, const FVector& End, float Time, int32 IgnoreSlot, FCandidateArray& OutCandidates) const
+{
+	OutCandidates.Reset();
+
+	for (int32 i = 0; i < Slots.Num(); i++)
+	{
+		const FSlot& Slot = Slots[i];
+
+		if (!Slot.bInUse || i == IgnoreSlot)
+		{
+			continue;
+		}
+
+		const ANetworkShooterCharacter* Character = Slot.Character.Get();
+
+		// The dead don't take shots, and ragdolls are owned by physics and can't be moved about
+		if (Character != nullptr && Character->IsDead())
+		{
+			continue;
+		}
+
+		FCandidate Candidate;
+		Candidate.Slot = i;
+
+		if (!Slot.History.Sample(Time, Candidate.Location, Candidate.Rotation))
+		{
+			continue;
+		}
+
+		const float RadiusSq = FMath::Square(Slot.BoundsRadius);
+
+		// Anyone sitting on the ray right now has to be moved too, otherwise they would block the rewound trace
+		const FVector Current = Character != nullptr ? Character->GetActorLocation() : Candidate.Location;
+
+		if (FMath::PointDistToSegmentSquared(Candidate.Location, Start, End) <= RadiusSq ||
+			FMath::PointDistToSegmentSquared(Current, Start, End) <= RadiusSq)
+		{
+			OutCandidates.Add(Candidate);
+		}
+	}
+}
+
+void FNetworkShooterLagCompensation::BuildBroadphase(float Time, FNetworkShooterHitscanBroadphase& OutBroadphase) const
+{
+	OutBroadphase.Reset();
+
+	for (const FSlot& Slot : Slots)
+	{
+		if (!Slot.bInUse)
+		{
+			continue;
+		}
+
+		ANetworkShooterCharacter* Character = Slot.Character.Get();
+
+		// The dead don't take shots, same as the rewind
+		if (Character != nullptr && Character->IsDead())
+		{
+			continue;
+		}
+
+		FVector Location;
+		FQuat Rotation;
+
+		// Registered since the last snapshot, where they are now is all there is
+		if (!Slot.History.Sample(Time, Location, Rotation))
+		{
+			if (Character == nullptr)
+			{
+				continue;
+			}
+
+			Location = Character->GetActorLocation();
+		}
+
+		OutBroadphase.Add(Character, Location, Slot.CapsuleRadius, Slot.CapsuleHalfHeight);
+	}
+}
+
+float FNetworkShooterLagCompensation::ClampRewindTime(float RewindTime, float Now) const
+{
+	return FMath::Clamp(RewindTime, Now - CVarLagCompMaxRewind.GetValueOnGameThread(), Now);
+}
+
+void FNetworkShooterLagCompensation::Rewind(float Time, TArrayView<const FSegment> Segments, int32 IgnoreSlot)
+{
+	check(Restores.Num() == 0);
+
+	FCandidateArray Candidates;
+
+	for (const FSegment& Segment : Segments)
+	{
+		GatherCandidates(Segment.Start, Segment.End, Time, IgnoreSlot, Candidates);
+
+		// A character near several of the segments is only moved once
+		for (const FCandidate& Candidate : Candidates)
+		{
+			if (!RewindCandidates.ContainsByPredicate([&Candidate](const FCandidate& Other) { return Other.Slot == Candidate.Slot; }))
+			{
+				RewindCandidates.Add(Candidate);
+			}
+		}
+	}
+
+	for (const FCandidate& Candidate : RewindCandidates)
+	{
+		ANetworkShooterCharacter* Character = Slots[Candidate.Slot].Character.Get();
+
+		if (Character != nullptr)
+		{
+			Restores.Add({ Character, Character->GetActorLocation(), Character->GetActorQuat() });
+			Character->SetActorLocationAndRotation(Candidate.Location, Candidate.Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+		}
+	}
+
+	RewindCandidates.Reset();
+}
+
+void FNetworkShooterLagCompensation::Restore()
+{
+	for (const FRestore& Moved : Restores)
+	{
+		Moved.Character->SetActorLocationAndRotation(Moved.Location, Moved.Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	}
+
+	Restores.Reset();
+}
+
+bool FNetworkShooterLagCompensation::LineTrace(UWorld* World, FHitResult& OutHit, const ANetworkShooterCharacter* Shooter, const FVector& Start, const FVector& End,
+	float RewindTime, const FCollisionObjectQueryParams& ObjectParams, const FCollisionQueryParams& Params)
+{
+	const FSegment Segment = { Start, End };
+
+	Rewind(ClampRewindTime(RewindTime, World->GetTimeSeconds()), MakeArrayView(&Segment, 1), FindSlot(Shooter));
+
+	const bool bHit = World->LineTraceSingleByObjectType(OutHit, Start, End, ObjectParams, Params);
+
+	Restore();
+
+	return bHit;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Benchmark
+
+static void RunLagCompensationBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 NumPlayers = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 64;
+	const int32 NumShots = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 10000;
+	const float TickRate = 60.0f;
+
+	FRandomStream Random(1337);
+
+	// Synthetic history: players wandering a 10000 unit square for a full buffer of ticks
+	FNetworkShooterLagCompensation LagComp;
+	TArray<FVector> Positions;
+
+	for (int32 i = 0; i < NumPlayers; i++)
+	{
+		LagComp.AddSyntheticSlot(55.0f, 96.0f);
+		Positions.Add(FVector(Random.FRandRange(-5000.0f, 5000.0f), Random.FRandRange(-5000.0f, 5000.0f), 100.0f));
+	}
+
+	for (int32 Tick = 0; Tick < FNetworkShooterHitboxHistory::Capacity; Tick++)
+	{
+		for (int32 i = 0; i < NumPlayers; i++)
+		{
+			Positions[i] += FVector(Random.FRandRange(-10.0f, 10.0f), Random.FRandRange(-10.0f, 10.0f), 0.0f);
+			LagComp.GetHistory(i).Add(Tick / TickRate, Positions[i], FQuat::Identity);
+		}
+	}
+
+	const float Newest = (FNetworkShooterHitboxHistory::Capacity - 1) / TickRate;
+	FNetworkShooterLagCompensation::FCandidateArray Candidates;
+	int64 TotalCandidates = 0;
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	for (int32 Shot = 0; Shot < NumShots; Shot++)
+	{
+		const int32 Shooter = Random.RandRange(0, NumPlayers - 1);
+		const int32 Target = Random.RandRange(0, NumPlayers - 1);
+		const FVector Start = Positions[Shooter];
+		const FVector End = Start + (Positions[Target] - Start).GetSafeNormal() * 10000000.0f;
+
+		LagComp.GatherCandidates(Start, End, Newest - Random.FRandRange(0.0f, 0.5f), Shooter, Candidates);
+		TotalCandidates += Candidates.Num();
+	}
+
+	const double Elapsed = FPlatformTime::Seconds() - StartTime;
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("LagComp synthetic: %d players, %d shots, %.3f us/shot, %.2f candidates/shot"),
+		NumPlayers, NumShots, Elapsed * 1000000.0 / NumShots, double(TotalCandidates) / NumShots);
+
+	// Full rewind + trace + restore against whoever is registered on the running server
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode != nullptr)
+	{
+		FCollisionObjectQueryParams ObjQuery;
+		ObjQuery.AddObjectTypesToQuery(ECC_GameTraceChannel1);
+		FCollisionQueryParams ColQuery;
+		FHitResult HitRes;
+
+		const float Now = World->GetTimeSeconds();
+		const double LiveStartTime = FPlatformTime::Seconds();
+
+		for (int32 Shot = 0; Shot < NumShots; Shot++)
+		{
+			const FVector Start(Random.FRandRange(-5000.0f, 5000.0f), Random.FRandRange(-5000.0f, 5000.0f), 100.0f);
+			const FVector End = Start + Random.GetUnitVector() * 10000000.0f;
+
+			GameMode->GetLagCompensation().LineTrace(World, HitRes, nullptr, Start, End, Now - Random.FRandRange(0.0f, 0.5f), ObjQuery, ColQuery);
+		}
+
+		const double LiveElapsed = FPlatformTime::Seconds() - LiveStartTime;
+
+		UE_LOG(LogNetworkShooter, Display, TEXT("LagComp live world: %d shots, %.3f us/shot"), NumShots, LiveElapsed * 1000000.0 / NumShots);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs LagCompensationBenchmarkCommand(
+	TEXT("ns.LagComp.Bench"),
+	TEXT("Times lag compensated shots. Usage: ns.LagComp.Bench [NumPlayers=64] [NumShots=10000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunLagCompensationBenchmark));
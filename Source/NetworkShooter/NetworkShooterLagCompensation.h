@@ -0,0 +1,146 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/StaticArray.h"
+#include "Engine/EngineTypes.h"
+
+class ANetworkShooterCharacter;
+class FNetworkShooterHitscanBroadphase;
+class UWorld;
+
+/** One sampled hitbox transform of a character */
+struct FNetworkShooterHitboxFrame
+{
+	float Time;
+	FVector Location;
+	FQuat Rotation;
+};
+
+/**
+ * Fixed-size ring buffer of hitbox transforms for a single character.
+ * Frames live inline so the history never allocates once constructed.
+ */
+struct NETWORKSHOOTER_API FNetworkShooterHitboxHistory
+{
+	// At a 60Hz server tick this covers a little over one second
+	static constexpr int32 Capacity = 64;
+
+	FNetworkShooterHitboxHistory();
+
+	void Reset();
+
+	// Overwrites the oldest frame once the buffer is full
+	void Add(float Time, const FVector& Location, const FQuat& Rotation);
+
+	// Interpolates the transform at Time, clamping to the oldest/newest frame. False if empty
+	bool Sample(float Time, FVector& OutLocation, FQuat& OutRotation) const;
+
+	int32 Num() const { return Count; }
+
+	// i = 0 is the oldest frame
+	const FNetworkShooterHitboxFrame& GetFrame(int32 i) const { return Frames[(Head + Capacity - Count + i) % Capacity]; }
+
+private:
+	TStaticArray<FNetworkShooterHitboxFrame, Capacity> Frames;
+
+	// Index the next frame will be written to
+	int32 Head;
+	int32 Count;
+};
+
+/**
+ * Server side rewind for hitscan shots. Keeps a hitbox history for every registered character,
+ * and when a shot is traced moves only the characters near the ray back to where the shooter
+ * saw them, runs the trace, then puts them back.
+ */
+class NETWORKSHOOTER_API FNetworkShooterLagCompensation
+{
+public:
+	struct FCandidate
+	{
+		int32 Slot;
+		FVector Location;
+		FQuat Rotation;
+	};
+
+	typedef TArray<FCandidate, TInlineAllocator<16>> FCandidateArray;
+
+	struct FSegment
+	{
+		FVector Start;
+		FVector End;
+	};
+
+	FNetworkShooterLagCompensation();
+
+	void Register(ANetworkShooterCharacter* Character);
+	void Unregister(ANetworkShooterCharacter* Character);
+
+	// Records the current transform of every registered character, called once per server tick
+	void Snapshot(float Time);
+
+	/**
+	 * Traces Start->End against the world with characters rewound to RewindTime.
+	 * RewindTime is clamped to the configured rewind window.
+	 */
+	bool LineTrace(UWorld* World, FHitResult& OutHit, const ANetworkShooterCharacter* Shooter, const FVector& Start, const FVector& End,
+		float RewindTime, const FCollisionObjectQueryParams& ObjectParams, const FCollisionQueryParams& Params);
+
+	// RewindTime limited to the configured rewind window before Now
+	float ClampRewindTime(float RewindTime, float Now) const;
+
+	/**
+	 * Moves every character near any of Segments back to Time, so several shots can be traced
+	 * against one rewind. Must be followed by Restore before anything else moves them.
+	 * Overlaps begun or ended by the move are undone by Restore, listeners skip them via IsRewinding.
+	 */
+	void Rewind(float Time, TArrayView<const FSegment> Segments, int32 IgnoreSlot = INDEX_NONE);
+	void Restore();
+
+	// True between Rewind and the end of Restore while characters are away from where they really are
+	bool IsRewinding() const { return Restores.Num() != 0; }
+
+	// Characters whose current or rewound bounds touch the segment, with their rewound transform
+	void GatherCandidates(const FVector& Start, const FVector& End, float Time, int32 IgnoreSlot, FCandidateArray& OutCandidates) const;
+
+	// Every character's capsule at Time, for tracing shots without moving anyone
+	void BuildBroadphase(float Time, FNetworkShooterHitscanBroadphase& OutBroadphase) const;
+
+	// Synthetic registration for benchmarks, no actor attached
+	int32 AddSyntheticSlot(float CapsuleRadius, float CapsuleHalfHeight);
+	FNetworkShooterHitboxHistory& GetHistory(int32 Slot) { return Slots[Slot].History; }
+
+	float GetLatestTime() const { return LatestTime; }
+
+	SIZE_T GetAllocatedSize() const { return Slots.GetAllocatedSize() + Restores.GetAllocatedSize() + RewindCandidates.GetAllocatedSize(); }
+
+private:
+	struct FSlot
+	{
+		TWeakObjectPtr<ANetworkShooterCharacter> Character;
+		FNetworkShooterHitboxHistory History;
+		float BoundsRadius;
+		float CapsuleRadius;
+		float CapsuleHalfHeight;
+		bool bInUse;
+	};
+
+	int32 FindSlot(const ANetworkShooterCharacter* Character) const;
+	int32 AllocateSlot();
+
+	TArray<FSlot> Slots;
+	float LatestTime;
+
+	struct FRestore
+	{
+		ANetworkShooterCharacter* Character;
+		FVector Location;
+		FQuat Rotation;
+	};
+
+	// Characters moved by the current Rewind
+	TArray<FRestore, TInlineAllocator<16>> Restores;
+	FCandidateArray RewindCandidates;
+};
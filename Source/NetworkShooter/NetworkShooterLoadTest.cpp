@@ -0,0 +1,269 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterLoadTest.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterGameMode.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/GameStateBase.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/CommandLine.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+FNetworkShooterLoadTest::FNetworkShooterLoadTest()
+	: SampleInterval(1.0f)
+	, FlushStart(0.0)
+	, bRunning(false)
+	, bQuitWhenDone(false)
+	, bCheckedCommandLine(false)
+	, Elapsed(0.0f)
+	, EndTime(0.0f)
+	, SampleTime(0.0f)
+	, Frames(0)
+	, FrameSeconds(0.0)
+	, BusySeconds(0.0)
+	, MaxFrameSeconds(0.0)
+	, MaxBusySeconds(0.0)
+	, FlushSeconds(0.0)
+	, MaxFlushSeconds(0.0)
+	, ServerFires(0)
+	, Multicasts(0)
+{
+}
+
+void FNetworkShooterLoadTest::Start(float Duration, const FString& InFilename)
+{
+	Filename = InFilename.Len() > 0 ? InFilename :
+		FPaths::ProjectSavedDir() / TEXT("LoadTests") / FString::Printf(TEXT("LoadTest-%s.csv"), *FDateTime::Now().ToString());
+
+	Rows.Reset();
+	Rows.Add(TEXT("Time,Players,FrameMsAvg,FrameMsMax,BusyMsAvg,BusyMsMax,NetFlushMsAvg,NetFlushMsMax,Connections,OutBytesPerSecAvg,OutBytesPerSecMax,InBytesPerSecAvg,ServerFiresPerSec,MulticastsPerSec"));
+
+	bRunning = true;
+	Elapsed = 0.0f;
+	EndTime = Duration;
+
+	SampleTime = 0.0f;
+	Frames = 0;
+	FrameSeconds = 0.0;
+	BusySeconds = 0.0;
+	MaxFrameSeconds = 0.0;
+	MaxBusySeconds = 0.0;
+	FlushSeconds = 0.0;
+	MaxFlushSeconds = 0.0;
+	ServerFires = 0;
+	Multicasts = 0;
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Load test started, writing to %s"), *Filename);
+}
+
+void FNetworkShooterLoadTest::Stop()
+{
+	if (!bRunning)
+	{
+		return;
+	}
+
+	bRunning = false;
+	Unbind();
+
+	if (FFileHelper::SaveStringArrayToFile(Rows, *Filename))
+	{
+		UE_LOG(LogNetworkShooter, Display, TEXT("Load test wrote %d samples to %s"), Rows.Num() - 1, *Filename);
+	}
+	else
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("Unable to write the load test results to %s"), *Filename);
+	}
+
+	if (bQuitWhenDone)
+	{
+		FPlatformMisc::RequestExit(false);
+	}
+}
+
+SIZE_T FNetworkShooterLoadTest::GetAllocatedSize() const
+{
+	SIZE_T Size = Rows.GetAllocatedSize() + Filename.GetAllocatedSize();
+
+	for (const FString& Row : Rows)
+	{
+		Size += Row.GetAllocatedSize();
+	}
+
+	return Size;
+}
+
+void FNetworkShooterLoadTest::Tick(UWorld* World, float DeltaSeconds)
+{
+	if (!bCheckedCommandLine)
+	{
+		bCheckedCommandLine = true;
+
+		float Duration = 0.0f;
+
+		if (FParse::Value(FCommandLine::Get(), TEXT("LoadTest="), Duration) && Duration > 0.0f)
+		{
+			FString CommandLineFile;
+			FParse::Value(FCommandLine::Get(), TEXT("LoadTestFile="), CommandLineFile);
+
+			bQuitWhenDone = true;
+			Start(Duration, CommandLineFile);
+		}
+	}
+
+	if (!bRunning)
+	{
+		return;
+	}
+
+	if (!BoundWorld.IsValid())
+	{
+		BoundWorld = World;
+		PostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddRaw(this, &FNetworkShooterLoadTest::OnPostActorTick);
+		TickFlushHandle = World->OnTickFlush().AddRaw(this, &FNetworkShooterLoadTest::OnTickFlush);
+	}
+
+	// Idle time is what the engine slept to hold the tick rate, the rest is the server actually working
+	const double Frame = FApp::GetDeltaTime();
+	const double Busy = FMath::Max(Frame - FApp::GetIdleTime(), 0.0);
+
+	Frames++;
+	FrameSeconds += Frame;
+	BusySeconds += Busy;
+	MaxFrameSeconds = FMath::Max(MaxFrameSeconds, Frame);
+	MaxBusySeconds = FMath::Max(MaxBusySeconds, Busy);
+
+	Elapsed += DeltaSeconds;
+	SampleTime += DeltaSeconds;
+
+	if (SampleTime >= SampleInterval)
+	{
+		WriteRow(World);
+	}
+
+	if (EndTime > 0.0f && Elapsed >= EndTime)
+	{
+		Stop();
+	}
+}
+
+void FNetworkShooterLoadTest::OnPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (World == BoundWorld.Get())
+	{
+		FlushStart = FPlatformTime::Seconds();
+	}
+}
+
+void FNetworkShooterLoadTest::OnTickFlush(float DeltaSeconds)
+{
+	// Bound after the net driver, so this runs once it has replicated
+	if (FlushStart > 0.0)
+	{
+		const double Flush = FPlatformTime::Seconds() - FlushStart;
+
+		FlushSeconds += Flush;
+		MaxFlushSeconds = FMath::Max(MaxFlushSeconds, Flush);
+		FlushStart = 0.0;
+	}
+}
+
+void FNetworkShooterLoadTest::Unbind()
+{
+	FWorldDelegates::OnWorldPostActorTick.Remove(PostActorTickHandle);
+
+	if (UWorld* World = BoundWorld.Get())
+	{
+		World->OnTickFlush().Remove(TickFlushHandle);
+	}
+
+	BoundWorld = nullptr;
+	FlushStart = 0.0;
+}
+
+void FNetworkShooterLoadTest::WriteRow(UWorld* World)
+{
+	int32 Connections = 0;
+	int64 TotalOut = 0;
+	int64 TotalIn = 0;
+	int32 MaxOut = 0;
+
+	UNetDriver* NetDriver = World->GetNetDriver();
+
+	if (NetDriver != nullptr)
+	{
+		for (UNetConnection* Connection : NetDriver->ClientConnections)
+		{
+			if (Connection != nullptr)
+			{
+				Connections++;
+				TotalOut += Connection->OutBytesPerSecond;
+				TotalIn += Connection->InBytesPerSecond;
+				MaxOut = FMath::Max(MaxOut, Connection->OutBytesPerSecond);
+			}
+		}
+	}
+
+	const int32 Players = World->GetGameState() ? World->GetGameState()->PlayerArray.Num() : 0;
+	const int32 SafeConnections = FMath::Max(Connections, 1);
+
+	Rows.Add(FString::Printf(TEXT("%.2f,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%d,%lld,%d,%lld,%.1f,%.1f"),
+		Elapsed, Players,
+		FrameSeconds * 1000.0 / Frames, MaxFrameSeconds * 1000.0,
+		BusySeconds * 1000.0 / Frames, MaxBusySeconds * 1000.0,
+		FlushSeconds * 1000.0 / Frames, MaxFlushSeconds * 1000.0,
+		Connections, TotalOut / SafeConnections, MaxOut, TotalIn / SafeConnections,
+		ServerFires / SampleTime, Multicasts / SampleTime));
+
+	SampleTime = 0.0f;
+	Frames = 0;
+	FrameSeconds = 0.0;
+	BusySeconds = 0.0;
+	MaxFrameSeconds = 0.0;
+	MaxBusySeconds = 0.0;
+	FlushSeconds = 0.0;
+	MaxFlushSeconds = 0.0;
+	ServerFires = 0;
+	Multicasts = 0;
+}
+
+static void StartLoadTest(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("ns.LoadTest.Start only works on the server"));
+		return;
+	}
+
+	const float Duration = Args.Num() > 0 ? FCString::Atof(*Args[0]) : 0.0f;
+
+	GameMode->GetLoadTest().Start(Duration, Args.Num() > 1 ? Args[1] : FString());
+}
+
+static void StopLoadTest(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode != nullptr)
+	{
+		GameMode->GetLoadTest().Stop();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs StartLoadTestCommand(
+	TEXT("ns.LoadTest.Start"),
+	TEXT("Records server frame time, bandwidth and RPC counts to a CSV. Usage: ns.LoadTest.Start [Seconds=0 runs until stopped] [Filename]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StartLoadTest));
+
+static FAutoConsoleCommandWithWorldAndArgs StopLoadTestCommand(
+	TEXT("ns.LoadTest.Stop"),
+	TEXT("Stops the running load test and writes its CSV"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StopLoadTest));
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+
+class UWorld;
+
+/**
+ * Server metrics for load test runs, one CSV row per sample interval: frame times, time spent
+ * in the net driver's tick flush (where actors are replicated), player count, per connection
+ * bandwidth and how many fire RPCs came in and effect multicasts went out.
+ * Started with ns.LoadTest.Start, or -LoadTest=<Seconds> on the command line, which also quits
+ * once the file is written so runs from 8 to 128 players can be scripted.
+ */
+class NETWORKSHOOTER_API FNetworkShooterLoadTest
+{
+public:
+	FNetworkShooterLoadTest();
+
+	void Start(float Duration, const FString& InFilename);
+	void Stop();
+
+	bool IsRunning() const { return bRunning; }
+
+	SIZE_T GetAllocatedSize() const;
+
+	// Called every server tick by the game mode
+	void Tick(UWorld* World, float DeltaSeconds);
+
+	void CountServerFire() { ServerFires++; }
+	void CountMulticast() { Multicasts++; }
+
+	// Seconds of data per CSV row
+	float SampleInterval;
+
+private:
+	void WriteRow(UWorld* World);
+
+	// Brackets the net driver's TickFlush, which runs between the two
+	void OnPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+	void OnTickFlush(float DeltaSeconds);
+	void Unbind();
+
+	TWeakObjectPtr<UWorld> BoundWorld;
+	FDelegateHandle PostActorTickHandle;
+	FDelegateHandle TickFlushHandle;
+	double FlushStart;
+
+	TArray<FString> Rows;
+	FString Filename;
+
+	bool bRunning;
+	bool bQuitWhenDone;
+	bool bCheckedCommandLine;
+
+	float Elapsed;
+	float EndTime;
+
+	// Current sample
+	float SampleTime;
+	int32 Frames;
+	double FrameSeconds;
+	double BusySeconds;
+	double MaxFrameSeconds;
+	double MaxBusySeconds;
+	double FlushSeconds;
+	double MaxFlushSeconds;
+	int32 ServerFires;
+	int32 Multicasts;
+};
@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterNetProfiles.h"
+#include "GameFramework/Actor.h"
+
+const FNetworkShooterNetProfile* UNetworkShooterNetProfiles::Find(const UClass* Class)
+{
+	for (const FNetworkShooterNetProfile& Profile : GetDefault<UNetworkShooterNetProfiles>()->Profiles)
+	{
+		const UClass* ProfileClass = Profile.ActorClass.Get();
+
+		if (ProfileClass != nullptr && Class->IsChildOf(ProfileClass))
+		{
+			return &Profile;
+		}
+	}
+
+	return nullptr;
+}
+
+void UNetworkShooterNetProfiles::Apply(AActor* Actor)
+{
+	if (Actor->GetLocalRole() != ROLE_Authority)
+	{
+		return;
+	}
+
+	if (const FNetworkShooterNetProfile* Profile = Find(Actor->GetClass()))
+	{
+		Actor->NetUpdateFrequency = Profile->NetUpdateFrequency;
+		Actor->MinNetUpdateFrequency = Profile->MinNetUpdateFrequency;
+		Actor->SetNetDormancy(Profile->NetDormancy);
+	}
+}
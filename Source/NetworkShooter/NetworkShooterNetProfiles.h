@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+#include "UObject/Object.h"
+#include "UObject/SoftObjectPtr.h"
+#include "NetworkShooterNetProfiles.generated.h"
+
+class AActor;
+
+/** Replication rates and dormancy for one actor class and its subclasses */
+USTRUCT()
+struct FNetworkShooterNetProfile
+{
+	GENERATED_BODY()
+
+	UPROPERTY(config)
+	TSoftClassPtr<AActor> ActorClass;
+
+	UPROPERTY(config)
+	float NetUpdateFrequency;
+
+	UPROPERTY(config)
+	float MinNetUpdateFrequency;
+
+	// Dormant actors are skipped by the net driver until ForceNetUpdate flushes them
+	UPROPERTY(config)
+	TEnumAsByte<ENetDormancy> NetDormancy;
+
+	FNetworkShooterNetProfile()
+		: NetUpdateFrequency(100.0f)
+		, MinNetUpdateFrequency(2.0f)
+		, NetDormancy(DORM_Awake)
+	{
+	}
+};
+
+/**
+ * Per class net update profiles from the [/Script/NetworkShooter.NetworkShooterNetProfiles]
+ * section of Game.ini, so rates can be tuned without a rebuild. Actors with a profile apply it
+ * when their components are initialized and call ForceNetUpdate whenever their replicated
+ * state changes, so a low rate or dormancy doesn't delay what players see.
+ */
+UCLASS(config=Game)
+class NETWORKSHOOTER_API UNetworkShooterNetProfiles : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	// The first matching entry wins, list subclasses before their parents
+	UPROPERTY(config)
+	TArray<FNetworkShooterNetProfile> Profiles;
+
+	// Profile for Class, null when it has none
+	static const FNetworkShooterNetProfile* Find(const UClass* Class);
+
+	// Server side, sets Actor's rates and dormancy from its profile if it has one
+	static void Apply(AActor* Actor);
+};
@@ -0,0 +1,121 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterPawnPool.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterGameMode.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<float> CVarCorpseTime(
+	TEXT("ns.PawnPool.CorpseTime"),
+	5.0f,
+	TEXT("Seconds a dead character stays in the world after its player respawned, before it goes back to the pool."));
+
+FNetworkShooterPawnPool::FNetworkShooterPawnPool()
+	: MaxPerTeam(32)
+	, Hits(0)
+	, Misses(0)
+	, Released(0)
+	, Discarded(0)
+{
+}
+
+TArray<TWeakObjectPtr<ANetworkShooterCharacter>>& FNetworkShooterPawnPool::GetTeamPool(ETeam Team)
+{
+	return Team == ETeam::RED_TEAM ? RedPool : BluePool;
+}
+
+void FNetworkShooterPawnPool::Release(ANetworkShooterCharacter* Character, ETeam Team)
+{
+	TArray<TWeakObjectPtr<ANetworkShooterCharacter>>& Pool = GetTeamPool(Team);
+
+	if (Pool.Num() >= MaxPerTeam)
+	{
+		Discarded++;
+		Character->Destroy(true, true);
+		return;
+	}
+
+	Released++;
+	Character->ReturnToPool();
+	Pool.Add(Character);
+}
+
+void FNetworkShooterPawnPool::ReleaseLater(ANetworkShooterCharacter* Character, ETeam Team, double Now)
+{
+	FCorpse& Corpse = Corpses.AddDefaulted_GetRef();
+	Corpse.Character = Character;
+	Corpse.Team = Team;
+	Corpse.ReleaseTime = Now + FMath::Max(CVarCorpseTime.GetValueOnGameThread(), 0.0f);
+}
+
+void FNetworkShooterPawnPool::Update(double Now)
+{
+	// Copied out first, a release may destroy the character
+	TArray<FCorpse, TInlineAllocator<8>> Due;
+
+	for (int32 i = Corpses.Num() - 1; i >= 0; i--)
+	{
+		if (Corpses[i].ReleaseTime <= Now)
+		{
+			Due.Add(Corpses[i]);
+			Corpses.RemoveAtSwap(i, 1, false);
+		}
+	}
+
+	for (const FCorpse& Corpse : Due)
+	{
+		ANetworkShooterCharacter* Character = Corpse.Character.Get();
+
+		if (Character != nullptr && !Character->IsPendingKill())
+		{
+			Release(Character, Corpse.Team);
+		}
+	}
+}
+
+ANetworkShooterCharacter* FNetworkShooterPawnPool::Acquire(ETeam Team)
+{
+	TArray<TWeakObjectPtr<ANetworkShooterCharacter>>& Pool = GetTeamPool(Team);
+
+	while (Pool.Num() > 0)
+	{
+		ANetworkShooterCharacter* Character = Pool.Pop(false).Get();
+
+		// Anything torn down behind our back (level change, editor) is just skipped
+		if (Character != nullptr && !Character->IsPendingKill())
+		{
+			Hits++;
+			Character->ActivateFromPool();
+			return Character;
+		}
+	}
+
+	Misses++;
+	return nullptr;
+}
+
+void FNetworkShooterPawnPool::LogStats() const
+{
+	const int32 Requests = Hits + Misses;
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Pawn pool: %d hits, %d misses (%.1f%% hit rate), %d released, %d discarded, %d red / %d blue pooled, %d corpses"),
+		Hits, Misses, Requests > 0 ? 100.0f * Hits / Requests : 0.0f, Released, Discarded, RedPool.Num(), BluePool.Num(), Corpses.Num());
+}
+
+static void LogPawnPoolStats(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode != nullptr)
+	{
+		GameMode->GetPawnPool().LogStats();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs PawnPoolStatsCommand(
+	TEXT("ns.PawnPool.Stats"),
+	TEXT("Logs respawn pawn pool hit and miss counts"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LogPawnPoolStats));
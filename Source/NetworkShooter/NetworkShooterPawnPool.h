@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ANetworkShooterCharacter;
+enum class ETeam : uint8;
+
+/**
+ * Per team pool of dead characters waiting to be reused on respawn, so a death costs
+ * a reset in place instead of a Destroy plus a fresh SpawnActor of every subobject.
+ * A dead character stays in the world as a corpse for ns.PawnPool.CorpseTime after its
+ * player respawned, so its ragdoll or death animation plays out before it is pooled.
+ */
+class NETWORKSHOOTER_API FNetworkShooterPawnPool
+{
+public:
+	FNetworkShooterPawnPool();
+
+	// Deactivates Character and keeps it for its team, destroys it when the pool is full
+	void Release(ANetworkShooterCharacter* Character, ETeam Team);
+
+	// Leaves Character as a corpse and releases it once ns.PawnPool.CorpseTime has passed, see Update
+	void ReleaseLater(ANetworkShooterCharacter* Character, ETeam Team, double Now);
+
+	// Releases the corpses whose time is up, run from the game mode tick
+	void Update(double Now);
+
+	// Reactivated character for Team, or nullptr when the pool is empty. Never one that is still a corpse.
+	// It stays hidden where it died until the game mode places it on a spawn point
+	ANetworkShooterCharacter* Acquire(ETeam Team);
+
+	void LogStats() const;
+
+	// Most characters kept around per team
+	int32 MaxPerTeam;
+
+private:
+	TArray<TWeakObjectPtr<ANetworkShooterCharacter>>& GetTeamPool(ETeam Team);
+
+	TArray<TWeakObjectPtr<ANetworkShooterCharacter>> RedPool;
+	TArray<TWeakObjectPtr<ANetworkShooterCharacter>> BluePool;
+
+	struct FCorpse
+	{
+		TWeakObjectPtr<ANetworkShooterCharacter> Character;
+		ETeam Team;
+		double ReleaseTime;
+	};
+
+	// Unordered, ns.PawnPool.CorpseTime can change while some are waiting
+	TArray<FCorpse> Corpses;
+
+	int32 Hits;
+	int32 Misses;
+	int32 Released;
+	int32 Discarded;
+};
@@ -2,7 +2,11 @@
 
 
 #include "NetworkShooterPlayerState.h"
+#include "NetworkShooterClientEvents.h"
+#include "NetworkShooterNetProfiles.h"
+#include "Engine/World.h"
 #include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
 
 ANetworkShooterPlayerState::ANetworkShooterPlayerState(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
@@ -10,13 +14,143 @@ ANetworkShooterPlayerState::ANetworkShooterPlayerState(const FObjectInitializer&
 	Health = 100.0f;
 	Deaths = 0;
 	Team = ETeam::BLUE_TEAM;
+	bHasTeam = false;
 }
 
 void ANetworkShooterPlayerState::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-	DOREPLIFETIME(ANetworkShooterPlayerState, Health);
-	DOREPLIFETIME(ANetworkShooterPlayerState, Deaths);
-	DOREPLIFETIME(ANetworkShooterPlayerState, Team);
-}
\ No newline at end of file
+	// These change rarely, so only compare them when marked dirty
+	FDoRepLifetimeParams Params;
+	Params.bIsPushBased = true;
+
+	DOREPLIFETIME_WITH_PARAMS_FAST(ANetworkShooterPlayerState, Health, Params);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ANetworkShooterPlayerState, Deaths, Params);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ANetworkShooterPlayerState, Team, Params);
+}
+
+void ANetworkShooterPlayerState::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	UNetworkShooterNetProfiles::Apply(this);
+}
+
+void ANetworkShooterPlayerState::CopyProperties(APlayerState* PlayerState)
+{
+	Super::CopyProperties(PlayerState);
+
+	ANetworkShooterPlayerState* thisPS = Cast<ANetworkShooterPlayerState>(PlayerState);
+
+	if (thisPS != nullptr)
+	{
+		if (bHasTeam)
+		{
+			thisPS->SetTeam(Team);
+		}
+
+		thisPS->SetDeaths(Deaths);
+	}
+}
+
+// The setters publish themselves since RepNotifies don't run on a listen server. They also
+// force a net update, the player state's profile keeps it dormant in between
+
+void ANetworkShooterPlayerState::SetHealth(float NewHealth)
+{
+	const float OldHealth = Health;
+
+	Health = NewHealth;
+	MARK_PROPERTY_DIRTY_FROM_NAME(ANetworkShooterPlayerState, Health, this);
+	ForceNetUpdate();
+	PublishHealthChange(OldHealth);
+}
+
+void ANetworkShooterPlayerState::SetDeaths(uint8 NewDeaths)
+{
+	Deaths = NewDeaths;
+	MARK_PROPERTY_DIRTY_FROM_NAME(ANetworkShooterPlayerState, Deaths, this);
+	ForceNetUpdate();
+	PublishChange(false);
+}
+
+void ANetworkShooterPlayerState::SetTeam(ETeam NewTeam)
+{
+	Team = NewTeam;
+	bHasTeam = true;
+	MARK_PROPERTY_DIRTY_FROM_NAME(ANetworkShooterPlayerState, Team, this);
+	ForceNetUpdate();
+	PublishChange(true);
+}
+
+void ANetworkShooterPlayerState::AddScore(float Delta)
+{
+	SetScore(GetScore() + Delta);
+	ForceNetUpdate();
+	PublishChange(false);
+}
+
+void ANetworkShooterPlayerState::SetPlayerName(const FString& S)
+{
+	Super::SetPlayerName(S);
+	ForceNetUpdate();
+	PublishChange(true);
+}
+
+void ANetworkShooterPlayerState::OnRep_Score()
+{
+	Super::OnRep_Score();
+	PublishChange(false);
+}
+
+void ANetworkShooterPlayerState::OnRep_PlayerName()
+{
+	Super::OnRep_PlayerName();
+	PublishChange(true);
+}
+
+void ANetworkShooterPlayerState::OnRep_Health(float OldHealth)
+{
+	PublishHealthChange(OldHealth);
+}
+
+void ANetworkShooterPlayerState::OnRep_Deaths()
+{
+	PublishChange(false);
+}
+
+void ANetworkShooterPlayerState::OnRep_Team()
+{
+	PublishChange(true);
+}
+
+void ANetworkShooterPlayerState::PublishChange(bool bScoreboard)
+{
+	// Not there yet for the first replicated values, subscribers read everything when they bind
+	FNetworkShooterClientEvents* Events = FNetworkShooterClientEvents::Get(GetWorld());
+
+	if (Events == nullptr)
+	{
+		return;
+	}
+
+	Events->OnPlayerStatsChanged.Broadcast(this);
+
+	if (bScoreboard)
+	{
+		Events->OnScoreboardChanged.Broadcast();
+	}
+}
+
+void ANetworkShooterPlayerState::PublishHealthChange(float OldHealth)
+{
+	FNetworkShooterClientEvents* Events = FNetworkShooterClientEvents::Get(GetWorld());
+
+	if (Events != nullptr && OldHealth != Health)
+	{
+		Events->OnHealthChanged.Broadcast(this, OldHealth, Health);
+	}
+
+	PublishChange(false);
+}
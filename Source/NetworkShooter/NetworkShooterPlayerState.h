@@ -15,12 +15,48 @@ class NETWORKSHOOTER_API ANetworkShooterPlayerState : public APlayerState
 {
 	GENERATED_UCLASS_BODY()
 
-	UPROPERTY(Replicated)
+	// Replicated with push model, only write these through the setters below
+	UPROPERTY(ReplicatedUsing = OnRep_Health)
 	float Health;
 
-	UPROPERTY(Replicated)
+	UPROPERTY(ReplicatedUsing = OnRep_Deaths)
 	uint8 Deaths;
 	
-	UPROPERTY(Replicated)
+	UPROPERTY(ReplicatedUsing = OnRep_Team)
 	ETeam Team;
+
+	void SetHealth(float NewHealth);
+	void SetDeaths(uint8 NewDeaths);
+	void SetTeam(ETeam NewTeam);
+	void AddScore(float Delta);
+
+	// Whether the server has put this player on a team yet, carried over seamless travel with the team
+	bool HasTeam() const { return bHasTeam; }
+
+	virtual void SetPlayerName(const FString& S) override;
+	virtual void OnRep_Score() override;
+	virtual void OnRep_PlayerName() override;
+
+	virtual void PostInitializeComponents() override;
+
+	// Seamless travel copies into the next map's player state, keep the team and deaths along with the base's
+	virtual void CopyProperties(APlayerState* PlayerState) override;
+
+protected:
+	UFUNCTION()
+	void OnRep_Health(float OldHealth);
+
+	UFUNCTION()
+	void OnRep_Deaths();
+
+	UFUNCTION()
+	void OnRep_Team();
+
+private:
+	// Raises OnPlayerStatsChanged, and OnScoreboardChanged too for changes to names and teams
+	void PublishChange(bool bScoreboard);
+
+	void PublishHealthChange(float OldHealth);
+
+	bool bHasTeam;
 };
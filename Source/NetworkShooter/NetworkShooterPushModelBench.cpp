@@ -0,0 +1,271 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterPushModelBench.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterGameMode.h"
+#include "NetworkShooterReplicationGraph.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+// Frames the bots get to spawn, and the connections to receive everything they start with
+static const int32 PushModelBenchWaitFrames = 600;
+static const int32 PushModelBenchSettleFrames = 120;
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterPushModelBench::FRun
+
+void FNetworkShooterPushModelBench::FRun::Reset()
+{
+	Frames = 0;
+	Seconds = 0.0;
+	MaxSeconds = 0.0;
+}
+
+void FNetworkShooterPushModelBench::FRun::Add(double FrameSeconds)
+{
+	Frames++;
+	Seconds += FrameSeconds;
+	MaxSeconds = FMath::Max(MaxSeconds, FrameSeconds);
+}
+
+void FNetworkShooterPushModelBench::FRun::Log(const TCHAR* Label, int32 InNumConnections) const
+{
+	UE_LOG(LogNetworkShooter, Display, TEXT("PushModelBench: %s, %d connections: ServerReplicateActors avg %.3fms, max %.3fms over %d frames"),
+		Label, InNumConnections, Frames > 0 ? Seconds * 1000.0 / Frames : 0.0, MaxSeconds * 1000.0, Frames);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterPushModelBench
+
+FNetworkShooterPushModelBench::FNetworkShooterPushModelBench()
+	: Phase(EPhase::Idle)
+	, NumConnections(0)
+	, FramesPerRun(0)
+	, PhaseFrames(0)
+	, PhaseStartFrame(0)
+	, LastSampledFrame(0)
+	, bWasPushModelEnabled(false)
+{
+	PushModelOn.Reset();
+	PushModelOff.Reset();
+}
+
+void FNetworkShooterPushModelBench::Start(ANetworkShooterGameMode* GameMode, int32 InNumConnections, int32 NumBots, int32 InFramesPerRun)
+{
+	if (IsRunning())
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("PushModelBench: already running"));
+		return;
+	}
+
+	NumConnections = FMath::Max(InNumConnections, 1);
+	FramesPerRun = FMath::Max(InFramesPerRun, 1);
+
+	PushModelOn.Reset();
+	PushModelOff.Reset();
+
+	IConsoleVariable* PushModelVar = IConsoleManager::Get().FindConsoleVariable(TEXT("net.IsPushModelEnabled"));
+	bWasPushModelEnabled = PushModelVar != nullptr && PushModelVar->GetBool();
+
+	if (PushModelVar == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("PushModelBench: built without push model, both runs compare every property"));
+	}
+
+	for (int32 i = 0; i < NumBots; i++)
+	{
+		GameMode->AddBot();
+	}
+
+	BeginPhase(EPhase::WaitForCharacters);
+}
+
+void FNetworkShooterPushModelBench::Stop()
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+
+	CloseConnections();
+	SetPushModel(bWasPushModelEnabled);
+
+	Phase = EPhase::Idle;
+}
+
+void FNetworkShooterPushModelBench::BeginPhase(EPhase NewPhase)
+{
+	Phase = NewPhase;
+	PhaseFrames = 0;
+
+	// This frame's flush is the first to run under the new phase
+	PhaseStartFrame = GFrameCounter;
+}
+
+void FNetworkShooterPushModelBench::Tick(ANetworkShooterGameMode* GameMode)
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+
+	UNetDriver* NetDriver = GameMode->GetWorld()->GetNetDriver();
+	UNetworkShooterReplicationGraph* Graph = NetDriver ? Cast<UNetworkShooterReplicationGraph>(NetDriver->GetReplicationDriver()) : nullptr;
+
+	if (Graph == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("PushModelBench: needs a listen or dedicated server running the replication graph, not -NoRepGraph"));
+		Stop();
+		return;
+	}
+
+	PhaseFrames++;
+
+	switch (Phase)
+	{
+	case EPhase::WaitForCharacters:
+		if (GameMode->GetLivingCharacters().Num() >= NumConnections || PhaseFrames >= PushModelBenchWaitFrames)
+		{
+			if (!OpenConnections(GameMode))
+			{
+				Stop();
+				return;
+			}
+
+			BeginPhase(EPhase::Settle);
+		}
+		break;
+
+	case EPhase::Settle:
+		if (PhaseFrames >= PushModelBenchSettleFrames)
+		{
+			SetPushModel(true);
+			BeginPhase(EPhase::PushModelOn);
+		}
+		break;
+
+	case EPhase::PushModelOn:
+	case EPhase::PushModelOff:
+	{
+		// The game mode ticks before the flush, so what the graph has is the last frame's
+		if (Graph->GetLastReplicateFrame() >= PhaseStartFrame && Graph->GetLastReplicateFrame() != LastSampledFrame)
+		{
+			FRun& Run = Phase == EPhase::PushModelOn ? PushModelOn : PushModelOff;
+
+			Run.Add(Graph->GetLastReplicateSeconds());
+			LastSampledFrame = Graph->GetLastReplicateFrame();
+
+			if (Run.Frames >= FramesPerRun)
+			{
+				if (Phase == EPhase::PushModelOn)
+				{
+					SetPushModel(false);
+					BeginPhase(EPhase::PushModelOff);
+				}
+				else
+				{
+					PushModelOn.Log(TEXT("push model on"), Connections.Num());
+					PushModelOff.Log(TEXT("push model off"), Connections.Num());
+					Stop();
+				}
+			}
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+bool FNetworkShooterPushModelBench::OpenConnections(ANetworkShooterGameMode* GameMode)
+{
+	UWorld* World = GameMode->GetWorld();
+	UNetDriver* NetDriver = World->GetNetDriver();
+
+	const TArray<ANetworkShooterCharacter*>& Characters = GameMode->GetLivingCharacters();
+
+	if (Characters.Num() == 0)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("PushModelBench: no living characters to view the game from"));
+		return false;
+	}
+
+	for (int32 i = 0; i < NumConnections; i++)
+	{
+		USimulatedClientNetConnection* Connection = NewObject<USimulatedClientNetConnection>();
+		Connection->InitConnection(NetDriver, USOCK_Open, World->URL, 1000000);
+		Connection->InitSendBuffer();
+
+		// Without a player controller the replication graph views the game from the owning actor,
+		// spread over the characters so the grid gathers around all of them
+		Connection->OwningActor = Characters[i % Characters.Num()];
+
+		NetDriver->AddClientConnection(Connection);
+		Connections.Add(Connection);
+	}
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("PushModelBench: %d simulated connections viewing %d characters"), NumConnections, Characters.Num());
+
+	return true;
+}
+
+void FNetworkShooterPushModelBench::CloseConnections()
+{
+	// The net driver cleans closed connections up on its next tick
+	for (const TWeakObjectPtr<UNetConnection>& Connection : Connections)
+	{
+		if (Connection.IsValid())
+		{
+			Connection->Close();
+		}
+	}
+
+	Connections.Reset();
+}
+
+bool FNetworkShooterPushModelBench::SetPushModel(bool bEnabled)
+{
+	IConsoleVariable* PushModelVar = IConsoleManager::Get().FindConsoleVariable(TEXT("net.IsPushModelEnabled"));
+
+	if (PushModelVar == nullptr)
+	{
+		return false;
+	}
+
+	PushModelVar->Set(bEnabled ? 1 : 0, ECVF_SetByConsole);
+
+	return true;
+}
+
+static void RunPushModelBench(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("ns.Net.PushModelBench only works on the server"));
+		return;
+	}
+
+	if (Args.Num() > 0 && Args[0] == TEXT("Stop"))
+	{
+		GameMode->GetPushModelBench().Stop();
+		return;
+	}
+
+	const int32 NumConnections = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 100;
+	const int32 NumBots = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : NumConnections;
+	const int32 Frames = Args.Num() > 2 ? FCString::Atoi(*Args[2]) : 600;
+
+	GameMode->GetPushModelBench().Start(GameMode, NumConnections, NumBots, Frames);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs PushModelBenchCommand(
+	TEXT("ns.Net.PushModelBench"),
+	TEXT("Adds bots and simulated client connections, then times the replication graph's ServerReplicateActors with net.IsPushModelEnabled on and off. Usage: ns.Net.PushModelBench [Connections=100] [Bots=Connections] [Frames=600] | Stop"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunPushModelBench));
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ANetworkShooterGameMode;
+class UNetConnection;
+
+/**
+ * Server replication cost with push model on and off, see ns.Net.PushModelBench. Adds bots, waits
+ * for them to spawn, then opens simulated client connections that each view one of the living
+ * characters. Once the connections' initial replication has gone out, the replication graph's
+ * ServerReplicateActors is timed for the same number of frames with net.IsPushModelEnabled on and
+ * then off, and both are logged. The connections are closed again at the end, the bots stay.
+ */
+class NETWORKSHOOTER_API FNetworkShooterPushModelBench
+{
+public:
+	FNetworkShooterPushModelBench();
+
+	void Start(ANetworkShooterGameMode* GameMode, int32 InNumConnections, int32 NumBots, int32 InFramesPerRun);
+	void Stop();
+
+	bool IsRunning() const { return Phase != EPhase::Idle; }
+
+	// Called every server tick by the game mode
+	void Tick(ANetworkShooterGameMode* GameMode);
+
+private:
+	enum class EPhase : uint8
+	{
+		Idle,
+		WaitForCharacters,
+		Settle,
+		PushModelOn,
+		PushModelOff,
+	};
+
+	struct FRun
+	{
+		int32 Frames;
+		double Seconds;
+		double MaxSeconds;
+
+		void Reset();
+		void Add(double FrameSeconds);
+		void Log(const TCHAR* Label, int32 NumConnections) const;
+	};
+
+	void BeginPhase(EPhase NewPhase);
+
+	// Simulated connections drop everything sent, they cost the server all the same
+	bool OpenConnections(ANetworkShooterGameMode* GameMode);
+	void CloseConnections();
+
+	// False when the binaries were built without push model, where the cvar doesn't exist
+	bool SetPushModel(bool bEnabled);
+
+	EPhase Phase;
+	int32 NumConnections;
+	int32 FramesPerRun;
+	int32 PhaseFrames;
+
+	// Flushes of the replication graph before this frame ran under the last phase
+	uint64 PhaseStartFrame;
+	uint64 LastSampledFrame;
+
+	// net.IsPushModelEnabled as it was before the bench, put back at the end
+	bool bWasPushModelEnabled;
+
+	TArray<TWeakObjectPtr<UNetConnection>> Connections;
+
+	FRun PushModelOn;
+	FRun PushModelOff;
+};
@@ -0,0 +1,245 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterRagdollManager.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterFrameBudget.h"
+#include "NSGameState.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "TimerManager.h"
+
+static TAutoConsoleVariable<int32> CVarRagdollMaxSimulated(
+	TEXT("ns.Ragdoll.MaxSimulated"),
+	8,
+	TEXT("Most ragdolls simulating at once, later deaths play a death animation."));
+
+static TAutoConsoleVariable<float> CVarRagdollMaxDistance(
+	TEXT("ns.Ragdoll.MaxDistance"),
+	5000.0f,
+	TEXT("Deaths further than this from the local view play a death animation instead of a ragdoll, 0 disables."));
+
+static TAutoConsoleVariable<float> CVarRagdollSleepDelay(
+	TEXT("ns.Ragdoll.SleepDelay"),
+	2.0f,
+	TEXT("Seconds a ragdoll simulates before it is frozen and its slot is freed, once it has come to rest."));
+
+static TAutoConsoleVariable<float> CVarRagdollSleepSpeed(
+	TEXT("ns.Ragdoll.SleepSpeed"),
+	20.0f,
+	TEXT("Speed in cm/s under which a ragdoll counts as at rest and can be frozen."));
+
+static TAutoConsoleVariable<float> CVarRagdollMaxSimulateTime(
+	TEXT("ns.Ragdoll.MaxSimulateTime"),
+	6.0f,
+	TEXT("Seconds after which a ragdoll is frozen even if it is still moving, so the cap holds."));
+
+static TAutoConsoleVariable<int32> CVarRagdollServerCollision(
+	TEXT("ns.Ragdoll.ServerCollision"),
+	0,
+	TEXT("0: dead bodies have no mesh collision on a dedicated server. 1: the mesh keeps ragdoll collision without simulating."));
+
+FNetworkShooterRagdollManager::FNetworkShooterRagdollManager()
+	: PeakSimulated(0)
+	, Ragdolls(0)
+	, OverBudget(0)
+	, DistanceCulled(0)
+	, ServerDeaths(0)
+	, SleptEarly(0)
+	, FrozenMoving(0)
+{
+}
+
+void FNetworkShooterRagdollManager::StartDeath(ANetworkShooterCharacter* Character)
+{
+	UWorld* World = Character->GetWorld();
+	USkeletalMeshComponent* thisMesh = Character->GetMesh();
+
+	// Nobody watches a dedicated server, and lag compensation ignores the dead anyway
+	if (World->GetNetMode() == NM_DedicatedServer)
+	{
+		if (CVarRagdollServerCollision.GetValueOnGameThread() != 0)
+		{
+			thisMesh->SetCollisionProfileName("Ragdoll");
+		}
+		else
+		{
+			thisMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		}
+
+		ServerDeaths++;
+		return;
+	}
+
+	const float MaxDistance = CVarRagdollMaxDistance.GetValueOnGameThread();
+	APlayerController* thisCont = World->GetFirstPlayerController();
+
+	if (MaxDistance > 0.0f && thisCont != nullptr)
+	{
+		FVector ViewLocation;
+		FRotator ViewRotation;
+		thisCont->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+		if (FVector::DistSquared(ViewLocation, Character->GetActorLocation()) > FMath::Square(MaxDistance))
+		{
+			DistanceCulled++;
+			PlayDeathAnimation(Character);
+			return;
+		}
+	}
+
+	// Drop anything that was destroyed without telling us
+	Simulated.RemoveAllSwap([](const FSimulatedBody& Body) { return !Body.Character.IsValid(); });
+
+	if (Simulated.Num() >= CVarRagdollMaxSimulated.GetValueOnGameThread())
+	{
+		OverBudget++;
+		PlayDeathAnimation(Character);
+		return;
+	}
+
+	StartRagdoll(Character);
+}
+
+void FNetworkShooterRagdollManager::StartRagdoll(ANetworkShooterCharacter* Character)
+{
+	USkeletalMeshComponent* thisMesh = Character->GetMesh();
+
+	thisMesh->SetPhysicsBlendWeight(1.0f);
+	thisMesh->SetSimulatePhysics(true);
+	thisMesh->SetCollisionProfileName("Ragdoll");
+
+	// A pawn that died again before its last ragdoll froze keeps one slot and starts over
+	Remove(Character);
+
+	FSimulatedBody& Body = Simulated.AddDefaulted_GetRef();
+	Body.Character = Character;
+	Body.StartTime = Character->GetWorld()->GetTimeSeconds();
+
+	PeakSimulated = FMath::Max(PeakSimulated, Simulated.Num());
+	Ragdolls++;
+
+	SET_DWORD_STAT(STAT_NS_SimulatedRagdolls, Simulated.Num());
+
+	SetSleepTimer(Character, Body.SleepTimer, CVarRagdollSleepDelay.GetValueOnGameThread());
+}
+
+void FNetworkShooterRagdollManager::SetSleepTimer(ANetworkShooterCharacter* Character, FTimerHandle& Timer, float Delay)
+{
+	AActor* OwnerActor = Owner.Get();
+
+	if (OwnerActor == nullptr)
+	{
+		return;
+	}
+
+	// The owner holds this manager, so it is still around whenever the timer fires
+	TWeakObjectPtr<ANetworkShooterCharacter> WeakCharacter = Character;
+
+	OwnerActor->GetWorldTimerManager().SetTimer(Timer, FTimerDelegate::CreateWeakLambda(OwnerActor, [this, WeakCharacter]()
+	{
+		if (ANetworkShooterCharacter* thisChar = WeakCharacter.Get())
+		{
+			Sleep(thisChar);
+		}
+	}), FMath::Max(Delay, 0.01f), false);
+}
+
+void FNetworkShooterRagdollManager::PlayDeathAnimation(ANetworkShooterCharacter* Character)
+{
+	INC_DWORD_STAT(STAT_NS_DeathAnimations);
+
+	const TArray<UAnimationAsset*>& Animations = Character->DeathAnimations;
+
+	if (Animations.Num() == 0)
+	{
+		return;
+	}
+
+	UAnimationAsset* Animation = Animations[FMath::RandHelper(Animations.Num())];
+
+	if (Animation != nullptr)
+	{
+		// Switches the mesh to single node animation, ResetRagdoll puts the blueprint back
+		Character->GetMesh()->PlayAnimation(Animation, false);
+	}
+}
+
+void FNetworkShooterRagdollManager::Sleep(ANetworkShooterCharacter* Character)
+{
+	const int32 Index = Simulated.IndexOfByPredicate([Character](const FSimulatedBody& Body) { return Body.Character == Character; });
+
+	// Already brought back from the pool
+	if (Index == INDEX_NONE)
+	{
+		return;
+	}
+
+	USkeletalMeshComponent* thisMesh = Character->GetMesh();
+	FSimulatedBody& Body = Simulated[Index];
+
+	const bool bAtRest = thisMesh->GetPhysicsLinearVelocity().SizeSquared() <= FMath::Square(CVarRagdollSleepSpeed.GetValueOnGameThread());
+	const bool bOutOfTime = Character->GetWorld()->GetTimeSeconds() - Body.StartTime >= CVarRagdollMaxSimulateTime.GetValueOnGameThread();
+
+	// Still falling or sliding, look again shortly instead of freezing it in mid-air
+	if (!bAtRest && !bOutOfTime)
+	{
+		SetSleepTimer(Character, Body.SleepTimer, 0.25f);
+		return;
+	}
+
+	// Sleeping bodies wake on the next hit and simulate outside the cap. Without the mesh tick the
+	// now kinematic bodies aren't moved back to the animated pose, so the body keeps where it fell
+	thisMesh->SetComponentTickEnabled(false);
+	thisMesh->SetSimulatePhysics(false);
+
+	(bAtRest ? SleptEarly : FrozenMoving)++;
+
+	Simulated.RemoveAtSwap(Index);
+
+	SET_DWORD_STAT(STAT_NS_SimulatedRagdolls, Simulated.Num());
+}
+
+void FNetworkShooterRagdollManager::Remove(ANetworkShooterCharacter* Character)
+{
+	const int32 Index = Simulated.IndexOfByPredicate([Character](const FSimulatedBody& Body) { return Body.Character == Character; });
+
+	if (Index == INDEX_NONE)
+	{
+		return;
+	}
+
+	// Or it would fire on the pawn's next life
+	if (AActor* OwnerActor = Owner.Get())
+	{
+		OwnerActor->GetWorldTimerManager().ClearTimer(Simulated[Index].SleepTimer);
+	}
+
+	Simulated.RemoveAtSwap(Index);
+
+	SET_DWORD_STAT(STAT_NS_SimulatedRagdolls, Simulated.Num());
+}
+
+void FNetworkShooterRagdollManager::LogStats() const
+{
+	UE_LOG(LogNetworkShooter, Display, TEXT("Ragdolls: %d simulating now (peak %d, cap %d), %d started, %d frozen at rest, %d frozen still moving, %d over budget and %d too far played a death animation, %d on the dedicated server"),
+		Simulated.Num(), PeakSimulated, CVarRagdollMaxSimulated.GetValueOnGameThread(), Ragdolls, SleptEarly, FrozenMoving, OverBudget, DistanceCulled, ServerDeaths);
+}
+
+static void LogRagdollStats(const TArray<FString>& Args, UWorld* World)
+{
+	ANSGameState* thisGameState = World ? World->GetGameState<ANSGameState>() : nullptr;
+
+	if (thisGameState != nullptr)
+	{
+		thisGameState->GetRagdolls().LogStats();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs RagdollStatsCommand(
+	TEXT("ns.Ragdoll.Stats"),
+	TEXT("Logs simulated ragdolls against the cap and how many deaths fell back to an animation"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LogRagdollStats));
@@ -0,0 +1,62 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+
+class AActor;
+class ANetworkShooterCharacter;
+
+/**
+ * Decides how each death is shown, one per world. Up to ns.Ragdoll.MaxSimulated bodies
+ * simulate at once. After ns.Ragdoll.SleepDelay seconds a body that has come to rest is frozen
+ * in its pose with simulation off, which frees its slot, and ns.Ragdoll.MaxSimulateTime freezes
+ * it even if it is still moving. Deaths over the cap or further than ns.Ragdoll.MaxDistance from
+ * the local view play one of the character's death animations instead. A dedicated server
+ * never simulates.
+ */
+class NETWORKSHOOTER_API FNetworkShooterRagdollManager
+{
+public:
+	FNetworkShooterRagdollManager();
+
+	// Sleep timers are set on Owner's world and die with it
+	void SetOwner(AActor* InOwner) { Owner = InOwner; }
+
+	// Ragdoll or death animation for Character, run from its death multicast
+	void StartDeath(ANetworkShooterCharacter* Character);
+
+	// Frees Character's slot and drops its timer, for pawns going back to the pool or destroyed
+	void Remove(ANetworkShooterCharacter* Character);
+
+	int32 GetNumSimulated() const { return Simulated.Num(); }
+
+	void LogStats() const;
+
+private:
+	void StartRagdoll(ANetworkShooterCharacter* Character);
+	void PlayDeathAnimation(ANetworkShooterCharacter* Character);
+	void Sleep(ANetworkShooterCharacter* Character);
+	void SetSleepTimer(ANetworkShooterCharacter* Character, FTimerHandle& Timer, float Delay);
+
+	TWeakObjectPtr<AActor> Owner;
+
+	struct FSimulatedBody
+	{
+		TWeakObjectPtr<ANetworkShooterCharacter> Character;
+		FTimerHandle SleepTimer;
+		double StartTime;
+	};
+
+	// Bodies currently simulating, never more than the cap
+	TArray<FSimulatedBody> Simulated;
+
+	int32 PeakSimulated;
+	int32 Ragdolls;
+	int32 OverBudget;
+	int32 DistanceCulled;
+	int32 ServerDeaths;
+	int32 SleptEarly;
+	int32 FrozenMoving;
+};
@@ -0,0 +1,315 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterReplicationGraph.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterNetProfiles.h"
+#include "NetworkShooterPlayerState.h"
+#include "NSGameState.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "GameFramework/PlayerController.h"
+#include "Misc/CommandLine.h"
+#include "UObject/UObjectIterator.h"
+
+//////////////////////////////////////////////////////////////////////////
+// UNetworkShooterReplicationGraphNode_TeamPlayerStates
+
+UNetworkShooterReplicationGraphNode_TeamPlayerStates::UNetworkShooterReplicationGraphNode_TeamPlayerStates()
+	: EnemyPeriodFrames(10)
+{
+	bRequiresPrepareForReplicationCall = true;
+}
+
+void UNetworkShooterReplicationGraphNode_TeamPlayerStates::NotifyAddNetworkActor(const FNewReplicatedActorInfo& ActorInfo)
+{
+	PlayerStates.AddUnique(ActorInfo.Actor);
+}
+
+bool UNetworkShooterReplicationGraphNode_TeamPlayerStates::NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo, bool bWarnIfNotFound)
+{
+	const bool bRemoved = PlayerStates.RemoveSwap(ActorInfo.Actor) > 0;
+
+	if (!bRemoved && bWarnIfNotFound)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("Player state %s was not in the team node"), *GetNameSafe(ActorInfo.Actor));
+	}
+
+	return bRemoved;
+}
+
+void UNetworkShooterReplicationGraphNode_TeamPlayerStates::NotifyResetAllNetworkActors()
+{
+	PlayerStates.Reset();
+	RedList.Reset();
+	BlueList.Reset();
+}
+
+void UNetworkShooterReplicationGraphNode_TeamPlayerStates::PrepareForReplication()
+{
+	RedList.Reset();
+	BlueList.Reset();
+
+	for (const TWeakObjectPtr<AActor>& Actor : PlayerStates)
+	{
+		ANetworkShooterPlayerState* thisPS = Cast<ANetworkShooterPlayerState>(Actor.Get());
+
+		if (thisPS != nullptr)
+		{
+			if (thisPS->Team == ETeam::RED_TEAM)
+			{
+				RedList.Add(thisPS);
+			}
+			else
+			{
+				BlueList.Add(thisPS);
+			}
+		}
+	}
+}
+
+void UNetworkShooterReplicationGraphNode_TeamPlayerStates::GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params)
+{
+	APlayerController* ViewerPC = Params.ConnectionManager.NetConnection ? Params.ConnectionManager.NetConnection->PlayerController : nullptr;
+	ANetworkShooterPlayerState* ViewerPS = ViewerPC ? ViewerPC->GetPlayerState<ANetworkShooterPlayerState>() : nullptr;
+
+	const bool bViewerRed = ViewerPS != nullptr && ViewerPS->Team == ETeam::RED_TEAM;
+
+	const FActorRepListRefView& TeamList = bViewerRed ? RedList : BlueList;
+	const FActorRepListRefView& EnemyList = bViewerRed ? BlueList : RedList;
+
+	if (TeamList.Num() > 0)
+	{
+		Params.OutGatheredReplicationLists.AddReplicationActorList(TeamList);
+	}
+
+	// Channels stay open in between, see ActorChannelFrameTimeout in InitGlobalActorClassSettings
+	if (EnemyList.Num() > 0 && Params.ReplicationFrameNum % FMath::Max(EnemyPeriodFrames, 1) == 0)
+	{
+		Params.OutGatheredReplicationLists.AddReplicationActorList(EnemyList);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UNetworkShooterReplicationGraph
+
+UNetworkShooterReplicationGraph::UNetworkShooterReplicationGraph()
+	: GridCellSize(10000.0f)
+	, EnemyPlayerStatePeriodFrames(10)
+	, GridNode(nullptr)
+	, AlwaysRelevantNode(nullptr)
+	, PlayerStateNode(nullptr)
+	, LastReplicateSeconds(0.0)
+	, LastReplicateFrame(0)
+{
+}
+
+void UNetworkShooterReplicationGraph::RegisterReplicationDriver()
+{
+	UReplicationDriver::CreateReplicationDriverDelegate().BindLambda([](UNetDriver* ForNetDriver, const FURL& URL, UWorld* World) -> UReplicationDriver*
+	{
+		// Demo and beacon drivers keep the default behaviour
+		if (ForNetDriver->NetDriverName != NAME_GameNetDriver || FParse::Param(FCommandLine::Get(), TEXT("NoRepGraph")))
+		{
+			return nullptr;
+		}
+
+		return NewObject<UNetworkShooterReplicationGraph>(GetTransientPackage());
+	});
+}
+
+void UNetworkShooterReplicationGraph::InitGlobalActorClassSettings()
+{
+	Super::InitGlobalActorClassSettings();
+
+	// The graph works in frames, convert every replicated class's update rate and cull distance
+	for (TObjectIterator<UClass> It; It; ++It)
+	{
+		UClass* Class = *It;
+		AActor* ActorCDO = Cast<AActor>(Class->GetDefaultObject());
+
+		if (ActorCDO == nullptr || !ActorCDO->GetIsReplicated())
+		{
+			continue;
+		}
+
+		// Skip blueprint compile leftovers
+		if (Class->GetName().StartsWith(TEXT("SKEL_")) || Class->GetName().StartsWith(TEXT("REINST_")))
+		{
+			continue;
+		}
+
+		const FNetworkShooterNetProfile* Profile = UNetworkShooterNetProfiles::Find(Class);
+
+		FClassReplicationInfo ClassInfo;
+		ClassInfo.ReplicationPeriodFrame = GetReplicationPeriodFrameForFrequency(Profile ? Profile->NetUpdateFrequency : ActorCDO->NetUpdateFrequency);
+
+		if (ActorCDO->bAlwaysRelevant || ActorCDO->bOnlyRelevantToOwner)
+		{
+			ClassInfo.SetCullDistanceSquared(0.0f);
+		}
+		else
+		{
+			ClassInfo.SetCullDistanceSquared(ActorCDO->NetCullDistanceSquared);
+		}
+
+		GlobalActorReplicationInfoMap.SetClassInfo(Class, ClassInfo);
+	}
+
+	// Enemy player states skip frames on purpose, don't let their channels time out in between
+	const FNetworkShooterNetProfile* PlayerStateProfile = UNetworkShooterNetProfiles::Find(ANetworkShooterPlayerState::StaticClass());
+
+	FClassReplicationInfo PlayerStateInfo;
+	PlayerStateInfo.ReplicationPeriodFrame = GetReplicationPeriodFrameForFrequency(PlayerStateProfile ? PlayerStateProfile->NetUpdateFrequency : GetDefault<ANetworkShooterPlayerState>()->NetUpdateFrequency);
+	PlayerStateInfo.DistancePriorityScale = 0.0f;
+	PlayerStateInfo.ActorChannelFrameTimeout = 0;
+	GlobalActorReplicationInfoMap.SetClassInfo(ANetworkShooterPlayerState::StaticClass(), PlayerStateInfo);
+}
+
+void UNetworkShooterReplicationGraph::InitGlobalGraphNodes()
+{
+	GridNode = CreateNewNode<UReplicationGraphNode_GridSpatialization2D>();
+	GridNode->CellSize = GridCellSize;
+	GridNode->SpatialBias = FVector2D(-WORLD_MAX, -WORLD_MAX);
+	AddGlobalGraphNode(GridNode);
+
+	AlwaysRelevantNode = CreateNewNode<UReplicationGraphNode_ActorList>();
+	AddGlobalGraphNode(AlwaysRelevantNode);
+
+	PlayerStateNode = CreateNewNode<UNetworkShooterReplicationGraphNode_TeamPlayerStates>();
+	PlayerStateNode->EnemyPeriodFrames = EnemyPlayerStatePeriodFrames;
+	AddGlobalGraphNode(PlayerStateNode);
+}
+
+void UNetworkShooterReplicationGraph::InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection)
+{
+	Super::InitConnectionGraphNodes(RepGraphConnection);
+
+	UReplicationGraphNode_AlwaysRelevant_ForConnection* ConnectionNode = CreateNewNode<UReplicationGraphNode_AlwaysRelevant_ForConnection>();
+
+	// Needs to know which streaming levels the client has loaded
+	RepGraphConnection->OnClientVisibleLevelNameAdd.AddUObject(ConnectionNode, &UReplicationGraphNode_AlwaysRelevant_ForConnection::OnClientLevelVisibilityAdd);
+	RepGraphConnection->OnClientVisibleLevelNameRemove.AddUObject(ConnectionNode, &UReplicationGraphNode_AlwaysRelevant_ForConnection::OnClientLevelVisibilityRemove);
+
+	AddConnectionGraphNode(ConnectionNode, RepGraphConnection);
+
+	AlwaysRelevantForConnection.Add(RepGraphConnection->NetConnection, ConnectionNode);
+}
+
+void UNetworkShooterReplicationGraph::RemoveClientConnection(UNetConnection* NetConnection)
+{
+	AlwaysRelevantForConnection.Remove(NetConnection);
+
+	Super::RemoveClientConnection(NetConnection);
+}
+
+UReplicationGraphNode_AlwaysRelevant_ForConnection* UNetworkShooterReplicationGraph::GetAlwaysRelevantNodeForConnection(UNetConnection* Connection)
+{
+	UReplicationGraphNode_AlwaysRelevant_ForConnection** Node = Connection ? AlwaysRelevantForConnection.Find(Connection) : nullptr;
+
+	return Node ? *Node : nullptr;
+}
+
+void UNetworkShooterReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo)
+{
+	AActor* Actor = ActorInfo.Actor;
+
+	if (Actor->IsA<ANetworkShooterPlayerState>())
+	{
+		PlayerStateNode->NotifyAddNetworkActor(ActorInfo);
+	}
+	else if (Actor->IsA<ANetworkShooterCharacter>())
+	{
+		// Characters move every frame, skip the dormancy bookkeeping
+		GridNode->AddActor_Dynamic(ActorInfo, GlobalInfo);
+	}
+	else if (Actor->bAlwaysRelevant || Actor->IsA<ANSGameState>())
+	{
+		AlwaysRelevantNode->NotifyAddNetworkActor(ActorInfo);
+	}
+	else if (Actor->bOnlyRelevantToOwner)
+	{
+		ActorsWithoutNetConnection.Add(Actor);
+	}
+	else
+	{
+		// Dynamic while awake, static once dormant
+		GridNode->AddActor_Dormancy(ActorInfo, GlobalInfo);
+	}
+}
+
+void UNetworkShooterReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
+{
+	AActor* Actor = ActorInfo.Actor;
+
+	if (Actor->IsA<ANetworkShooterPlayerState>())
+	{
+		PlayerStateNode->NotifyRemoveNetworkActor(ActorInfo);
+	}
+	else if (Actor->IsA<ANetworkShooterCharacter>())
+	{
+		GridNode->RemoveActor_Dynamic(ActorInfo);
+	}
+	else if (Actor->bAlwaysRelevant || Actor->IsA<ANSGameState>())
+	{
+		AlwaysRelevantNode->NotifyRemoveNetworkActor(ActorInfo);
+		SetActorDestructionInfoToIgnoreDistanceCulling(Actor);
+	}
+	else if (Actor->bOnlyRelevantToOwner)
+	{
+		ActorsWithoutNetConnection.Remove(Actor);
+
+		if (UReplicationGraphNode_AlwaysRelevant_ForConnection* Node = GetAlwaysRelevantNodeForConnection(Actor->GetNetConnection()))
+		{
+			Node->NotifyRemoveNetworkActor(ActorInfo);
+		}
+	}
+	else
+	{
+		GridNode->RemoveActor_Dormancy(ActorInfo);
+	}
+}
+
+int32 UNetworkShooterReplicationGraph::ServerReplicateActors(float DeltaSeconds)
+{
+	// Hand owner only actors to their connection's node once they have one
+	for (int32 i = ActorsWithoutNetConnection.Num() - 1; i >= 0; i--)
+	{
+		AActor* Actor = ActorsWithoutNetConnection[i];
+		bool bRemove = Actor == nullptr;
+
+		if (Actor != nullptr)
+		{
+			if (UNetConnection* Connection = Actor->GetNetConnection())
+			{
+				bRemove = true;
+
+				if (UReplicationGraphNode_AlwaysRelevant_ForConnection* Node = GetAlwaysRelevantNodeForConnection(Connection))
+				{
+					Node->NotifyAddNetworkActor(FNewReplicatedActorInfo(Actor));
+				}
+			}
+		}
+
+		if (bRemove)
+		{
+			ActorsWithoutNetConnection.RemoveAtSwap(i, 1, false);
+		}
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	const int32 NumReplicated = Super::ServerReplicateActors(DeltaSeconds);
+
+	LastReplicateSeconds = FPlatformTime::Seconds() - StartTime;
+	LastReplicateFrame = GFrameCounter;
+
+	return NumReplicated;
+}
+
+bool UNetworkShooterReplicationGraph::WasReplicatedThisFrame(AActor* Actor)
+{
+	FGlobalActorReplicationInfo* GlobalInfo = GlobalActorReplicationInfoMap.Find(Actor);
+
+	return GlobalInfo != nullptr && GlobalInfo->LastPreReplicationFrame == ReplicationGraphFrame;
+}
@@ -0,0 +1,107 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicationGraph.h"
+#include "NetworkShooterReplicationGraph.generated.h"
+
+class UReplicationGraphNode_ActorList;
+class UReplicationGraphNode_AlwaysRelevant_ForConnection;
+class UReplicationGraphNode_GridSpatialization2D;
+
+/**
+ * Player states for everyone, split by team. A connection gets its own team's player states
+ * every frame and the other team's only every EnemyPeriodFrames, since the scoreboard is all
+ * it uses them for.
+ */
+UCLASS()
+class NETWORKSHOOTER_API UNetworkShooterReplicationGraphNode_TeamPlayerStates : public UReplicationGraphNode
+{
+	GENERATED_BODY()
+
+public:
+	UNetworkShooterReplicationGraphNode_TeamPlayerStates();
+
+	virtual void NotifyAddNetworkActor(const FNewReplicatedActorInfo& ActorInfo) override;
+	virtual bool NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo, bool bWarnIfNotFound = true) override;
+	virtual void NotifyResetAllNetworkActors() override;
+	virtual void PrepareForReplication() override;
+	virtual void GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params) override;
+
+	int32 EnemyPeriodFrames;
+
+private:
+	TArray<TWeakObjectPtr<AActor>> PlayerStates;
+
+	// Rebuilt from PlayerStates once per frame, teams can change at any time
+	FActorRepListRefView RedList;
+	FActorRepListRefView BlueList;
+};
+
+/**
+ * Replication graph for the game, replaces the net driver's per connection relevancy loop:
+ *
+ *   ANetworkShooterCharacter and other spatial actors     2D grid
+ *   ANSGameState and other always relevant actors         one global list
+ *   ANetworkShooterPlayerState                            per team node above
+ *   Owner only actors (player controllers)                per connection list
+ *
+ * Spawn points don't replicate and are never routed. Class rates come from the net profiles
+ * in Game.ini where there is one. Start with -NoRepGraph to fall back to the legacy relevancy
+ * loop for comparison.
+ */
+UCLASS(transient, config=Engine)
+class NETWORKSHOOTER_API UNetworkShooterReplicationGraph : public UReplicationGraph
+{
+	GENERATED_BODY()
+
+public:
+	UNetworkShooterReplicationGraph();
+
+	virtual void InitGlobalActorClassSettings() override;
+	virtual void InitGlobalGraphNodes() override;
+	virtual void InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection) override;
+	virtual void RemoveClientConnection(UNetConnection* NetConnection) override;
+	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
+	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+	virtual int32 ServerReplicateActors(float DeltaSeconds) override;
+
+	// Creates the graph for the game net driver unless -NoRepGraph was given
+	static void RegisterReplicationDriver();
+
+	// Whether the graph ran PreReplication for Actor in the frame it last replicated, for ns.Net.RelevancyReport
+	bool WasReplicatedThisFrame(AActor* Actor);
+
+	// How long the last ServerReplicateActors took, property compares included, and the frame it ran in. For ns.Net.PushModelBench
+	double GetLastReplicateSeconds() const { return LastReplicateSeconds; }
+	uint64 GetLastReplicateFrame() const { return LastReplicateFrame; }
+
+	UPROPERTY(config)
+	float GridCellSize;
+
+	UPROPERTY(config)
+	int32 EnemyPlayerStatePeriodFrames;
+
+	UPROPERTY()
+	UReplicationGraphNode_GridSpatialization2D* GridNode;
+
+	UPROPERTY()
+	UReplicationGraphNode_ActorList* AlwaysRelevantNode;
+
+	UPROPERTY()
+	UNetworkShooterReplicationGraphNode_TeamPlayerStates* PlayerStateNode;
+
+private:
+	UReplicationGraphNode_AlwaysRelevant_ForConnection* GetAlwaysRelevantNodeForConnection(UNetConnection* Connection);
+
+	UPROPERTY()
+	TMap<UNetConnection*, UReplicationGraphNode_AlwaysRelevant_ForConnection*> AlwaysRelevantForConnection;
+
+	// Owner only actors wait here until they have a connection to be routed to
+	UPROPERTY()
+	TArray<AActor*> ActorsWithoutNetConnection;
+
+	double LastReplicateSeconds;
+	uint64 LastReplicateFrame;
+};
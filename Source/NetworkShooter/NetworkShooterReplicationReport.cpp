@@ -0,0 +1,141 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterReplicationReport.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterReplicationGraph.h"
+#include "Engine/NetDriver.h"
+#include "Engine/NetworkObjectList.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+FNetworkShooterReplicationReport& FNetworkShooterReplicationReport::Get()
+{
+	static FNetworkShooterReplicationReport Report;
+	return Report;
+}
+
+FNetworkShooterReplicationReport::FNetworkShooterReplicationReport()
+	: Ticks(0)
+	, TicksLeft(0)
+{
+}
+
+void FNetworkShooterReplicationReport::Start(UWorld* World, int32 NumTicks)
+{
+	Stop();
+
+	SampledWorld = World;
+	Ticks = FMath::Max(NumTicks, 1);
+	TicksLeft = Ticks;
+	Classes.Reset();
+
+	TickFlushHandle = World->OnPostTickFlush().AddRaw(this, &FNetworkShooterReplicationReport::Sample);
+}
+
+void FNetworkShooterReplicationReport::Stop()
+{
+	if (UWorld* World = SampledWorld.Get())
+	{
+		World->OnPostTickFlush().Remove(TickFlushHandle);
+	}
+
+	SampledWorld.Reset();
+	TickFlushHandle.Reset();
+}
+
+void FNetworkShooterReplicationReport::Sample(float DeltaSeconds)
+{
+	UWorld* World = SampledWorld.Get();
+	UNetDriver* Driver = World ? World->GetNetDriver() : nullptr;
+
+	if (Driver == nullptr || !Driver->IsServer())
+	{
+		Stop();
+		return;
+	}
+
+	UNetworkShooterReplicationGraph* Graph = Cast<UNetworkShooterReplicationGraph>(Driver->GetReplicationDriver());
+	const FNetworkObjectList& NetworkObjects = Driver->GetNetworkObjectList();
+
+	for (const TSharedPtr<FNetworkObjectInfo>& Info : NetworkObjects.GetAllObjects())
+	{
+		if (Info->Actor != nullptr)
+		{
+			Classes.FindOrAdd(Info->Actor->GetClass()->GetFName()).Actors++;
+		}
+	}
+
+	// Actors dormant on every connection drop out of the active list, the driver never looks at them
+	for (const TSharedPtr<FNetworkObjectInfo>& Info : NetworkObjects.GetActiveObjects())
+	{
+		AActor* Actor = Info->Actor;
+
+		if (Actor == nullptr)
+		{
+			continue;
+		}
+
+		FClassCounts& Counts = Classes.FindOrAdd(Actor->GetClass()->GetFName());
+		Counts.Considered++;
+
+		const bool bReplicated = Graph ? Graph->WasReplicatedThisFrame(Actor) : Info->LastNetReplicateTime == World->GetTimeSeconds();
+
+		if (bReplicated)
+		{
+			Counts.Replicated++;
+		}
+	}
+
+	if (--TicksLeft <= 0)
+	{
+		Log();
+		Stop();
+	}
+}
+
+void FNetworkShooterReplicationReport::Log() const
+{
+	TArray<FName> Names;
+	Classes.GenerateKeyArray(Names);
+
+	Names.Sort([this](const FName& A, const FName& B)
+	{
+		return Classes.FindChecked(A).Considered > Classes.FindChecked(B).Considered;
+	});
+
+	int64 TotalConsidered = 0;
+	int64 TotalReplicated = 0;
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Relevancy report over %d net ticks, per tick averages:"), Ticks);
+
+	for (const FName& Name : Names)
+	{
+		const FClassCounts& Counts = Classes.FindChecked(Name);
+
+		UE_LOG(LogNetworkShooter, Display, TEXT("  %-40s %7.1f actors %7.1f considered %7.1f replicated"), *Name.ToString(),
+			double(Counts.Actors) / Ticks, double(Counts.Considered) / Ticks, double(Counts.Replicated) / Ticks);
+
+		TotalConsidered += Counts.Considered;
+		TotalReplicated += Counts.Replicated;
+	}
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("  Total: %.1f considered, %.1f replicated (%.1f%%)"),
+		double(TotalConsidered) / Ticks, double(TotalReplicated) / Ticks, TotalConsidered > 0 ? 100.0 * TotalReplicated / TotalConsidered : 0.0);
+}
+
+static void RunRelevancyReport(const TArray<FString>& Args, UWorld* World)
+{
+	if (World == nullptr || World->GetNetDriver() == nullptr || !World->GetNetDriver()->IsServer())
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("ns.Net.RelevancyReport needs a listen or dedicated server"));
+		return;
+	}
+
+	FNetworkShooterReplicationReport::Get().Start(World, Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 300);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs RelevancyReportCommand(
+	TEXT("ns.Net.RelevancyReport"),
+	TEXT("Logs network actors considered versus actually replicated per tick, by class. Usage: ns.Net.RelevancyReport [Ticks=300]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunRelevancyReport));
@@ -0,0 +1,51 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UWorld;
+
+/**
+ * Server side sampler for ns.Net.RelevancyReport. After every net flush it counts, per actor
+ * class, the network actors that exist, the awake ones the net driver had to consider and the
+ * ones that actually replicated, then logs the per tick averages. Works with the replication
+ * graph and with -NoRepGraph.
+ */
+class NETWORKSHOOTER_API FNetworkShooterReplicationReport
+{
+public:
+	static FNetworkShooterReplicationReport& Get();
+
+	FNetworkShooterReplicationReport();
+
+	// Samples World's next NumTicks net ticks, restarting a report that is already running
+	void Start(UWorld* World, int32 NumTicks);
+
+private:
+	struct FClassCounts
+	{
+		FClassCounts()
+			: Actors(0)
+			, Considered(0)
+			, Replicated(0)
+		{
+		}
+
+		int64 Actors;
+		int64 Considered;
+		int64 Replicated;
+	};
+
+	void Sample(float DeltaSeconds);
+	void Stop();
+	void Log() const;
+
+	TWeakObjectPtr<UWorld> SampledWorld;
+	FDelegateHandle TickFlushHandle;
+
+	int32 Ticks;
+	int32 TicksLeft;
+
+	TMap<FName, FClassCounts> Classes;
+};
@@ -0,0 +1,125 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterShotTrace.h"
+
+#if NS_WITH_SHOT_TRACE
+
+#include "NetworkShooter.h"
+#include "NetworkShooterGameMode.h"
+#include "DrawDebugHelpers.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/DateTime.h"
+#include "Misc/Paths.h"
+#include "Serialization/Archive.h"
+
+static TAutoConsoleVariable<int32> CVarShotTrace(
+	TEXT("ns.ShotTrace"),
+	0,
+	TEXT("Record server shot traces.\n")
+	TEXT(" 0: off\n")
+	TEXT(" 1: record\n")
+	TEXT(" 2: record and draw each shot for a few seconds"));
+
+// Bumped whenever the record layout in the dump changes
+static const uint32 ShotTraceMagic = 0x4E535354; // 'NSST'
+static const uint32 ShotTraceVersion = 1;
+
+FNetworkShooterShotTrace::FNetworkShooterShotTrace()
+	: Head(0)
+	, Count(0)
+{
+}
+
+void FNetworkShooterShotTrace::Record(UWorld* World, const FVector& Origin, const FVector& End, const AActor* HitActor, float Time)
+{
+	const int32 Mode = CVarShotTrace.GetValueOnGameThread();
+
+	if (Mode <= 0)
+	{
+		return;
+	}
+
+	if (Records.Num() == 0)
+	{
+		Records.SetNumZeroed(Capacity);
+	}
+
+	FNetworkShooterShotRecord& Record = Records[Head];
+	Record.Origin = Origin;
+	Record.End = End;
+	Record.HitActor = HitActor != nullptr ? HitActor->GetFName() : NAME_None;
+	Record.Time = Time;
+
+	Head = (Head + 1) % Capacity;
+	Count = FMath::Min(Count + 1, Capacity);
+
+	if (Mode >= 2)
+	{
+		DrawDebugLine(World, Origin, End, HitActor != nullptr ? FColor::Green : FColor::Red, false, 5.0f, 0, 2.0f);
+	}
+}
+
+int32 FNetworkShooterShotTrace::Dump(const FString& Filename) const
+{
+	FArchive* Ar = IFileManager::Get().CreateFileWriter(*Filename);
+
+	if (Ar == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("Unable to open %s for the shot trace dump"), *Filename);
+		return 0;
+	}
+
+	uint32 Magic = ShotTraceMagic;
+	uint32 Version = ShotTraceVersion;
+	int32 NumRecords = Count;
+
+	*Ar << Magic << Version << NumRecords;
+
+	for (int32 i = 0; i < Count; i++)
+	{
+		FNetworkShooterShotRecord Record = Records[(Head + Capacity - Count + i) % Capacity];
+		FString HitActor = Record.HitActor.ToString();
+
+		*Ar << Record.Origin << Record.End << Record.Time << HitActor;
+	}
+
+	Ar->Close();
+	delete Ar;
+
+	return Count;
+}
+
+void FNetworkShooterShotTrace::Reset()
+{
+	Head = 0;
+	Count = 0;
+}
+
+static void DumpShotTrace(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode == nullptr)
+	{
+		UE_LOG(LogNetworkShooter, Warning, TEXT("ns.ShotTrace.Dump only works on the server"));
+		return;
+	}
+
+	const FString Filename = Args.Num() > 0 ? Args[0] :
+		FPaths::ProjectSavedDir() / TEXT("ShotTraces") / FString::Printf(TEXT("ShotTrace-%s.bin"), *FDateTime::Now().ToString());
+
+	const int32 NumWritten = GameMode->GetShotTrace().Dump(Filename);
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Wrote %d shots to %s"), NumWritten, *Filename);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs DumpShotTraceCommand(
+	TEXT("ns.ShotTrace.Dump"),
+	TEXT("Writes the recorded server shots to a binary file. Usage: ns.ShotTrace.Dump [Filename]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&DumpShotTrace));
+
+#endif // NS_WITH_SHOT_TRACE
@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Shot tracing is a development tool only, shipping builds compile it out entirely
+#ifndef NS_WITH_SHOT_TRACE
+#define NS_WITH_SHOT_TRACE !UE_BUILD_SHIPPING
+#endif
+
+#if NS_WITH_SHOT_TRACE
+
+class AActor;
+class UWorld;
+
+/** One authoritative shot as the server traced it */
+struct FNetworkShooterShotRecord
+{
+	FVector Origin;
+	FVector End;
+	FName HitActor;
+	float Time;
+};
+
+/**
+ * Bounded recorder for server shot traces, replaces leaving persistent debug lines in the world.
+ * Off unless ns.ShotTrace is set, keeps the most recent Capacity shots and can be dumped to disk
+ * with ns.ShotTrace.Dump for offline review.
+ */
+class NETWORKSHOOTER_API FNetworkShooterShotTrace
+{
+public:
+	static constexpr int32 Capacity = 4096;
+
+	FNetworkShooterShotTrace();
+
+	// Records a shot if tracing is enabled, optionally drawing a short lived line for it
+	void Record(UWorld* World, const FVector& Origin, const FVector& End, const AActor* HitActor, float Time);
+
+	// Writes the buffered shots, oldest first, to Filename. Returns the number written
+	int32 Dump(const FString& Filename) const;
+
+	void Reset();
+
+	int32 Num() const { return Count; }
+
+	SIZE_T GetAllocatedSize() const { return Records.GetAllocatedSize(); }
+
+private:
+	// Allocated the first time a shot is recorded, never resized after
+	TArray<FNetworkShooterShotRecord> Records;
+
+	int32 Head;
+	int32 Count;
+};
+
+#endif // NS_WITH_SHOT_TRACE
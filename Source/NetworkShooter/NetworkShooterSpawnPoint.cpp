@@ -2,13 +2,20 @@
 
 
 #include "NetworkShooterSpawnPoint.h"
+#include "NetworkShooterFrameBudget.h"
 #include "Components/CapsuleComponent.h"
 
 // Sets default values
 ANetworkShooterSpawnPoint::ANetworkShooterSpawnPoint()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	// Occupancy is tracked from overlap events, nothing to do per frame
+	PrimaryActorTick.bCanEverTick = false;
+
+	// Only used by the server, clients drop them when the map loads instead of tracking overlaps nobody reads
+	bReplicates = false;
+	bNetLoadOnClient = false;
+
+	bOccupancyStale = true;
 
 	SpawnCapsule = CreateDefaultSubobject<UCapsuleComponent>(TEXT("Capsule"));;
 	SpawnCapsule->SetCollisionProfileName("OverlapAllDynamic");
@@ -35,34 +42,82 @@ void ANetworkShooterSpawnPoint::OnConstruction(const FTransform& Transform)
 void ANetworkShooterSpawnPoint::BeginPlay()
 {
 	Super::BeginPlay();
-	
+
+	bOccupancyStale = true;
 }
 
-// Called every frame
-void ANetworkShooterSpawnPoint::Tick(float DeltaTime)
+bool ANetworkShooterSpawnPoint::GetBlocked()
 {
-	Super::Tick(DeltaTime);
-	SpawnCapsule->UpdateOverlaps();
+	// An actor destroyed without an end overlap leaves a dead entry behind
+	for (const TWeakObjectPtr<AActor>& Actor : OverlappingActors)
+	{
+		if (!Actor.IsValid())
+		{
+			bOccupancyStale = true;
+			break;
+		}
+	}
+
+	if (bOccupancyStale)
+	{
+		RefreshOccupancy();
+	}
+
+	return OverlappingActors.Num() != 0;
 }
 
-void ANetworkShooterSpawnPoint::ActorBeginOverlaps(AActor* OverlappedActor, AActor* OtherActor)
+void ANetworkShooterSpawnPoint::RefreshOccupancy()
 {
-	if (GetLocalRole() == ROLE_Authority)
+	NS_SCOPE_CYCLE_COUNTER(SpawnPointOccupancy);
+
+	const bool bWasBlocked = OverlappingActors.Num() != 0;
+
+	SpawnCapsule->UpdateOverlaps();
+
+	TArray<AActor*> Actors;
+	SpawnCapsule->GetOverlappingActors(Actors);
+
+	OverlappingActors.Reset();
+
+	for (AActor* Actor : Actors)
 	{
-		if (OverlappingActors.Find(OtherActor) == INDEX_NONE)
+		if (Actor != this)
 		{
-			OverlappingActors.Add(OtherActor);
+			OverlappingActors.Add(Actor);
 		}
 	}
+
+	bOccupancyStale = false;
+
+	if (bWasBlocked && OverlappingActors.Num() == 0)
+	{
+		OnSpawnPointFreed.Broadcast(this);
+	}
+}
+
+bool ANetworkShooterSpawnPoint::IsLagCompensationMove() const
+{
+	// A rewound character is put back before anyone reads occupancy, its overlaps come back in pairs
+	ANetworkShooterGameMode* GameMode = GetWorld()->GetAuthGameMode<ANetworkShooterGameMode>();
+
+	return GameMode != nullptr && GameMode->GetLagCompensation().IsRewinding();
+}
+
+void ANetworkShooterSpawnPoint::ActorBeginOverlaps(AActor* OverlappedActor, AActor* OtherActor)
+{
+	if (GetLocalRole() == ROLE_Authority && !IsLagCompensationMove())
+	{
+		OverlappingActors.AddUnique(OtherActor);
+	}
 }
 
 void ANetworkShooterSpawnPoint::ActorEndOverlaps(AActor* OverlappedActor, AActor* OtherActor)
 {
-	if (GetLocalRole() == ROLE_Authority)
+	if (GetLocalRole() == ROLE_Authority && !IsLagCompensationMove())
 	{
-		if (OverlappingActors.Find(OtherActor) != INDEX_NONE)
+		if (OverlappingActors.RemoveSwap(OtherActor) > 0 && OverlappingActors.Num() == 0)
 		{
-			OverlappingActors.Remove(OtherActor);
+			OnSpawnPointFreed.Broadcast(this);
 		}
 	}
 }
@@ -7,6 +7,10 @@
 #include "NetworkShooterGameMode.h"
 #include "NetworkShooterSpawnPoint.generated.h"
 
+class ANetworkShooterSpawnPoint;
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnSpawnPointFreed, ANetworkShooterSpawnPoint*);
+
 UCLASS()
 class NETWORKSHOOTER_API ANetworkShooterSpawnPoint : public AActor
 {
@@ -16,9 +20,6 @@ public:
 	// Sets default values for this actor's properties
 	ANetworkShooterSpawnPoint();
 
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
 	virtual void OnConstruction(const FTransform& Transform) override;
 
 	UFUNCTION()
@@ -27,14 +28,18 @@ public:
 	UFUNCTION()
 	void ActorEndOverlaps(AActor* OverlappedActor, AActor* OtherActor);
 
-	bool GetBlocked()
-	{
-		return OverlappingActors.Num() != 0;
-	}
+	// Only queries physics when the tracked overlaps can't be trusted
+	bool GetBlocked();
+
+	// Forces the next GetBlocked to refresh overlaps from physics
+	void MarkOccupancyStale() { bOccupancyStale = true; }
 
 	UPROPERTY(EditAnywhere, BlueprintReadOnly)
 	ETeam Team;
 
+	// Server only, broadcast when the last overlapping actor leaves
+	FOnSpawnPointFreed OnSpawnPointFreed;
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
@@ -42,5 +47,13 @@ protected:
 private:
 	class UCapsuleComponent* SpawnCapsule;
 
-	TArray<AActor*> OverlappingActors;
+	void RefreshOccupancy();
+
+	// Overlap events caused by a lag compensation rewind or restore, not real movement
+	bool IsLagCompensationMove() const;
+
+	// Kept up to date from overlap events, rarely holds more than one actor
+	TArray<TWeakObjectPtr<AActor>, TInlineAllocator<4>> OverlappingActors;
+
+	bool bOccupancyStale;
 };
@@ -0,0 +1,203 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterSpawnQueue.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterCharacter.h"
+#include "NetworkShooterGameMode.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+// Upper bounds in seconds of every wait bucket but the last
+static const double WaitBucketBounds[FNetworkShooterSpawnQueue::NumWaitBuckets - 1] = { 0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 5.0 };
+
+// Upper bounds of every depth bucket but the last
+static const int32 DepthBucketBounds[FNetworkShooterSpawnQueue::NumDepthBuckets - 1] = { 1, 2, 4, 8, 16, 32 };
+
+FNetworkShooterSpawnQueue::FNetworkShooterSpawnQueue()
+	: RetryInterval(1.0)
+	, MaxDepth(0)
+	, TotalSpawned(0)
+{
+	for (FTeamQueue* Queue : { &RedQueue, &BlueQueue })
+	{
+		Queue->bWoken = false;
+		Queue->LastAttempt = 0.0;
+	}
+
+	FMemory::Memzero(WaitHistogram);
+	FMemory::Memzero(DepthHistogram);
+}
+
+FNetworkShooterSpawnQueue::FTeamQueue& FNetworkShooterSpawnQueue::GetTeamQueue(ETeam Team)
+{
+	return Team == ETeam::RED_TEAM ? RedQueue : BlueQueue;
+}
+
+void FNetworkShooterSpawnQueue::Enqueue(ANetworkShooterCharacter* Character, ETeam Team, double Now)
+{
+	if (Contains(Character))
+	{
+		return;
+	}
+
+	FTeamQueue& Queue = GetTeamQueue(Team);
+
+	// Whoever queued it just failed to spawn it. Later arrivals leave the head's retry timer alone
+	if (Queue.Heap.Num() == 0)
+	{
+		Queue.LastAttempt = Now;
+	}
+
+	Queue.Heap.HeapPush({ Character, Now });
+
+	RecordDepth();
+}
+
+void FNetworkShooterSpawnQueue::Remove(ANetworkShooterCharacter* Character)
+{
+	for (FTeamQueue* Queue : { &RedQueue, &BlueQueue })
+	{
+		const int32 Index = Queue->Heap.IndexOfByPredicate([Character](const FEntry& Entry) { return Entry.Character.Get() == Character; });
+
+		if (Index != INDEX_NONE)
+		{
+			Queue->Heap.HeapRemoveAt(Index);
+		}
+	}
+}
+
+bool FNetworkShooterSpawnQueue::Contains(const ANetworkShooterCharacter* Character) const
+{
+	for (const FTeamQueue* Queue : { &RedQueue, &BlueQueue })
+	{
+		if (Queue->Heap.ContainsByPredicate([Character](const FEntry& Entry) { return Entry.Character.Get() == Character; }))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void FNetworkShooterSpawnQueue::Wake(ETeam Team)
+{
+	GetTeamQueue(Team).bWoken = true;
+}
+
+int32 FNetworkShooterSpawnQueue::Num() const
+{
+	return RedQueue.Heap.Num() + BlueQueue.Heap.Num();
+}
+
+int32 FNetworkShooterSpawnQueue::Update(double Now, TFunctionRef<bool(ANetworkShooterCharacter*)> TrySpawn)
+{
+	return UpdateTeam(RedQueue, Now, TrySpawn) + UpdateTeam(BlueQueue, Now, TrySpawn);
+}
+
+int32 FNetworkShooterSpawnQueue::UpdateTeam(FTeamQueue& Queue, double Now, TFunctionRef<bool(ANetworkShooterCharacter*)> TrySpawn)
+{
+	if (Queue.Heap.Num() == 0 || (!Queue.bWoken && Now - Queue.LastAttempt < RetryInterval))
+	{
+		Queue.bWoken = false;
+		return 0;
+	}
+
+	Queue.bWoken = false;
+	Queue.LastAttempt = Now;
+
+	int32 NumSpawned = 0;
+
+	while (Queue.Heap.Num() > 0)
+	{
+		// Pop before spawning so nothing TrySpawn does can disturb the heap under us
+		FEntry Entry;
+		Queue.Heap.HeapPop(Entry, false);
+
+		ANetworkShooterCharacter* Character = Entry.Character.Get();
+
+		if (Character == nullptr || Character->IsInPool())
+		{
+			continue;
+		}
+
+		if (!TrySpawn(Character))
+		{
+			// Still blocked, keep its place in line and wait for the next free point
+			Queue.Heap.HeapPush(Entry);
+			break;
+		}
+
+		const double Wait = Now - Entry.EnqueueTime;
+		int32 Bucket = 0;
+
+		while (Bucket < NumWaitBuckets - 1 && Wait > WaitBucketBounds[Bucket])
+		{
+			Bucket++;
+		}
+
+		WaitHistogram[Bucket]++;
+		TotalSpawned++;
+		NumSpawned++;
+	}
+
+	return NumSpawned;
+}
+
+void FNetworkShooterSpawnQueue::RecordDepth()
+{
+	const int32 Depth = Num();
+	int32 Bucket = 0;
+
+	while (Bucket < NumDepthBuckets - 1 && Depth > DepthBucketBounds[Bucket])
+	{
+		Bucket++;
+	}
+
+	DepthHistogram[Bucket]++;
+	MaxDepth = FMath::Max(MaxDepth, Depth);
+}
+
+void FNetworkShooterSpawnQueue::LogStats() const
+{
+	UE_LOG(LogNetworkShooter, Display, TEXT("Spawn queue: depth %d (max %d), %d spawned from the queue"), Num(), MaxDepth, TotalSpawned);
+
+	for (int32 Bucket = 0; Bucket < NumWaitBuckets; Bucket++)
+	{
+		if (Bucket < NumWaitBuckets - 1)
+		{
+			UE_LOG(LogNetworkShooter, Display, TEXT("  wait <= %5.2fs: %d"), WaitBucketBounds[Bucket], WaitHistogram[Bucket]);
+		}
+		else
+		{
+			UE_LOG(LogNetworkShooter, Display, TEXT("  wait  > %5.2fs: %d"), WaitBucketBounds[Bucket - 1], WaitHistogram[Bucket]);
+		}
+	}
+
+	for (int32 Bucket = 0; Bucket < NumDepthBuckets; Bucket++)
+	{
+		if (Bucket < NumDepthBuckets - 1)
+		{
+			UE_LOG(LogNetworkShooter, Display, TEXT("  depth <= %2d: %d"), DepthBucketBounds[Bucket], DepthHistogram[Bucket]);
+		}
+		else
+		{
+			UE_LOG(LogNetworkShooter, Display, TEXT("  depth  > %2d: %d"), DepthBucketBounds[Bucket - 1], DepthHistogram[Bucket]);
+		}
+	}
+}
+
+static void LogSpawnQueueStats(const TArray<FString>& Args, UWorld* World)
+{
+	ANetworkShooterGameMode* GameMode = World ? Cast<ANetworkShooterGameMode>(World->GetAuthGameMode()) : nullptr;
+
+	if (GameMode != nullptr)
+	{
+		GameMode->GetSpawnQueue().LogStats();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs SpawnQueueStatsCommand(
+	TEXT("ns.SpawnQueue.Stats"),
+	TEXT("Logs spawn queue depth and wait time histograms"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LogSpawnQueueStats));
@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ANetworkShooterCharacter;
+enum class ETeam : uint8;
+
+/**
+ * Characters waiting for a free spawn point, longest wait first. Each team's queue is only
+ * retried when one of its spawn points frees up (or on a slow fallback timer), instead of
+ * every character being re-tried every tick.
+ */
+class NETWORKSHOOTER_API FNetworkShooterSpawnQueue
+{
+public:
+	FNetworkShooterSpawnQueue();
+
+	void Enqueue(ANetworkShooterCharacter* Character, ETeam Team, double Now);
+	void Remove(ANetworkShooterCharacter* Character);
+	bool Contains(const ANetworkShooterCharacter* Character) const;
+
+	// A spawn point of Team became free, retry that queue on the next Update
+	void Wake(ETeam Team);
+
+	// Retries woken queues in wait order until TrySpawn fails, returns how many were spawned
+	int32 Update(double Now, TFunctionRef<bool(ANetworkShooterCharacter*)> TrySpawn);
+
+	int32 Num() const;
+
+	void LogStats() const;
+
+	// Seconds between retries of a queue that was never woken, covers missed overlap events
+	double RetryInterval;
+
+	// Histogram sizes, the last bucket of each catches everything above the others
+	static constexpr int32 NumWaitBuckets = 8;
+	static constexpr int32 NumDepthBuckets = 7;
+
+private:
+	struct FEntry
+	{
+		TWeakObjectPtr<ANetworkShooterCharacter> Character;
+		double EnqueueTime;
+
+		bool operator<(const FEntry& Other) const { return EnqueueTime < Other.EnqueueTime; }
+	};
+
+	struct FTeamQueue
+	{
+		// Binary heap on EnqueueTime
+		TArray<FEntry> Heap;
+		bool bWoken;
+		double LastAttempt;
+	};
+
+	FTeamQueue& GetTeamQueue(ETeam Team);
+	int32 UpdateTeam(FTeamQueue& Queue, double Now, TFunctionRef<bool(ANetworkShooterCharacter*)> TrySpawn);
+	void RecordDepth();
+
+	FTeamQueue RedQueue;
+	FTeamQueue BlueQueue;
+
+	int32 WaitHistogram[NumWaitBuckets];
+	int32 DepthHistogram[NumDepthBuckets];
+	int32 MaxDepth;
+	int32 TotalSpawned;
+};
@@ -0,0 +1,330 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetworkShooterSpawnSelector.h"
+#include "NetworkShooter.h"
+#include "NetworkShooterGameMode.h"
+#include "HAL/IConsoleManager.h"
+
+// Keeps the grid from getting silly on huge or degenerate maps
+static const int32 MaxGridDim = 128;
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterSpawnGrid
+
+FNetworkShooterSpawnGrid::FNetworkShooterSpawnGrid()
+{
+	Init(FBox(FVector::ZeroVector, FVector::ZeroVector), 1.0f);
+}
+
+void FNetworkShooterSpawnGrid::Init(const FBox& Bounds, float InCellSize)
+{
+	const FVector Size = Bounds.GetSize();
+
+	Origin = FVector2D(Bounds.Min.X, Bounds.Min.Y);
+	CellSize = FMath::Max(InCellSize, FMath::Max(Size.X, Size.Y) / MaxGridDim);
+	DimX = FMath::Clamp(FMath::CeilToInt(Size.X / CellSize), 1, MaxGridDim);
+	DimY = FMath::Clamp(FMath::CeilToInt(Size.Y / CellSize), 1, MaxGridDim);
+
+	CellStart.Reset();
+	CellStart.SetNumZeroed(DimX * DimY + 1);
+	Items.Reset();
+}
+
+void FNetworkShooterSpawnGrid::Build(const TArray<FVector>& Points)
+{
+	const int32 NumCells = DimX * DimY;
+
+	FMemory::Memzero(CellStart.GetData(), CellStart.Num() * sizeof(int32));
+	Items.SetNumUninitialized(Points.Num(), false);
+
+	// Count, prefix sum, then scatter
+	for (const FVector& Point : Points)
+	{
+		CellStart[CellIndex(Point) + 1]++;
+	}
+
+	for (int32 Cell = 0; Cell < NumCells; Cell++)
+	{
+		CellStart[Cell + 1] += CellStart[Cell];
+	}
+
+	CellCursor = CellStart;
+
+	for (int32 i = 0; i < Points.Num(); i++)
+	{
+		Items[CellCursor[CellIndex(Points[i])]++] = i;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FNetworkShooterSpawnSelector
+
+FNetworkShooterSpawnSelector::FNetworkShooterSpawnSelector()
+	: ThreatRadius(3000.0f)
+	, TeammateRadius(2000.0f)
+	, TeammateWeight(0.1f)
+	, MaxCandidates(64)
+	, QueryStamp(0)
+{
+	RedTeam.SampleOffset = 0;
+	BlueTeam.SampleOffset = 0;
+}
+
+FNetworkShooterSpawnSelector::FTeamSpawns& FNetworkShooterSpawnSelector::GetTeamSpawns(ETeam Team)
+{
+	return Team == ETeam::RED_TEAM ? RedTeam : BlueTeam;
+}
+
+void FNetworkShooterSpawnSelector::SetSpawnLocations(const TArray<FVector>& RedSpawns, const TArray<FVector>& BlueSpawns)
+{
+	FBox Bounds(ForceInit);
+
+	for (const FVector& Location : RedSpawns)
+	{
+		Bounds += Location;
+	}
+
+	for (const FVector& Location : BlueSpawns)
+	{
+		Bounds += Location;
+	}
+
+	if (!Bounds.IsValid)
+	{
+		Bounds = FBox(FVector::ZeroVector, FVector::ZeroVector);
+	}
+
+	// Characters outside the spawn area land in the edge cells, which is fine for scoring
+	const float CellSize = ThreatRadius * 0.5f;
+
+	RedTeam.Locations = RedSpawns;
+	BlueTeam.Locations = BlueSpawns;
+
+	for (FTeamSpawns* TeamSpawns : { &RedTeam, &BlueTeam })
+	{
+		TeamSpawns->Grid.Init(Bounds, CellSize);
+		TeamSpawns->Grid.Build(TeamSpawns->Locations);
+		TeamSpawns->VisitedStamp.SetNumZeroed(TeamSpawns->Locations.Num());
+		TeamSpawns->SampleOffset = 0;
+	}
+
+	CharacterGrid.Init(Bounds, CellSize);
+	CharacterGrid.Build(CharacterLocations);
+}
+
+void FNetworkShooterSpawnSelector::SetCharacters(const TArray<FVector>& Locations, const TArray<ETeam>& Teams)
+{
+	check(Locations.Num() == Teams.Num());
+
+	CharacterLocations = Locations;
+	CharacterTeams = Teams;
+	CharacterGrid.Build(CharacterLocations);
+}
+
+float FNetworkShooterSpawnSelector::ScoreLocation(ETeam Team, const FVector& Location) const
+{
+	float NearestEnemySq = FMath::Square(ThreatRadius);
+	const float TeammateRadiusSq = FMath::Square(TeammateRadius);
+	int32 NumTeammates = 0;
+
+	CharacterGrid.ForEachNear(Location, FMath::Max(ThreatRadius, TeammateRadius), [&](int32 i)
+	{
+		const float DistSq = FVector::DistSquared(Location, CharacterLocations[i]);
+
+		if (CharacterTeams[i] != Team)
+		{
+			NearestEnemySq = FMath::Min(NearestEnemySq, DistSq);
+		}
+		else if (DistSq <= TeammateRadiusSq)
+		{
+			NumTeammates++;
+		}
+	});
+
+	// 0 with an enemy on top of the point, 1 with none inside the threat radius
+	return FMath::Sqrt(NearestEnemySq) / ThreatRadius + TeammateWeight * FMath::Min(NumTeammates, 4);
+}
+
+int32 FNetworkShooterSpawnSelector::SelectSpawn(ETeam Team, TFunctionRef<bool(int32)> IsAvailable)
+{
+	FTeamSpawns& TeamSpawns = GetTeamSpawns(Team);
+	const int32 NumSpawns = TeamSpawns.Locations.Num();
+
+	if (NumSpawns == 0)
+	{
+		return INDEX_NONE;
+	}
+
+	QueryStamp++;
+	Candidates.Reset();
+
+	auto AddCandidate = [&](int32 Spawn)
+	{
+		if (Candidates.Num() < MaxCandidates && TeamSpawns.VisitedStamp[Spawn] != QueryStamp)
+		{
+			TeamSpawns.VisitedStamp[Spawn] = QueryStamp;
+			Candidates.Add(Spawn);
+		}
+	};
+
+	// Points around living teammates first
+	for (int32 i = 0; i < CharacterLocations.Num() && Candidates.Num() < MaxCandidates; i++)
+	{
+		if (CharacterTeams[i] == Team)
+		{
+			TeamSpawns.Grid.ForEachNear(CharacterLocations[i], TeammateRadius, AddCandidate);
+		}
+	}
+
+	// Then a rotating slice of the rest so a lone player still gets choices
+	const int32 NumSamples = FMath::Min(NumSpawns, MaxCandidates / 2);
+	const int32 Stride = FMath::Max(NumSpawns / FMath::Max(NumSamples, 1), 1);
+
+	for (int32 i = 0; i < NumSamples; i++)
+	{
+		AddCandidate((TeamSpawns.SampleOffset + i * Stride) % NumSpawns);
+	}
+
+	TeamSpawns.SampleOffset = (TeamSpawns.SampleOffset + 1) % NumSpawns;
+
+	int32 BestSpawn = INDEX_NONE;
+	float BestScore = -MAX_flt;
+
+	for (int32 Spawn : Candidates)
+	{
+		const float Score = ScoreLocation(Team, TeamSpawns.Locations[Spawn]);
+
+		if (Score > BestScore && IsAvailable(Spawn))
+		{
+			BestScore = Score;
+			BestSpawn = Spawn;
+		}
+	}
+
+	// Every candidate was blocked, take any free point rather than queueing the player
+	if (BestSpawn == INDEX_NONE)
+	{
+		for (int32 Spawn = 0; Spawn < NumSpawns; Spawn++)
+		{
+			if (TeamSpawns.VisitedStamp[Spawn] != QueryStamp && IsAvailable(Spawn))
+			{
+				return Spawn;
+			}
+		}
+	}
+
+	return BestSpawn;
+}
+
+int32 FNetworkShooterSpawnSelector::SelectSpawnBruteForce(ETeam Team, TFunctionRef<bool(int32)> IsAvailable) const
+{
+	const FTeamSpawns& TeamSpawns = Team == ETeam::RED_TEAM ? RedTeam : BlueTeam;
+	const float TeammateRadiusSq = FMath::Square(TeammateRadius);
+
+	int32 BestSpawn = INDEX_NONE;
+	float BestScore = -MAX_flt;
+
+	for (int32 Spawn = 0; Spawn < TeamSpawns.Locations.Num(); Spawn++)
+	{
+		const FVector& Location = TeamSpawns.Locations[Spawn];
+		float NearestEnemySq = FMath::Square(ThreatRadius);
+		int32 NumTeammates = 0;
+
+		for (int32 i = 0; i < CharacterLocations.Num(); i++)
+		{
+			const float DistSq = FVector::DistSquared(Location, CharacterLocations[i]);
+
+			if (CharacterTeams[i] != Team)
+			{
+				NearestEnemySq = FMath::Min(NearestEnemySq, DistSq);
+			}
+			else if (DistSq <= TeammateRadiusSq)
+			{
+				NumTeammates++;
+			}
+		}
+
+		const float Score = FMath::Sqrt(NearestEnemySq) / ThreatRadius + TeammateWeight * FMath::Min(NumTeammates, 4);
+
+		if (Score > BestScore && IsAvailable(Spawn))
+		{
+			BestScore = Score;
+			BestSpawn = Spawn;
+		}
+	}
+
+	return BestSpawn;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Benchmark
+
+static void RunSpawnSelectionBenchmark(const TArray<FString>& Args)
+{
+	const int32 NumSpawns = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1000;
+	const int32 NumCharacters = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 128;
+	const int32 NumQueries = Args.Num() > 2 ? FCString::Atoi(*Args[2]) : 10000;
+	const float MapExtent = 20000.0f;
+
+	FRandomStream Random(1337);
+
+	TArray<FVector> RedSpawns;
+	TArray<FVector> BlueSpawns;
+
+	for (int32 i = 0; i < NumSpawns; i++)
+	{
+		const FVector Location(Random.FRandRange(-MapExtent, MapExtent), Random.FRandRange(-MapExtent, MapExtent), 0.0f);
+		(i % 2 == 0 ? RedSpawns : BlueSpawns).Add(Location);
+	}
+
+	TArray<FVector> Locations;
+	TArray<ETeam> Teams;
+
+	for (int32 i = 0; i < NumCharacters; i++)
+	{
+		Locations.Add(FVector(Random.FRandRange(-MapExtent, MapExtent), Random.FRandRange(-MapExtent, MapExtent), 0.0f));
+		Teams.Add(i % 2 == 0 ? ETeam::RED_TEAM : ETeam::BLUE_TEAM);
+	}
+
+	FNetworkShooterSpawnSelector Selector;
+	Selector.SetSpawnLocations(RedSpawns, BlueSpawns);
+
+	auto AlwaysAvailable = [](int32) { return true; };
+
+	double StartTime = FPlatformTime::Seconds();
+
+	for (int32 Query = 0; Query < NumQueries; Query++)
+	{
+		Selector.SetCharacters(Locations, Teams);
+	}
+
+	const double RebuildTime = FPlatformTime::Seconds() - StartTime;
+
+	StartTime = FPlatformTime::Seconds();
+
+	for (int32 Query = 0; Query < NumQueries; Query++)
+	{
+		Selector.SelectSpawn(Query % 2 == 0 ? ETeam::RED_TEAM : ETeam::BLUE_TEAM, AlwaysAvailable);
+	}
+
+	const double SelectTime = FPlatformTime::Seconds() - StartTime;
+
+	StartTime = FPlatformTime::Seconds();
+
+	for (int32 Query = 0; Query < NumQueries; Query++)
+	{
+		Selector.SelectSpawnBruteForce(Query % 2 == 0 ? ETeam::RED_TEAM : ETeam::BLUE_TEAM, AlwaysAvailable);
+	}
+
+	const double BruteForceTime = FPlatformTime::Seconds() - StartTime;
+
+	UE_LOG(LogNetworkShooter, Display, TEXT("Spawn selection: %d spawn points, %d characters, %d queries"), NumSpawns, NumCharacters, NumQueries);
+	UE_LOG(LogNetworkShooter, Display, TEXT("  character grid rebuild %.3f us, grid select %.3f us, brute force select %.3f us"),
+		RebuildTime * 1000000.0 / NumQueries, SelectTime * 1000000.0 / NumQueries, BruteForceTime * 1000000.0 / NumQueries);
+}
+
+static FAutoConsoleCommandWithArgs SpawnSelectionBenchmarkCommand(
+	TEXT("ns.Spawn.Bench"),
+	TEXT("Times spawn point selection. Usage: ns.Spawn.Bench [NumSpawns=1000] [NumCharacters=128] [NumQueries=10000]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&RunSpawnSelectionBenchmark));
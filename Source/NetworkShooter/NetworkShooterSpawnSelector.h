@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+enum class ETeam : uint8;
+
+/**
+ * Flat 2D bucket grid over the XY plane. Items are stored sorted by cell so each
+ * cell is a contiguous range, rebuilt in one counting sort pass.
+ */
+struct NETWORKSHOOTER_API FNetworkShooterSpawnGrid
+{
+	FNetworkShooterSpawnGrid();
+
+	void Init(const FBox& Bounds, float InCellSize);
+	void Build(const TArray<FVector>& Points);
+
+	// Calls Fn with the index of every point whose cell overlaps the square around Location
+	template<typename FunctionType>
+	void ForEachNear(const FVector& Location, float Radius, FunctionType&& Fn) const
+	{
+		const int32 MinX = CellX(Location.X - Radius);
+		const int32 MaxX = CellX(Location.X + Radius);
+		const int32 MinY = CellY(Location.Y - Radius);
+		const int32 MaxY = CellY(Location.Y + Radius);
+
+		for (int32 y = MinY; y <= MaxY; y++)
+		{
+			for (int32 x = MinX; x <= MaxX; x++)
+			{
+				const int32 Cell = y * DimX + x;
+
+				for (int32 i = CellStart[Cell]; i < CellStart[Cell + 1]; i++)
+				{
+					Fn(Items[i]);
+				}
+			}
+		}
+	}
+
+private:
+	int32 CellX(float X) const { return FMath::Clamp(FMath::FloorToInt((X - Origin.X) / CellSize), 0, DimX - 1); }
+	int32 CellY(float Y) const { return FMath::Clamp(FMath::FloorToInt((Y - Origin.Y) / CellSize), 0, DimY - 1); }
+	int32 CellIndex(const FVector& Location) const { return CellY(Location.Y) * DimX + CellX(Location.X); }
+
+	FVector2D Origin;
+	float CellSize;
+	int32 DimX;
+	int32 DimY;
+
+	// CellStart[c]..CellStart[c + 1] is the range of Items in cell c
+	TArray<int32> CellStart;
+	TArray<int32> Items;
+
+	// Scratch write positions for Build
+	TArray<int32> CellCursor;
+};
+
+/**
+ * Picks spawn points for a team. Candidates are gathered from spawn points near living
+ * teammates (plus a bounded rotating sample) and scored against nearby characters found
+ * through a grid, so the cost depends on local density rather than map size.
+ */
+class NETWORKSHOOTER_API FNetworkShooterSpawnSelector
+{
+public:
+	FNetworkShooterSpawnSelector();
+
+	// Builds the spawn point grids, indices returned by SelectSpawn refer to these arrays
+	void SetSpawnLocations(const TArray<FVector>& RedSpawns, const TArray<FVector>& BlueSpawns);
+
+	// Replaces the living character set used for scoring
+	void SetCharacters(const TArray<FVector>& Locations, const TArray<ETeam>& Teams);
+
+	/**
+	 * Returns the index of the best scoring spawn point for Team that IsAvailable accepts,
+	 * or INDEX_NONE if every candidate was rejected.
+	 */
+	int32 SelectSpawn(ETeam Team, TFunctionRef<bool(int32)> IsAvailable);
+
+	// Scores every spawn point against every character, for comparison in benchmarks
+	int32 SelectSpawnBruteForce(ETeam Team, TFunctionRef<bool(int32)> IsAvailable) const;
+
+	// Enemies closer than this make a spawn point progressively worse
+	float ThreatRadius;
+
+	// Teammates closer than this make a spawn point slightly better
+	float TeammateRadius;
+
+	float TeammateWeight;
+
+	// Upper bound on spawn points scored per query
+	int32 MaxCandidates;
+
+private:
+	struct FTeamSpawns
+	{
+		TArray<FVector> Locations;
+		FNetworkShooterSpawnGrid Grid;
+
+		// Query stamp per spawn point, avoids scoring the same point twice
+		TArray<uint32> VisitedStamp;
+
+		// Where the fallback sample starts next time so repeated spawns spread out
+		int32 SampleOffset;
+	};
+
+	FTeamSpawns& GetTeamSpawns(ETeam Team);
+
+	float ScoreLocation(ETeam Team, const FVector& Location) const;
+
+	FTeamSpawns RedTeam;
+	FTeamSpawns BlueTeam;
+
+	TArray<FVector> CharacterLocations;
+	TArray<ETeam> CharacterTeams;
+	FNetworkShooterSpawnGrid CharacterGrid;
+
+	TArray<int32> Candidates;
+	uint32 QueryStamp;
+};
@@ -0,0 +1,25 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+using System.Collections.Generic;
+
+public class NetworkShooterServerTarget : TargetRules
+{
+	public NetworkShooterServerTarget(TargetInfo Target) : base(Target)
+	{
+		Type = TargetType.Server;
+		DefaultBuildSettings = BuildSettingsVersion.V2;
+		ExtraModuleNames.Add("NetworkShooter");
+
+		// Server targets only build against a source built engine, the launcher install ships no server binaries.
+		// With its own build environment the target may also change engine settings such as push model
+		BuildEnvironment = TargetBuildEnvironment.Unique;
+
+		// Player state and character properties are push model replicated, the game and editor targets
+		// turn it on too when they are built against a source built engine
+		bWithPushModel = true;
+
+		// Server logs are all there is to go on, keep them in shipping builds too
+		bUseLoggingInShipping = true;
+	}
+}